@@ -276,9 +276,8 @@ int Addsynth::save (const char *sdir)
 int Addsynth::load (const char *sdir)
 {
     FILE  *F;
-    char   d [32];
     char   path [1024];    
-    int    v, k;
+    int    r;
 
     strcpy (path, sdir);
     strcat (path, "/");
@@ -291,12 +290,25 @@ int Addsynth::load (const char *sdir)
         fprintf (stderr, "Can't open '%s' for reading\n", path);
         return 1;
     }
+    r = load (F);
+    fclose (F);
+    return r;
+}
+
+
+// Read the stop from an open file, or a member of a bundle.
+//
+int Addsynth::load (FILE *F)
+{
+    char   d [32];
+    int    v, k;
+
+    reset (); 
 
     fread (d, 1, 32, F);
     if (strcmp (d, "AEOLUS"))
     {
         fprintf (stderr, "File '%s' is not an Aeolus file\n", _filename);
-        fclose (F); 
         return 1;
     }
     v = d [7];
@@ -334,7 +346,6 @@ int Addsynth::load (const char *sdir)
     _h_att.read (F, k);    
     _h_atp.read (F, k);    
 
-    fclose (F);
     return 0;
 }
 
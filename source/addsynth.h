@@ -95,6 +95,7 @@ public:
     void reset (void);
     int save (const char *sdir); 
     int load (const char *sdir);
+    int load (FILE *F);
     
     char       _filename [64]; 
     char       _stopname [32];
@@ -42,15 +42,32 @@ Diffuser::Diffuser (int size, float c)
 }
 
 
-float Diffuser::process (float x)
+// Process a block of at most PERIOD samples, x and y may be the
+// same. Since the delay is at least PERIOD, no sample read in this
+// block is written in the same block, and the loop has no carried
+// dependency.
+//
+void Diffuser::process (const float *x, float *y, int n)
 {
-    float w;
+    int   i;
+    float w, *d;
+
+    period_begin ();
+    d = _data.get () + _i;
+    for (i = 0; i < n; i++)
+    {
+        w = x [i] - _c * d [i];
+        y [i] = d [i] + _c * w;
+        d [i] = w;
+    }
+    _i += n;  // wrapping is handled by period_end ()
+    period_end ();
+}
+
 
-    w = x - _c * _data [_i];
-    x = _data [_i] + _c * w;
-    _data [_i] = w;
-    ++_i;  // wrapping is handled by period_end ()
-    return x;
+void Diffuser::reset (void)
+{
+    std::fill_n (_data.get (), _size + PERIOD - 1, 0.0f);
 }
 
 
@@ -86,27 +103,39 @@ Asection::Asection (float fsam) : _fsam (fsam)
     _base = std::make_unique <float []> (NCHANN * N);
 
     _offs0 = 0;
+    _nidle = 0;
+    _idle = false;
+    _reduce = false;
+    _ntaps = 16;
     _sw = _sx = _sy = 0.0f;
     _dif0 = Diffuser ((int)(fsam * 0.017f), 0.5f);
     _dif1 = Diffuser ((int)(fsam * 0.029f), 0.5f);
     _dif2 = Diffuser ((int)(fsam * 0.023f), 0.5f);
     _dif3 = Diffuser ((int)(fsam * 0.013f), 0.5f);
+    init_apar (_apar);
+}
 
-    _apar [AZIMUTH]._val =  0.0f;
-    _apar [AZIMUTH]._min = -0.5f;
-    _apar [AZIMUTH]._max =  0.5f;
-    _apar [STWIDTH]._val = 0.8f;
-    _apar [STWIDTH]._min = 0.0f;
-    _apar [STWIDTH]._max = 1.0f;
-    _apar [DIRECT]._val = 0.56f;
-    _apar [DIRECT]._min = 0.00f;
-    _apar [DIRECT]._max = 1.00f;
-    _apar [REFLECT]._val = 0.25f;
-    _apar [REFLECT]._min = 0.00f;
-    _apar [REFLECT]._max = 1.00f;
-    _apar [REVERB]._val = 0.32f;
-    _apar [REVERB]._min = 0.00f;
-    _apar [REVERB]._max = 1.00f;
+
+// Set the parameters to their defaults. Also used by the model
+// thread when the instrument is replaced.
+//
+void Asection::init_apar (Fparm *P)
+{
+    P [AZIMUTH]._val =  0.0f;
+    P [AZIMUTH]._min = -0.5f;
+    P [AZIMUTH]._max =  0.5f;
+    P [STWIDTH]._val = 0.8f;
+    P [STWIDTH]._min = 0.0f;
+    P [STWIDTH]._max = 1.0f;
+    P [DIRECT]._val = 0.56f;
+    P [DIRECT]._min = 0.00f;
+    P [DIRECT]._max = 1.00f;
+    P [REFLECT]._val = 0.25f;
+    P [REFLECT]._min = 0.00f;
+    P [REFLECT]._max = 1.00f;
+    P [REVERB]._val = 0.32f;
+    P [REVERB]._min = 0.00f;
+    P [REVERB]._max = 1.00f;
 }
 
 
@@ -126,6 +155,20 @@ void Asection::set_size (float time)
 }
 
 
+// At reduced quality the reflections are not diffused. The diffusers
+// are cleared when switching so they don't resume with old signal.
+//
+void Asection::set_reduced (bool on)
+{
+    if (on == _reduce) return;
+    _reduce = on;
+    _dif0.reset ();
+    _dif1.reset ();
+    _dif2.reset ();
+    _dif3.reset ();
+}
+
+
 void Asection::process (float vol, float *W, float *X, float *Y, float *R) 
 {
     int     i;
@@ -135,6 +178,8 @@ void Asection::process (float vol, float *W, float *X, float *Y, float *R)
     float   x [PERIOD];
     float   y [PERIOD];
 
+    if (_idle) return;
+
     gw = vol * _apar [DIRECT]._val;   
     g = 0.45f * _apar [STWIDTH]._val;
     s = 0.5f + g * (1 - g);
@@ -162,29 +207,36 @@ void Asection::process (float vol, float *W, float *X, float *Y, float *R)
         y [i] = gy1 * (t3 - t0) + gy2 * (t2 - t1);
     }
 
-    _dif0.period_begin ();
-    p = _base.get ();
-    for (i = 0; i < PERIOD; i++, p++)
-        ta0 [i] = _dif0.process (p [_offs [1]] + p [_offs  [5]] + p [_offs [11]] + p [_offs [15]] + 1e-20f);
-    _dif0.period_end ();
-
-    _dif1.period_begin ();
-    p = _base.get ();
-    for (i = 0; i < PERIOD; i++, p++)
-        ta1 [i] = _dif1.process (p [_offs [0]] + p [_offs  [4]] + p [_offs [10]] + p [_offs [14]] + 1e-20f);
-    _dif1.period_end ();
-
-    _dif2.period_begin ();
-    p = _base.get ();
-    for (i = 0; i < PERIOD; i++, p++)
-        ta2 [i] = _dif2.process (p [_offs [2]] + p [_offs  [6]] + p [_offs  [8]] + p [_offs [12]] + 2e-20f);
-    _dif2.period_end ();
-
-    _dif3.period_begin ();
     p = _base.get ();
-    for (i = 0; i < PERIOD; i++, p++)
-        ta3 [i] = _dif3.process (p [_offs [3]] + p [_offs  [7]] + p [_offs  [9]] + p [_offs [13]] + 2e-20f);
-    _dif3.period_end ();
+    if (_ntaps == 16)
+    {
+        for (i = 0; i < PERIOD; i++, p++)
+        {
+            ta0 [i] = p [_offs [1]] + p [_offs  [5]] + p [_offs [11]] + p [_offs [15]] + 1e-20f;
+            ta1 [i] = p [_offs [0]] + p [_offs  [4]] + p [_offs [10]] + p [_offs [14]] + 1e-20f;
+            ta2 [i] = p [_offs [2]] + p [_offs  [6]] + p [_offs  [8]] + p [_offs [12]] + 2e-20f;
+            ta3 [i] = p [_offs [3]] + p [_offs  [7]] + p [_offs  [9]] + p [_offs [13]] + 2e-20f;
+        }
+    }
+    else
+    {
+        // Every other reflection, at +3 dB to keep the same power.
+        g = std::numbers::sqrt2_v<float>;
+        for (i = 0; i < PERIOD; i++, p++)
+        {
+            ta0 [i] = g * (p [_offs [1]] + p [_offs [11]]) + 1e-20f;
+            ta1 [i] = g * (p [_offs [0]] + p [_offs [10]]) + 1e-20f;
+            ta2 [i] = g * (p [_offs [2]] + p [_offs  [8]]) + 2e-20f;
+            ta3 [i] = g * (p [_offs [3]] + p [_offs [13]]) + 2e-20f;
+        }
+    }
+    if (! _reduce)
+    {
+        _dif0.process (ta0, ta0, PERIOD);
+        _dif1.process (ta1, ta1, PERIOD);
+        _dif2.process (ta2, ta2, PERIOD);
+        _dif3.process (ta3, ta3, PERIOD);
+    }
 
     gr = vol * _apar [REFLECT]._val;
     for (i = 0; i < PERIOD; i++)
@@ -218,5 +270,26 @@ void Asection::process (float vol, float *W, float *X, float *Y, float *R)
     std::fill_n (p + 1 * N, PERIOD, 0);
     std::fill_n (p + 2 * N, PERIOD, 0);
     std::fill_n (p + 3 * N, PERIOD, 0);
+
+    // After MIXLEN periods without input the whole ring has been read
+    // and cleared. The section then goes idle as soon as the diffusers
+    // have decayed, until a division wakes it up again.
+    if (++_nidle >= MIXLEN)
+    {
+        for (i = 0, s = 0; i < PERIOD; i++)
+        {
+            s = fmaxf (s, fabsf (ta0 [i]) + fabsf (ta1 [i]) + fabsf (ta2 [i]) + fabsf (ta3 [i]));
+        }
+        if (s < IDLE_LEVEL)
+        {
+            _dif0.reset ();
+            _dif1.reset ();
+            _dif2.reset ();
+            _dif3.reset ();
+            _sw = _sx = _sy = 0.0f;
+            _idle = true;
+        }
+        _nidle = MIXLEN;
+    }
 }
 
@@ -29,6 +29,7 @@
 #define PERIOD 64
 #define MIXLEN 64
 #define NCHANN 4
+#define IDLE_LEVEL 1e-10f  // divisions and asections below this are silent
 
 
 class Diffuser
@@ -39,12 +40,14 @@ public:
     Diffuser (int size, float c);
 
     int  size (void) { return _size; }
-    float process (float x);
-    void period_begin ();
-    void period_end ();
+    void process (const float *x, float *y, int n);
+    void reset (void);
 
 private:
 
+    void period_begin ();
+    void period_end ();
+
     std::unique_ptr <float []> _data;
     int        _size;
     int        _i;
@@ -60,8 +63,12 @@ public:
 
     float *get_wptr (void) { return _base.get () + _offs0; }
     Fparm *get_apar (void) { return _apar; }
+    static void init_apar (Fparm *P);
+    void wake (void) { _nidle = 0; _idle = false; }
 
     void set_size (float size);
+    void set_reduced (bool on);
+    void set_ntaps (int n) { _ntaps = n; }
     void process (float vol, float *W, float *X, float *Y, float *R);
     
     static float _refl [16];
@@ -72,6 +79,10 @@ private:
 
     int      _offs0;
     int      _offs [16];
+    int      _nidle;   // periods since the last input
+    bool     _idle;    // ring, diffusers and filters are all zero
+    bool     _reduce;  // bypass the diffusers
+    int      _ntaps;   // number of reflections, 16 or 8
     float    _fsam;
     std::unique_ptr <float []> _base;
     float    _sw;
@@ -24,6 +24,8 @@
 #include <numbers>
 #include <stop_token>
 #include <utility>
+#include <time.h>
+#include <unistd.h>
 #include "audio.h"
 #include "global.h"
 #include "messages.h"
@@ -32,12 +34,32 @@
 #endif
 
 
+// Adaptive quality. Level 0 is the quality of the selected profile,
+// each next level adds a reduction: 1 limits voices and release tails,
+// 2 bypasses the asection diffusers, 3 halves the number of reverb
+// delay lines.
+//
+#define NQUAL     4
+#define QLOAD_HI  0.80f   // reduce quality at this fraction of the period
+#define QLOAD_LO  0.50f   // restore it when the load stays below this
+#define QLOAD_TC  0.05f   // time constant of the averaged load, seconds
+#define QTIME_LO  2.0f    // for this many seconds
+#define QTIME_HI  0.25f   // minimum time between reductions
+
+#define XFADE_TIME 0.2f   // crossfade when the instrument is replaced
+
+
+bool Audio::_adapt = false;
+int  Audio::_profile = PROF_FULL;
+bool Audio::_upsample = false;
+
 
 Audio::Audio (const char *name, Lfq_u32 *qnote, Lfq_u32 *qcomm) :
     A_thread("Audio"),
     _appname (name),
     _qnote (qnote),
     _qcomm (qcomm),
+    _qmidi (0),
     _running (std::nostopstate),
     _abspri (0),
     _relpri (0),
@@ -46,24 +68,56 @@ Audio::Audio (const char *name, Lfq_u32 *qnote, Lfq_u32 *qcomm) :
     _fsize (0),
     _bform (0),
     _binaural (0),
+    _topology (OUT_MIXED),
     _nasect (0),
-    _ndivis (0)
+    _ndivis (0),
+    _ndnext (0),
+    _nfade (0),
+    _swap (0),
+    _tid (0),
+    _qlevel (0),
+    _qload (0.0f),
+    _qtime (0.0f),
+    _qwait (0.0f),
+    _qstat { 0, 0 }
 {
 }
 
 
 Audio::~Audio ()
 {
+    if (_swap) _swap->recover ();
 }
 
 
 void Audio::init_audio (bool binaural)
 {
-    int i;
+    int i, k;
 
 #if LIBSPATIALAUDIO_VERSION
     _binaural = binaural;
 #endif
+
+    // With upsampling, everything runs at a half or a quarter of the
+    // device rate if that is still at least 44.1 kHz and the period
+    // is a multiple of PERIOD at that rate, and the output ports are
+    // upsampled. From here on _fsamp is the synthesis rate.
+    if (_upsample)
+    {
+        for (k = 4; k > 1; k /= 2)
+	{
+            if ((_fsamp >= 44100U * k) && (_fsize % (PERIOD * k) == 0)) break;
+	}
+        if (k > 1)
+	{
+            _upsamp.init (_nplay, k, _fsize / k);
+            _fsamp /= k;
+	}
+        else if (_fsamp >= 88200)
+	{
+            fprintf (stderr, "Warning: period size %d is not a multiple of %d, not upsampling.\n", _fsize, 2 * PERIOD);
+	}
+    }
     
     _audiopar [VOLUME]._val = VOLUME_DEF;
     _audiopar [VOLUME]._min = VOLUME_MIN;
@@ -88,19 +142,21 @@ void Audio::init_audio (bool binaural)
     _reverb.set_t60mf (_revtime);
     _reverb.set_t60lo (_revtime * 1.50f, 250.0f);
     _reverb.set_t60hi (_revtime * 0.50f, 3e3f);
+    _reverb.set_reduced (_profile == PROF_LITE);
 
     _nasect = NASECT;
     for (i = 0; i < NASECT; i++)
     {
         _asectp [i] = std::make_unique <Asection> ((float) _fsamp);
         _asectp [i]->set_size (_revsize);
+        _asectp [i]->set_ntaps ((_profile == PROF_FULL) ? 16 : 8);
     }
     _hold = KMAP_ALL;
 
 #if LIBSPATIALAUDIO_VERSION
     if (_binaural)
     {
-        if (!_binauralizer_src.Configure (1, true, _fsize))
+        if (!_binauralizer_src.Configure (1, true, _fsize / _upsamp.fact ()))
         {
             fprintf (stderr, "Unable to configure binauralizer buffer; disabling.\n");
             _binaural = false;
@@ -108,7 +164,7 @@ void Audio::init_audio (bool binaural)
         else
         {
             unsigned tailLength;
-            if (!_binauralizer.Configure (1, true, _fsamp, _fsize, tailLength, ""))
+            if (!_binauralizer.Configure (1, true, _fsamp, _fsize / _upsamp.fact (), tailLength, ""))
             {
                 fprintf (stderr, "Unable to configure binauralizer; disabling.\n");
                 _binaural = false;
@@ -117,10 +173,10 @@ void Audio::init_audio (bool binaural)
             else
             {
                 // starting with libspatialaudio 0.3.1 this is no longer a limitation
-                if (tailLength > _fsize)
+                if (tailLength > _fsize / _upsamp.fact ())
                 {
                     fprintf (stderr, "Audio period size too small for binauralizer (have %d, need >= %d); disabling.\n",
-                        _fsize, tailLength);
+                        _fsize / _upsamp.fact (), tailLength);
                     _binaural = false;
                 }
             }
@@ -142,6 +198,10 @@ void Audio::start (void)
     M->_fsize  = _fsize;
     M->_instrpar = _audiopar;
     for (i = 0; i < _nasect; i++) M->_asectpar [i] = _asectp [i]->get_apar ();
+    M->_tid = &_tid;
+    M->_qstat = _qstat;
+    M->_policy = _policy;
+    M->_relpri = _relpri;
     send_event (TO_MODEL, M);
 }
 
@@ -150,10 +210,12 @@ void Audio::proc_queue (Lfq_u32 *Q)
     int       c, i, j, k, n;
     uint32_t  q;
     uint16_t  m;
+    Division  *D;
     union     { uint32_t i; float f; } u;
 
     // Execute commands from the model thread (qcomm),
-    // or from the midi thread (qnote).
+    // or from the midi thread (qnote). Commands for a
+    // division that does not exist are ignored.
 
     n = Q->read_avail ();
     while (n > 0)
@@ -163,6 +225,7 @@ void Audio::proc_queue (Lfq_u32 *Q)
         i = (q >> 16) & 255;  // key, rank or parameter index
         j = (q >>  8) & 255;  // division index
         k = q & 255;          // keyboard index
+        D = (j < _ndivis) ? _divisp [j].get () : 0;
 
         switch (static_cast<command>(c))
 	{
@@ -191,25 +254,25 @@ void Audio::proc_queue (Lfq_u32 *Q)
 
         case command::clr_div_mask:
 	    // Clear bit in division mask.
-            _divisp [j]->clr_div_mask (k & 0xf, k >> 4);
+            if (D) D->clr_div_mask (k & 0xf, k >> 4);
 	    Q->read_commit (1);
             break;
 
         case command::set_div_mask:
 	    // Set bit in division mask.
-            _divisp [j]->set_div_mask (k & 0xf, k >> 4);
+            if (D) D->set_div_mask (k & 0xf, k >> 4);
 	    Q->read_commit (1);
             break;
 
         case command::clr_rank_mask:
 	    // Clear bit in rank mask.
-            _divisp [j]->clr_rank_mask (i, k & 0xf, k >> 4);
+            if (D) D->clr_rank_mask (i, k & 0xf, k >> 4);
 	    Q->read_commit (1);
             break;
 
         case command::set_rank_mask:
 	    // Set bit in rank mask.
-            _divisp [j]->set_rank_mask (i, k & 0xf, k >> 4);
+            if (D) D->set_rank_mask (i, k & 0xf, k >> 4);
 	    Q->read_commit (1);
             break;
 
@@ -231,8 +294,11 @@ void Audio::proc_queue (Lfq_u32 *Q)
 
         case command::set_tremul:
 	    // Tremulant on/off.
-            if ((k & 0xf) != 0) _divisp [j]->trem_on (k >> 4);
-            else   _divisp [j]->trem_off (k >> 4);
+            if (D)
+	    {
+                if ((k & 0xf) != 0) D->trem_on (k >> 4);
+                else   D->trem_off (k >> 4);
+	    }
 	    Q->read_commit (1);
             break;
 
@@ -241,11 +307,11 @@ void Audio::proc_queue (Lfq_u32 *Q)
 	    if (n < 2) return;
             u.i = Q->read (1);
             Q->read_commit (2);        
-            switch (static_cast<dipar>(i))
+            if (D) switch (static_cast<dipar>(i))
  	    {
-            case dipar::swell: _divisp [j]->set_swell (u.f); break;
-            case dipar::tfreq: _divisp [j]->set_tfreq (u.f); break;
-            case dipar::tmodd: _divisp [j]->set_tmodd (u.f); break;
+            case dipar::swell: D->set_swell (u.f); break;
+            case dipar::tfreq: D->set_tfreq (u.f); break;
+            case dipar::tmodd: D->set_tmodd (u.f); break;
 	    }
             break;
             
@@ -257,6 +323,155 @@ void Audio::proc_queue (Lfq_u32 *Q)
 }
 
 
+// Process a MIDI message received by the audio thread. Events related
+// to keyboard state are dealt with locally. All the rest is sent as raw
+// MIDI to the model thread via qmidi.
+//
+void Audio::proc_midi (int t, int n, int v)
+{
+    int  c, f, k, m;
+
+    c = t & 0x0F;
+    k = _midimap [c] & 15;
+    f = _midimap [c] >> 12;
+
+    switch (t & 0xF0)
+    {
+    case 0x80:
+    case 0x90:
+	// Note on or off.
+	if (v && (t & 0x10))
+	{
+	    // Note on.
+	    if (n < 36)
+	    {
+		if ((f & 4) && (n >= 24) && (n < 34))
+		{
+		    // Preset selection, sent to model thread
+		    // if on control-enabled channel.
+		    if (_qmidi->write_avail () >= 3)
+		    {
+			_qmidi->write (0, t);
+			_qmidi->write (1, n);
+			_qmidi->write (2, v);
+			_qmidi->write_commit (3);
+		    }
+		}
+	    }
+	    else if (n <= 96)
+	    {
+		if (f & 1) key_on (n - 36, 1 << k);
+	    }
+	}
+	else
+	{
+	    // Note off.
+	    if (n < 36)
+	    {
+	    }
+	    else if (n <= 96)
+	    {
+		if (f & 1) key_off (n - 36, 1 << k);
+	    }
+	}
+	break;
+
+    case 0xB0: // Controller
+	switch (static_cast<midictl>(n))
+	{
+	case midictl::asoff:
+	    // All sound off, accepted on control channels only.
+	    // Clears all keyboards.
+	    if (f & 4)
+	    {
+		m = KMAP_ALL;
+		cond_key_off (m, m);
+	    }
+	    break;
+
+	case midictl::anoff:
+	    // All notes off, accepted on channels controlling
+	    // a keyboard.
+	    if (f & 1)
+	    {
+		m = 1 << k;
+		cond_key_off (m, m);
+	    }
+	    break;
+
+	case midictl::bank:
+	case midictl::ifelm:
+	    // Program bank selection or stop control, sent
+	    // to model thread if on control-enabled channel.
+	    if (f & 4)
+	    {
+		if (_qmidi->write_avail () >= 3)
+		{
+		    _qmidi->write (0, t);
+		    _qmidi->write (1, n);
+		    _qmidi->write (2, v);
+		    _qmidi->write_commit (3);
+		}
+	    }
+	    break;
+
+	case midictl::swell:
+	case midictl::tfreq:
+	case midictl::tmodd:
+	    // Per-division performance controls, sent to model
+	    // thread if on a channel that controls a division.
+	    if (f & 2)
+	    {
+		if (_qmidi->write_avail () >= 3)
+		{
+		    _qmidi->write (0, t);
+		    _qmidi->write (1, n);
+		    _qmidi->write (2, v);
+		    _qmidi->write_commit (3);
+		}
+	    }
+	    break;
+
+	case midictl::cresc:
+	case midictl::volume:
+	case midictl::sfz:
+	    // Instrument-wide and per-asection performance controls,
+	    // accepted on control channels only.
+	    if (f & 4)
+	    {
+		if (_qmidi->write_avail () >= 3)
+		{
+		    _qmidi->write (0, t);
+		    _qmidi->write (1, n);
+		    _qmidi->write (2, v);
+		    _qmidi->write_commit (3);
+		}
+	    }
+	    break;
+
+	default:
+	    break;
+	}
+	break;
+
+    case 0xC0:
+	// Program change sent to model thread
+	// if on control-enabled channel.
+	if (f & 4)
+	{
+	    if (_qmidi->write_avail () >= 3)
+	    {
+		_qmidi->write (0, t);
+		_qmidi->write (1, n);
+		_qmidi->write (2, 0);
+		_qmidi->write_commit (3);
+	    }
+	}
+	break;
+    }
+}
+
+
 void Audio::proc_keys1 (void)
 {    
     int       d, n;
@@ -273,6 +488,10 @@ void Audio::proc_keys1 (void)
             {
                 _divisp [d]->update (n, m & KMAP_ALL);
             }
+            for (d = 0; d < _ndnext; d++)
+            {
+                _dnext [d]->update (n, m & KMAP_ALL);
+            }
 	}
     }
 }
@@ -286,18 +505,24 @@ void Audio::proc_keys2 (void)
     {
         _divisp [d]->update (_keymap);
     }
+    for (d = 0; d < _ndnext; d++)
+    {
+        _dnext [d]->update (_keymap);
+    }
 }
 
 
 void Audio::proc_synth (int nframes) 
 {
     int           j, k;
-    float         W [PERIOD];
-    float         X [PERIOD];
-    float         Y [PERIOD];
-    float         Z [PERIOD];
-    float         R [PERIOD];
-    float        *out [8];
+    float        *out [NDIVIS * NCHANN];
+    struct timespec t0;
+
+    clock_gettime (CLOCK_MONOTONIC, &t0);
+#ifdef __linux__
+    // The model reads the page fault counts of this thread.
+    if (! _tid.load (std::memory_order_relaxed)) _tid.store (gettid (), std::memory_order_relaxed);
+#endif
 
     if (fabsf (_revsize - _audiopar [REVSIZE]._val) > 0.001f)
     {
@@ -313,10 +538,40 @@ void Audio::proc_synth (int nframes)
  	_reverb.set_t60hi (_revtime * 0.50f, 3e3f);
     }
 
+    // When upsampling, render at the synthesis rate into the input
+    // buffers of the upsampler, and upsample to the port buffers.
+    k = _upsamp.fact ();
+    if (k > 1)
+    {
+        std::copy_n (_outbuf, _nplay, out);
+        for (j = 0; j < _nplay; j++) _outbuf [j] = _upsamp.inp (j);
+        nframes /= k;
+    }
+    if (_topology != OUT_MIXED) proc_ports (nframes);
+    else proc_mixed (nframes);
+    if (k > 1)
+    {
+        _upsamp.process (out, nframes);
+        std::copy_n (out, _nplay, _outbuf);
+    }
+    proc_load (nframes, &t0);
+}
+
+
+void Audio::proc_mixed (int nframes) 
+{
+    int           j, k;
+    float         W [PERIOD];
+    float         X [PERIOD];
+    float         Y [PERIOD];
+    float         Z [PERIOD];
+    float         R [PERIOD];
+    float        *out [8];
+
 #if LIBSPATIALAUDIO_VERSION < 0x0301
     // spatialaudio < 0.3.1 does not support variable-size frames;
     // permanently disable binauralization if the frame size ever differs
-    if (_binaural && static_cast<unsigned>(nframes) != _fsize) _binaural = false;
+    if (_binaural && static_cast<unsigned>(nframes) != _fsize / _upsamp.fact ()) _binaural = false;
 #endif
 
     // mid+side virtual microphone balance
@@ -363,7 +618,7 @@ void Audio::proc_synth (int nframes)
 
     for (k = 0; k < nframes; k += PERIOD)
     {
-        on_synth_period(k);
+        on_synth_period (k * _upsamp.fact ());
 
         std::fill_n (W, PERIOD, 0);
         std::fill_n (X, PERIOD, 0);
@@ -371,9 +626,10 @@ void Audio::proc_synth (int nframes)
         std::fill_n (Z, PERIOD, 0);
         std::fill_n (R, PERIOD, 0);
 
-        for (j = 0; j < _ndivis; j++) _divisp [j]->process ();
+        proc_divis (0, 1.0f);
         for (j = 0; j < _nasect; j++) _asectp [j]->process (_audiopar [VOLUME]._val, W, X, Y, R);
-        _reverb.process (PERIOD, _audiopar [VOLUME]._val, R, W, X, Y, Z);
+        if (_convol) _convol->process (_audiopar [VOLUME]._val, R, W, X, Y, Z);
+        else _reverb.process (PERIOD, _audiopar [VOLUME]._val, R, W, X, Y, Z);
 
         // Note that W does *not* have a -3 dB adjustment applied to it.
         // (Most literature assumes it does.)
@@ -426,11 +682,125 @@ void Audio::proc_synth (int nframes)
 }
 
 
+// Measure the time taken by proc_synth () as a fraction of the time
+// the frames represent, and average it over QLOAD_TC. If enabled,
+// adapt the quality level to the average: reduce it when it is above
+// QLOAD_HI, leaving QTIME_HI for the effect to show, and restore it
+// one level at a time when it has been below QLOAD_LO for QTIME_LO.
+// A single late period does not change the level, and the gap between
+// the two limits keeps it from going up and down with every change.
+//
+void Audio::proc_load (int nframes, const struct timespec *t0)
+{
+    struct timespec t1;
+    float  dt, load;
+
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    dt = (float) nframes / _fsamp;
+    load = ((t1.tv_sec - t0->tv_sec) + 1e-9f * (t1.tv_nsec - t0->tv_nsec)) / dt;
+    _qload += std::min (dt / QLOAD_TC, 1.0f) * (load - _qload);
+    _qstat [1].store ((int)(100 * _qload + 0.5f), std::memory_order_relaxed);
+    if (! _adapt) return;
+
+    if (_qwait > 0) _qwait -= dt;
+    if (_qload > QLOAD_HI)
+    {
+        _qtime = 0;
+        if ((_qwait <= 0) && (_qlevel < NQUAL - 1)) set_quality (_qlevel + 1);
+    }
+    else if (_qload < QLOAD_LO)
+    {
+        _qtime += dt;
+        if ((_qtime > QTIME_LO) && (_qlevel > 0)) set_quality (_qlevel - 1);
+    }
+    else _qtime = 0;
+}
+
+
+void Audio::set_quality (int level)
+{
+    int j;
+
+    _qlevel = level;
+    _qtime = 0;
+    _qwait = QTIME_HI;
+    Rankwave::set_reduced (level >= 1);
+    for (j = 0; j < _nasect; j++) _asectp [j]->set_reduced (level >= 2);
+    _reverb.set_reduced ((level >= 3) || (_profile == PROF_LITE));
+    _qstat [0].store (level, std::memory_order_relaxed);
+}
+
+
+void Audio::proc_ports (int nframes)
+{
+    int    j, k;
+    float  *out [NDIVIS * NCHANN];
+
+    // Multichannel output. Divisions or asections write directly
+    // into the port buffers, and the built-in reverb is bypassed.
+    // In asection mode each section has a W, X, Y port and an R
+    // port carrying its reverb send.
+
+    std::copy_n (_outbuf, _nplay, out);
+    for (j = 0; j < _nplay; j++) std::fill_n (out [j], nframes, 0);
+
+    for (k = 0; k < nframes; k += PERIOD)
+    {
+        on_synth_period (k * _upsamp.fact ());
+
+        if (_topology == OUT_DIVIS)
+        {
+            proc_divis (out, _audiopar [VOLUME]._val);
+        }
+        else
+        {
+            proc_divis (0, 1.0f);
+            for (j = 0; j < _nasect; j++)
+            {
+                _asectp [j]->process (_audiopar [VOLUME]._val, out [4 * j], out [4 * j + 1], out [4 * j + 2], out [4 * j + 3]);
+            }
+        }
+        for (j = 0; j < _nplay; j++) out [j] += PERIOD;
+    }
+}
+
+
+// Process the divisions for one period, into the asections or
+// into out if given. When the instrument is replaced the previous
+// one is faded out while the new one is faded in, and its divisions
+// are then returned to the model thread to be destroyed there.
+//
+void Audio::proc_divis (float **out, float vol)
+{
+    int    j, n;
+    float  a;
+
+    if (! _nfade)
+    {
+        for (j = 0; j < _ndivis; j++) _divisp [j]->process (out ? out + j * NCHANN : 0, vol);
+        return;
+    }
+    n = std::max ((int)(XFADE_TIME * _fsamp / PERIOD), 1);
+    a = 0.5f * std::numbers::pi_v<float> * --_nfade / n;
+    for (j = 0; j < _ndivis; j++) _divisp [j]->process (out ? out + j * NCHANN : 0, vol * cosf (a));
+    for (j = 0; j < _ndnext; j++) _dnext [j]->process (out ? out + j * NCHANN : 0, vol * sinf (a));
+    if (_nfade) return;
+
+    for (j = 0; j < _ndnext; j++) _swap->_divis [j] = _dnext [j].release ();
+    _swap->_ndivis = _ndnext;
+    _ndnext = 0;
+    send_event (TO_MODEL, _swap);
+    _swap = 0;
+}
+
+
 void Audio::proc_mesg (void) 
 {
     ITC_mesg *M;
 
-    while (get_event_nowait () != EV_TIME)
+    // Only the message ports: with ALSA render-ahead this runs in the
+    // synthesis thread, and must not take the EV_EXIT meant for close ().
+    while (get_event_nowait ((1 << FM_MODEL) | (1 << FM_SLAVE)) != EV_TIME)
     {
 	M = get_message ();
         if (! M) continue; 
@@ -445,20 +815,68 @@ void Audio::proc_mesg (void)
                 D->set_swell (X->_swell);
                 D->set_tfreq (X->_tfreq);
                 D->set_tmodd (X->_tmodd);
-                _divisp [_ndivis] = std::move (D);
-                _ndivis++;
+                if (_swap) _dnext [_ndnext++] = std::move (D);
+                else _divisp [_ndivis++] = std::move (D);
                 break; 
 	    }
 	    case MT_CALC_RANK:
 	    case MT_LOAD_RANK:
 	    {
 	        M_def_rank *X = (M_def_rank *) M;
-                _divisp [X->_divis]->set_rank (X->_rank, std::unique_ptr <Rankwave> (X->_rwave), X->_synth->_pan, X->_synth->_del);
+                Division   *D = ((_swap && ! _nfade) ? _dnext : _divisp) [X->_divis].get ();
+                D->set_rank (X->_rank, std::unique_ptr <Rankwave> (X->_rwave), X->_synth->_pan, X->_synth->_del);
+                send_event (TO_MODEL, M);
+                M = 0;
+	        break;
+	    }
+	    case MT_LOAD_CONV:
+	    {
+                // Install the new convolver, and return the old one
+                // to the model thread to be destroyed there.
+	        M_load_conv *X = (M_load_conv *) M;
+                Convolver *C = _convol.release ();
+                _convol.reset (X->_conv);
+                X->_conv = C;
+                send_event (TO_MODEL, M);
+                M = 0;
+	        break;
+	    }
+	    case MT_GET_PREMIX:
+	    {
+                // List the drawn ranks of a division for the premix compiler.
+	        M_premix *X = (M_premix *) M;
+                X->_stat = ! _swap && _divisp [X->_divis]->get_premix (X->_premix);
                 send_event (TO_MODEL, M);
                 M = 0;
 	        break;
 	    }
+	    case MT_CALC_PREMIX:
+	    {
+                // Install the merged ranks, and return the premix that is
+                // replaced or rejected to the model thread to be destroyed.
+	        M_premix *X = (M_premix *) M;
+                Premix *P = _swap ? X->_premix : _divisp [X->_divis]->set_premix (X->_premix);
+                X->_stat = (P != X->_premix);
+                X->_premix = P;
+                send_event (TO_MODEL, M);
+                M = 0;
+	        break;
+	    }
+	    case MT_NEW_INSTR:
+                // The divisions and ranks that follow are for the next
+                // instrument, until the slave's MT_AUDIO_SYNC.
+                _swap = (M_new_instr *) M;
+                M = 0;
+                break;
+
 	    case MT_AUDIO_SYNC:
+                // If the next instrument is complete, start the crossfade.
+                if (_swap && ! _nfade)
+		{
+                    std::swap (_divisp, _dnext);
+                    std::swap (_ndivis, _ndnext);
+                    _nfade = std::max ((int)(XFADE_TIME * _fsamp / PERIOD), 1);
+		}
                 send_event (TO_MODEL, M);
                 M = 0;
 		break;
@@ -25,9 +25,11 @@
 #include <memory>
 #include <stop_token>
 #include "asection.h"
+#include "convolver.h"
 #include "division.h"
 #include "lfqueue.h"
 #include "reverb.h"
+#include "upsampler.h"
 #include "global.h"
 #include <clthreads.h>
 #if LIBSPATIALAUDIO_VERSION
@@ -36,6 +38,9 @@
 #endif
 
 
+class M_new_instr;
+
+
 #if LIBSPATIALAUDIO_VERSION
 class CBFormatEnh : public CBFormat
 {
@@ -56,6 +61,10 @@ public:
     virtual ~Audio ();
     void  start (void);
 
+    static void set_adaptive (bool on) { _adapt = on; }
+    static void set_profile (int prof) { _profile = prof; }
+    static void set_upsample (bool on) { _upsample = on; }
+
     const char  *appname (void) const { return _appname; }
     uint16_t    *midimap (void) const { return (uint16_t *) _midimap; }
     int  policy (void) const { return _policy; }
@@ -64,15 +73,24 @@ public:
     
     enum { VOLUME, REVSIZE, REVTIME, STPOSIT };
 
+    // Output port topologies.
+    enum { OUT_MIXED, OUT_ASECT, OUT_DIVIS };
+
 protected:
 
     void init_audio (bool binaural);
 
     void proc_queue (Lfq_u32 *);
+    void proc_midi (int, int, int);
     void proc_synth (int);
+    void proc_mixed (int);
+    void proc_divis (float **, float);
+    void proc_ports (int);
     void proc_keys1 (void);
     void proc_keys2 (void);
     void proc_mesg (void);
+    void proc_load (int, const struct timespec *);
+    void set_quality (int);
     
     virtual void on_synth_period(int) {}
 
@@ -120,6 +138,7 @@ protected:
     uint16_t        _midimap [16];
     Lfq_u32        *_qnote; 
     Lfq_u32        *_qcomm; 
+    Lfq_u8         *_qmidi;
     std::stop_source _running;
 
     int             _policy;
@@ -131,17 +150,34 @@ protected:
     unsigned int    _fsize;
     bool            _bform;
     bool            _binaural;
+    int             _topology;
     int             _nasect;
     int             _ndivis;
     std::unique_ptr <Asection> _asectp [NASECT];
     std::unique_ptr <Division> _divisp [NDIVIS];
+    int             _ndnext;
+    std::unique_ptr <Division> _dnext [NDIVIS];  // next instrument, or previous one while fading
+    int             _nfade;
+    M_new_instr    *_swap;
     Reverb          _reverb;
-    float          *_outbuf [8];
+    std::unique_ptr <Convolver> _convol;
+    Upsampler       _upsamp;
+    float          *_outbuf [NDIVIS * NCHANN];
     std::unique_ptr <float[]> _outbuf_storage;
     uint16_t        _keymap [NNOTES];
     Fparm           _audiopar [NAUPAR];
     float           _revsize;
     float           _revtime;
+    std::atomic <int> _tid;
+    int             _qlevel;
+    float           _qload;
+    float           _qtime;
+    float           _qwait;
+    std::atomic <int> _qstat [2];
+
+    static bool     _adapt;
+    static int      _profile;
+    static bool     _upsample;
 #if LIBSPATIALAUDIO_VERSION
     CBFormatEnh _binauralizer_src;
     CAmbisonicBinauralizer _binauralizer;
@@ -20,16 +20,20 @@
 
 #include <atomic>
 #include <memory>
+#include <pthread.h>
 #include <stop_token>
+#include <unistd.h>
 #include "audio_alsa.h"
 #include "messages.h"
 
 Audio_alsa::Audio_alsa (
-    const char *name, Lfq_u32 *qnote, Lfq_u32 *qcomm, const char *device, int fsamp, int fsize, int nfrag, bool binaural
+    const char *name, Lfq_u32 *qnote, Lfq_u32 *qcomm, const char *device, int fsamp, int fsize, int nfrag, int ahead, bool binaural
 ) :
-    Audio(name, qnote, qcomm)
+    Audio(name, qnote, qcomm),
+    _synsem (0),
+    _nxrun (0)
 {
-    init(device, fsamp, fsize, nfrag, binaural);
+    init(device, fsamp, fsize, nfrag, ahead, binaural);
 }
 
 
@@ -38,8 +42,10 @@ Audio_alsa::~Audio_alsa ()
     if (_alsa_handle) close ();
 }
 
-void Audio_alsa::init (const char *device, int fsamp, int fsize, int nfrag, bool binaural)
+void Audio_alsa::init (const char *device, int fsamp, int fsize, int nfrag, int ahead, bool binaural)
 {
+    struct sched_param  spar;
+
     _alsa_handle = std::make_unique <Alsa_pcmi> (device, nullptr, nullptr, fsamp, fsize, nfrag);
     if (_alsa_handle->state () < 0)
     {
@@ -51,9 +57,24 @@ void Audio_alsa::init (const char *device, int fsamp, int fsize, int nfrag, bool
     _fsamp = fsamp;
     if (_nplay > 2) _nplay = 2;
     init_audio (binaural);
-    _outbuf_storage = std::make_unique <float []> (_nplay * fsize);
-    for (int i = 0; i < _nplay; i++) _outbuf [i] = &_outbuf_storage [i * fsize];
     _running = std::stop_source ();
+    if (ahead > 0)
+    {
+        _qaudio = std::make_unique <Lfq_audio> (ahead, _nplay, fsize);
+        printf ("ALSA render-ahead: %d periods, %.1lf ms added latency.\n", ahead, 1e3 * ahead * fsize / fsamp);
+        _synsem.release (ahead);
+        _synth = std::thread (&Audio_alsa::synth_main, this);
+        spar.sched_priority = sched_get_priority_max (SCHED_FIFO) - 21;
+        if (pthread_setschedparam (_synth.native_handle (), SCHED_FIFO, &spar))
+        {
+            fprintf (stderr, "Warning: can't run synthesis thread in RT mode.\n");
+        }
+    }
+    else
+    {
+        _outbuf_storage = std::make_unique <float []> (_nplay * fsize);
+        for (int i = 0; i < _nplay; i++) _outbuf [i] = &_outbuf_storage [i * fsize];
+    }
     if (thr_start (_policy = SCHED_FIFO, _relpri = -20, 0))
     {
         fprintf (stderr, "Warning: can't run ALSA thread in RT mode.\n");
@@ -73,6 +94,12 @@ void Audio_alsa::close ()
         _running.request_stop ();
         get_event (1 << EV_EXIT);
     }
+    if (_synth.joinable ())
+    {
+        _synsem.release ();
+        _synth.join ();
+        if (_nxrun) fprintf (stderr, "ALSA render-ahead: %d periods not ready in time.\n", _nxrun);
+    }
 }
 
 
@@ -80,10 +107,39 @@ void Audio_alsa::thr_main (void)
 {
     unsigned long k;
 
+    if (_qaudio)
+    {
+        // Wait until the synthesis thread has filled the queue.
+        while (_qaudio->write_avail () && !_running.stop_requested ()) usleep (1000);
+    }
+
     _alsa_handle->pcm_start ();
 
     while (!_running.stop_requested ())
     {
+        if (_qaudio)
+        {
+            k = _alsa_handle->pcm_wait ();
+            while (k >= _fsize)
+            {
+                _alsa_handle->play_init (_fsize);
+                if (_qaudio->read_avail ())
+                {
+                    for (int i = 0; i < _nplay; i++) _alsa_handle->play_chan (i, _qaudio->read_ptr (i), _fsize);
+                    _qaudio->read_commit ();
+                    _synsem.release ();
+                }
+                else
+                {
+                    for (int i = 0; i < _nplay; i++) _alsa_handle->clear_chan (i, _fsize);
+                    _nxrun++;
+                }
+                _alsa_handle->play_done (_fsize);
+                k -= _fsize;
+            }
+            continue;
+        }
+
 	k = _alsa_handle->pcm_wait ();  
         proc_queue (_qnote);
         proc_queue (_qcomm);
@@ -103,3 +159,23 @@ void Audio_alsa::thr_main (void)
     _alsa_handle->pcm_stop ();
     put_event (EV_EXIT);
 }
+
+
+void Audio_alsa::synth_main (void)
+{
+    while (!_running.stop_requested ())
+    {
+        _synsem.acquire ();
+        proc_queue (_qnote);
+        proc_queue (_qcomm);
+        proc_keys1 ();
+        proc_keys2 ();
+        while (_qaudio->write_avail ())
+        {
+            for (int i = 0; i < _nplay; i++) _outbuf [i] = _qaudio->write_ptr (i);
+            proc_synth (_fsize);
+            _qaudio->write_commit ();
+        }
+        proc_mesg ();
+    }
+}
@@ -22,23 +22,34 @@
 #define __AUDIO_ALSA_H
 
 #include <memory>
+#include <semaphore>
+#include <thread>
 #include "audio.h"
+#include "lfqueue.h"
 #include <zita-alsa-pcmi.h>
 
 class Audio_alsa : public Audio
 {
 public:
 
-    Audio_alsa (const char *jname, Lfq_u32 *qnote, Lfq_u32 *qcomm, const char *device, int fsamp, int fsize, int nfrag, bool binaural);
+    Audio_alsa (const char *jname, Lfq_u32 *qnote, Lfq_u32 *qcomm, const char *device, int fsamp, int fsize, int nfrag, int ahead, bool binaural);
     virtual ~Audio_alsa ();
 
 private:
 
-    void  init (const char *device, int fsamp, int fsize, int nfrag, bool binaural);
+    void  init (const char *device, int fsamp, int fsize, int nfrag, int ahead, bool binaural);
     void close (void);
     virtual void thr_main (void);
+    void synth_main (void);
 
     std::unique_ptr <Alsa_pcmi> _alsa_handle;
+
+    // Render-ahead mode: a separate thread runs the synthesis
+    // and the ALSA thread only copies finished periods.
+    std::unique_ptr <Lfq_audio> _qaudio;
+    std::counting_semaphore <> _synsem;
+    std::thread     _synth;
+    int             _nxrun;
 };
 
 
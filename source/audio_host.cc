@@ -0,0 +1,134 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#include <algorithm>
+#include "audio_host.h"
+#include "messages.h"
+
+
+Audio_host::Audio_host (const char *name, Lfq_u32 *qnote, Lfq_u32 *qcomm, Lfq_u8 *qmidi, int fsamp, bool bform) :
+    Audio (name, qnote, qcomm),
+    _qevent (1024),
+    _tnext (0),
+    _tsynth (0),
+    _nrest (0)
+{
+    int i;
+
+    _qmidi = qmidi;
+    _policy = SCHED_OTHER;
+    _bform = bform;
+    _nplay = bform ? 4 : 2;
+    _fsamp = fsamp;
+    _fsize = PERIOD;
+    // The synthesis always runs one period at a time.
+    _buff = std::make_unique <float []> (_nplay * PERIOD);
+    for (i = 0; i < _nplay; i++) _outbuf [i] = _buff.get () + i * PERIOD;
+    init_audio (false);
+}
+
+
+Audio_host::~Audio_host (void)
+{
+}
+
+
+// Key and MIDI events. The time is in frames from the start of the
+// next process () call, and events must be given in time order.
+// Returns non-zero if the queue is full.
+//
+int Audio_host::key_event (int time, int keybd, int note, bool on)
+{
+    if ((keybd < 0) || (keybd >= NKEYBD) || (note < 0) || (note >= NNOTES)) return 1;
+    return add_event (time, (1 << 24) | (on << 16) | (keybd << 8) | note);
+}
+
+
+int Audio_host::midi_event (int time, int t, int n, int v)
+{
+    if (! (t & 0x80)) return 1;
+    return add_event (time, ((t & 255) << 16) | ((n & 127) << 8) | (v & 127));
+}
+
+
+int Audio_host::add_event (int time, uint32_t data)
+{
+    if (_qevent.write_avail () < 2) return 1;
+    _qevent.write (0, _tnext + std::max (time, 0));
+    _qevent.write (1, data);
+    _qevent.write_commit (2);
+    return 0;
+}
+
+
+void Audio_host::proc_events (uint32_t tmax)
+{
+    uint32_t  d;
+
+    while (   (_qevent.read_avail () >= 2)
+           && ((int32_t)(_qevent.read (0) - tmax) < 0))
+    {
+        d = _qevent.read (1);
+        _qevent.read_commit (2);
+        if (d >> 24)
+	{
+            if ((d >> 16) & 1) key_on (d & 255, 1 << ((d >> 8) & 255));
+            else               key_off (d & 255, 1 << ((d >> 8) & 255));
+	}
+        else proc_midi ((d >> 16) & 255, (d >> 8) & 127, d & 127);
+    }
+}
+
+
+void Audio_host::on_synth_period (int)
+{
+    proc_events (_tsynth + PERIOD);
+    proc_keys1 ();
+}
+
+
+// Compute nframes of output. The synthesis runs in periods of PERIOD
+// frames. Frames left from the previous call are output first, so
+// nframes can be any size.
+//
+void Audio_host::process (int nframes, float **outputs)
+{
+    int  i, k, n;
+
+    for (k = 0; k < nframes; k += n)
+    {
+        if (! _nrest)
+	{
+            proc_queue (_qnote);
+            proc_queue (_qcomm);
+            proc_keys1 ();
+            proc_keys2 ();
+            proc_synth (PERIOD);
+            proc_mesg ();
+            _tsynth += PERIOD;
+            _nrest = PERIOD;
+	}
+        n = std::min (_nrest, nframes - k);
+        for (i = 0; i < _nplay; i++) std::copy_n (_outbuf [i] + PERIOD - _nrest, n, outputs [i] + k);
+        _nrest -= n;
+    }
+    _tnext += nframes;
+}
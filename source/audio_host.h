@@ -0,0 +1,62 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __AUDIO_HOST_H
+#define __AUDIO_HOST_H
+
+#include <memory>
+#include "audio.h"
+#include "lfqueue.h"
+
+
+// Audio without a driver or a thread of its own, for use as a library
+// (see engine.h). The host calls process () from its audio thread.
+// Timed key and MIDI events are queued by the same thread, and are
+// applied at the period that contains them, as with JACK MIDI.
+//
+class Audio_host : public Audio
+{
+public:
+
+    Audio_host (const char *name, Lfq_u32 *qnote, Lfq_u32 *qcomm, Lfq_u8 *qmidi, int fsamp, bool bform);
+    virtual ~Audio_host (void);
+
+    int  nplay (void) const { return _nplay; }
+    int  key_event (int time, int keybd, int note, bool on);
+    int  midi_event (int time, int t, int n, int v);
+    void process (int nframes, float **outputs);
+
+private:
+
+    virtual void thr_main (void) {}
+
+    int  add_event (int time, uint32_t data);
+    void proc_events (uint32_t tmax);
+    void on_synth_period (int);
+
+    Lfq_u32         _qevent;
+    uint32_t        _tnext;   // time of the first frame of the next process () call
+    uint32_t        _tsynth;  // time of the next frame to compute
+    int             _nrest;   // frames computed but not yet output
+    std::unique_ptr <float []> _buff;
+};
+
+
+#endif
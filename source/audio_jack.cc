@@ -26,13 +26,12 @@
 
 Audio_jack::Audio_jack (
     const char *name, Lfq_u32 *qnote, Lfq_u32 *qcomm, const char *server, bool autoconnect,
-    bool bform, bool binaural, Lfq_u8 *qmidi
+    bool bform, bool binaural, int topology, Lfq_u8 *qmidi
 ) :
     Audio(name, qnote, qcomm),
-    _qmidi (0),
     _jack_handle (0)
 {
-    init(server, autoconnect, bform, binaural, qmidi);
+    init(server, autoconnect, bform, binaural, topology, qmidi);
 }
 
 Audio_jack::~Audio_jack (void)
@@ -40,15 +39,17 @@ Audio_jack::~Audio_jack (void)
     if (_jack_handle) close ();
 }
 
-void Audio_jack::init (const char *server, bool autoconnect, bool bform, bool binaural, Lfq_u8 *qmidi)
+void Audio_jack::init (const char *server, bool autoconnect, bool bform, bool binaural, int topology, Lfq_u8 *qmidi)
 {
     int                 i;
+    char                s [64];
     int                 opts;
     jack_status_t       stat;
     struct sched_param  spar;
     const char          **p;
 
-    _bform = bform;
+    _topology = topology;
+    _bform = bform && (_topology == OUT_MIXED);
     _qmidi = qmidi;
 
     opts = JackNoStartServer;
@@ -64,7 +65,20 @@ void Audio_jack::init (const char *server, bool autoconnect, bool bform, bool bi
     jack_set_process_callback (_jack_handle, jack_static_callback, (void *)this);
     jack_on_shutdown (_jack_handle, jack_static_shutdown, (void *)this);
 
-    if (_bform)
+    if (_topology == OUT_DIVIS)
+    {
+        // Divisions are created later by the model, so all
+        // possible port sets are registered here. Those of
+        // unused divisions remain silent.
+	_nplay = NDIVIS * NCHANN;
+	p = 0;
+    }
+    else if (_topology == OUT_ASECT)
+    {
+	_nplay = NASECT * 4;
+	p = 0;
+    }
+    else if (_bform)
     {
 	_nplay = 4;
 	p = _ports_ambis1;
@@ -77,10 +91,13 @@ void Audio_jack::init (const char *server, bool autoconnect, bool bform, bool bi
 
     for (i = 0; i < _nplay; i++)
     {
-        _jack_opport [i] = jack_port_register (_jack_handle, p [i], JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+        if (_topology == OUT_DIVIS) sprintf (s, "div%d.out%d", i / NCHANN + 1, i % NCHANN + 1);
+        else if (_topology == OUT_ASECT) sprintf (s, "sect%d.%s", i / 4 + 1, _ports_asect [i % 4]);
+        else strcpy (s, p [i]);
+        _jack_opport [i] = jack_port_register (_jack_handle, s, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
 	if (!_jack_opport [i])
 	{
-	    fprintf (stderr, "Error: can't create the '%s' jack port\n", p [i]);
+	    fprintf (stderr, "Error: can't create the '%s' jack port\n", s);
 	    exit (1);
 	}
     }
@@ -98,7 +115,7 @@ void Audio_jack::init (const char *server, bool autoconnect, bool bform, bool bi
     _fsamp = jack_get_sample_rate (_jack_handle);
     _fsize = jack_get_buffer_size (_jack_handle);
     _jmidi_pdata = 0;
-    init_audio (binaural);
+    init_audio (binaural && (_topology == OUT_MIXED));
 
     if (jack_activate (_jack_handle))
     {
@@ -204,158 +221,14 @@ int Audio_jack::jack_callback (jack_nframes_t nframes)
 
 void Audio_jack::proc_jmidi (int tmax)
 {
-    int                 c, f, k, m, n, t, v;
     jack_midi_event_t   E;
 
     // Read and process MIDI commands from the JACK port.
-    // Events related to keyboard state are dealt with
-    // locally. All the rest is sent as raw MIDI to the
-    // model thread via qmidi.
 
     while (   (jack_midi_event_get (&E, _jmidi_pdata, _jmidi_index) == 0)
            && (E.time < (jack_nframes_t) tmax))
     {
-	t = E.buffer [0];
-        n = E.buffer [1];
-	v = E.buffer [2];
-	c = t & 0x0F;
-        k = _midimap [c] & 15;
-        f = _midimap [c] >> 12;
-        
-	switch (t & 0xF0)
-	{
-	case 0x80:
-	case 0x90:
-	    // Note on or off.
-	    if (v && (t & 0x10))
-	    {
-		// Note on.
-		if (n < 36)
-		{
-		    if ((f & 4) && (n >= 24) && (n < 34))
-		    {
-			// Preset selection, sent to model thread
-			// if on control-enabled channel.
-			if (_qmidi->write_avail () >= 3)
-			{
-			    _qmidi->write (0, t);
-			    _qmidi->write (1, n);
-			    _qmidi->write (2, v);
-			    _qmidi->write_commit (3);
-			}
-		    }
-		}
-		else if (n <= 96)
-		{
-		    if (f & 1) key_on (n - 36, 1 << k);
-		}
-	    }
-	    else
-	    {
-		// Note off.
-		if (n < 36)
-		{
-		}
-		else if (n <= 96)
-		{
-		    if (f & 1) key_off (n - 36, 1 << k);
-		}
-	    }
-	    break;
-
-	case 0xB0: // Controller
-	    switch (static_cast<midictl>(n))
-	    {
-	    case midictl::asoff:
-		// All sound off, accepted on control channels only.
-		// Clears all keyboards.
-                if (f & 4)
-                {
-                    m = KMAP_ALL;
-                    cond_key_off (m, m);
-                }
-		break;
-
-	    case midictl::anoff:
-		// All notes off, accepted on channels controlling
-		// a keyboard.
-                if (f & 1)
-                {
-                    m = 1 << k;
-                    cond_key_off (m, m);
-                }
-		break;
-	
-	    case midictl::bank:
-	    case midictl::ifelm:
-                // Program bank selection or stop control, sent
-                // to model thread if on control-enabled channel.
-		if (f & 4)
-		{
-		    if (_qmidi->write_avail () >= 3)
-		    {
-			_qmidi->write (0, t);
-			_qmidi->write (1, n);
-			_qmidi->write (2, v);
-			_qmidi->write_commit (3);
-		    }
-		}
-		break;
-
-	    case midictl::swell:
-	    case midictl::tfreq:
-	    case midictl::tmodd:
-		// Per-division performance controls, sent to model
-                // thread if on a channel that controls a division.
-		if (f & 2)
-		{
-		    if (_qmidi->write_avail () >= 3)
-		    {
-			_qmidi->write (0, t);
-			_qmidi->write (1, n);
-			_qmidi->write (2, v);
-			_qmidi->write_commit (3);
-		    }
-		}
-		break;
-
-	    case midictl::cresc:
-	    case midictl::volume:
-	    case midictl::sfz:
-		// Instrument-wide and per-asection performance controls,
-		// accepted on control channels only.
-		if (f & 4)
-		{
-		    if (_qmidi->write_avail () >= 3)
-		    {
-			_qmidi->write (0, t);
-			_qmidi->write (1, n);
-			_qmidi->write (2, v);
-			_qmidi->write_commit (3);
-		    }
-		}
-		break;
-
-	    default:
-		break;
-	    }
-	    break;
-
-	case 0xC0:
-            // Program change sent to model thread
-            // if on control-enabled channel.
-            if (f & 4)
-   	    {
-	        if (_qmidi->write_avail () >= 3)
-	        {
-		    _qmidi->write (0, t);
-		    _qmidi->write (1, n);
-		    _qmidi->write (2, 0);
-		    _qmidi->write_commit (3);
-		}
-	    }
-	    break;
-	}	
+        proc_midi (E.buffer [0], E.buffer [1], E.buffer [2]);
 	_jmidi_index++;
     }
 }
@@ -364,10 +237,11 @@ void Audio_jack::on_synth_period(int sample)
 {
 	if (_jmidi_pdata)
 	{
-	    proc_jmidi (sample + PERIOD);
+	    proc_jmidi (sample + PERIOD * _upsamp.fact ());
 	    proc_keys1 ();
 	}
 }
 
 const char *Audio_jack::_ports_stereo [2] = { "out.L", "out.R" };
 const char *Audio_jack::_ports_ambis1 [4] = { "out.W", "out.X", "out.Y", "out.Z" };
+const char *Audio_jack::_ports_asect [4] = { "W", "X", "Y", "R" };
@@ -30,13 +30,13 @@ public:
 
     Audio_jack (
         const char *name, Lfq_u32 *qnote, Lfq_u32 *qcomm, const char *server, bool autoconnect,
-        bool bform, bool binaural, Lfq_u8 *qmidi
+        bool bform, bool binaural, int topology, Lfq_u8 *qmidi
     );
     virtual ~Audio_jack (void);
 
 private:
    
-    void  init (const char *server, bool autoconnect, bool bform, bool binaural, Lfq_u8 *qmidi);
+    void  init (const char *server, bool autoconnect, bool bform, bool binaural, int topology, Lfq_u8 *qmidi);
     void close (void);
 
     virtual void thr_main (void) {}
@@ -49,10 +49,8 @@ private:
     static void jack_static_shutdown (void *);
     static int  jack_static_callback (jack_nframes_t, void *);
     
-    Lfq_u8         *_qmidi;
-
     jack_client_t  *_jack_handle;
-    jack_port_t    *_jack_opport [8];
+    jack_port_t    *_jack_opport [NDIVIS * NCHANN];
     jack_port_t    *_jack_midipt;
     int             _jmidi_count;
     int             _jmidi_index;
@@ -60,6 +58,7 @@ private:
 
     static const char *_ports_stereo [2];
     static const char *_ports_ambis1 [4];
+    static const char *_ports_asect [4];
 };
 
 
@@ -85,7 +85,6 @@ void Audiowin::handle_callb (int k, X_window *W, XEvent *E)
 void Audiowin::setup (M_ifc_init *M)
 {
     int      i, j, k, x;
-    char     s [256];
     Asect    *S; 
     X_hints  H;
     
@@ -138,8 +137,8 @@ void Audiowin::setup (M_ifc_init *M)
     add_text (UISCALE(355), UISCALE(305), UISCALE(80), UISCALE(20), "Stereo width", &text0);
     add_text (UISCALE(585), UISCALE(305), UISCALE(60), UISCALE(20), "Volume",   &text0);
 
-    sprintf (s, "%s   Aeolus-%s   Audio settings", M->_appid, VERSION);
-    x_set_title (s);
+    snprintf (_title, 256, "%s   Aeolus-%s   Audio settings", M->_appid, VERSION);
+    x_set_title (_title);
 
     H.position (_xp, _yp);
     H.minsize (UISCALE(200), UISCALE(100));
@@ -170,6 +169,18 @@ void Audiowin::set_aupar (M_ifc_aupar *M)
 }
 
 
+// Show the adaptive quality level in the title.
+//
+void Audiowin::set_quality (M_ifc_quality *M)
+{
+    char s [320];
+
+    if (M->_level) snprintf (s, 320, "%s   [reduced quality %d, load %d%%]", _title, M->_level, M->_load);
+    else snprintf (s, 320, "%s", _title);
+    x_set_title (s);
+}
+
+
 void Audiowin::add_text (int xp, int yp, int xs, int ys, const char *text, X_textln_style *style)
 {
     (new X_textln (this, style, xp, yp, xs, ys, text, -1))->x_map ();
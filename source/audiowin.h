@@ -44,6 +44,7 @@ public:
 
     void setup (M_ifc_init *);
     void set_aupar (M_ifc_aupar *M);
+    void set_quality (M_ifc_quality *M);
 
     int   asect (void) const { return _asect; }
     int   parid (void) const { return _parid; }
@@ -62,6 +63,7 @@ private:
     void add_text (int xp, int yp, int xs, int ys, const char *text, X_textln_style *style);
 
     Atom            _atom;
+    char            _title [256];
     X_callback     *_callb;
     X_resman       *_xresm;
     int             _xp, _yp;
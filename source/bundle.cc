@@ -0,0 +1,259 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include "bundle.h"
+
+
+Bundle::Bundle (void) :
+    _addr (0),
+    _size (0),
+    _nmemb (0)
+{
+    *_path = 0;
+}
+
+
+Bundle::~Bundle (void)
+{
+    close ();
+}
+
+
+int Bundle::open (const char *path)
+{
+    int          fd, i;
+    struct stat  S;
+    uint64_t     a, b;
+    char         *p;
+
+    close ();
+    if ((fd = ::open (path, O_RDONLY)) < 0)
+    {
+        fprintf (stderr, "Can't open bundle '%s'\n", path);
+        return 1;
+    }
+    if (fstat (fd, &S) || (S.st_size < 16))
+    {
+        fprintf (stderr, "Bundle '%s' is empty or can't be read\n", path);
+        ::close (fd);
+        return 1;
+    }
+    p = (char *) mmap (0, S.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close (fd);
+    if (p == MAP_FAILED)
+    {
+        fprintf (stderr, "Can't map bundle '%s'\n", path);
+        return 1;
+    }
+    _addr = p;
+    _size = S.st_size;
+
+    if (strcmp (p, "aeb") || (p [4] != 1))
+    {
+        fprintf (stderr, "File '%s' is not an Aeolus bundle\n", path);
+        close ();
+        return 1;
+    }
+    _nmemb = *((int32_t *)(p + 8));
+    if ((_nmemb < 0) || ((size_t)(_nmemb) > (_size - 16) / BND_ENTRY))
+    {
+        fprintf (stderr, "Bundle '%s' is damaged\n", path);
+        close ();
+        return 1;
+    }
+    // Check every member once, so find () can trust the entries.
+    for (i = 0, p = _addr + 16; i < _nmemb; i++, p += BND_ENTRY)
+    {
+        a = *((uint64_t *)(p + BND_NAME));
+        b = *((uint64_t *)(p + BND_NAME + 8));
+	if (! memchr (p, 0, BND_NAME) || (a % BND_ALIGN) || (a > _size) || (b > _size - a))
+	{
+            fprintf (stderr, "Bundle '%s' is damaged\n", path);
+            close ();
+            return 1;
+	}
+    }
+    strncpy (_path, path, sizeof (_path) - 1);
+    _path [sizeof (_path) - 1] = 0;
+    return 0;
+}
+
+
+void Bundle::close (void)
+{
+    if (_addr) munmap (_addr, _size);
+    _addr = 0;
+    _size = 0;
+    _nmemb = 0;
+    *_path = 0;
+}
+
+
+// Return the data and size of a member, or zero if there is none
+// of that name. The data stays valid until the bundle is closed.
+//
+const char *Bundle::find (const char *name, size_t *size) const
+{
+    int         i, j, k, r;
+    const char  *p;
+
+    // Binary search, the table of contents is sorted by name.
+    i = 0;
+    j = _nmemb;
+    while (i < j)
+    {
+        k = (i + j) / 2;
+        p = _addr + 16 + k * BND_ENTRY;
+        r = strcmp (p, name);
+        if (r == 0)
+	{
+            *size = *((uint64_t *)(p + BND_NAME + 8));
+	    return _addr + *((uint64_t *)(p + BND_NAME));
+	}
+        if (r < 0) i = k + 1;
+        else j = k;
+    }
+    return 0;
+}
+
+
+// Open a member as a read-only stream, for the code that reads
+// the separate files.
+//
+FILE *Bundle::fopen (const char *name) const
+{
+    const char  *p;
+    size_t      n;
+
+    // An empty member is treated as missing, fmemopen () needs data.
+    if (! (p = find (name, &n)) || ! n) return 0;
+    return fmemopen ((void *) p, n, "r");
+}
+
+
+// Write a bundle from a list of files and the names they will have
+// in it. The bundle is first written to a temporary file that is then
+// renamed, so processes using the previous version can keep it mapped
+// and new ones see either the old or the new one, never a part.
+//
+int Bundle::write (const char *path, int nmemb, const char *const *names, const char *const *files)
+{
+    FILE      *F, *G;
+    int       i, j, n;
+    uint64_t  a, b;
+    char      tmp [1040];
+    char      ent [BND_ENTRY];
+    char      data [BND_ALIGN];
+
+    if (nmemb < 0) return 1;
+    for (i = 0; i < nmemb; i++)
+    {
+        if (strlen (names [i]) >= BND_NAME)
+	{
+            fprintf (stderr, "Name '%s' is too long for a bundle\n", names [i]);
+            return 1;
+	}
+    }
+    std::unique_ptr <int []> ord = std::make_unique <int []> (nmemb);
+    std::iota (ord.get (), ord.get () + nmemb, 0);
+    std::sort (ord.get (), ord.get () + nmemb, [names] (int x, int y) { return strcmp (names [x], names [y]) < 0; });
+    for (i = 1; i < nmemb; i++)
+    {
+        if (! strcmp (names [ord [i - 1]], names [ord [i]]))
+	{
+            fprintf (stderr, "Name '%s' is used twice\n", names [ord [i]]);
+            return 1;
+	}
+    }
+
+    snprintf (tmp, sizeof (tmp), "%s.tmp", path);
+    if (! (F = ::fopen (tmp, "wb")))
+    {
+        fprintf (stderr, "Can't open '%s' for writing\n", tmp);
+        return 1;
+    }
+
+    std::fill_n (data, 16, 0);
+    strcpy (data, "aeb");
+    data [4] = 1;
+    *((int32_t *)(data + 8)) = nmemb;
+    fwrite (data, 1, 16, F);
+
+    // The table of contents is written again when the offsets are known.
+    std::fill_n (data, BND_ENTRY, 0);
+    for (i = 0; i < nmemb; i++) fwrite (data, 1, BND_ENTRY, F);
+
+    std::fill_n (data, BND_ALIGN, 0);
+    for (i = 0; i < nmemb; i++)
+    {
+        j = ord [i];
+        a = ftell (F);
+        if (a % BND_ALIGN) fwrite (data, 1, BND_ALIGN - a % BND_ALIGN, F);
+        a = ftell (F);
+        if (! (G = ::fopen (files [j], "rb")))
+	{
+            fprintf (stderr, "Can't open '%s' for reading\n", files [j]);
+            fclose (F);
+            unlink (tmp);
+            return 1;
+	}
+        b = 0;
+        while ((n = fread (data, 1, BND_ALIGN, G)) > 0)
+	{
+            fwrite (data, 1, n, F);
+            b += n;
+	}
+        fclose (G);
+        std::fill_n (data, BND_ALIGN, 0);
+
+        std::fill_n (ent, BND_ENTRY, 0);
+        strcpy (ent, names [j]);
+        *((uint64_t *)(ent + BND_NAME)) = a;
+        *((uint64_t *)(ent + BND_NAME + 8)) = b;
+        fseek (F, 16 + i * BND_ENTRY, SEEK_SET);
+        fwrite (ent, 1, BND_ENTRY, F);
+        fseek (F, 0, SEEK_END);
+    }
+
+    if (fflush (F) || ferror (F) || fsync (fileno (F)))
+    {
+        fprintf (stderr, "Error writing '%s'\n", tmp);
+        fclose (F);
+        unlink (tmp);
+        return 1;
+    }
+    fclose (F);
+    if (rename (tmp, path))
+    {
+        fprintf (stderr, "Can't rename '%s' to '%s'\n", tmp, path);
+        unlink (tmp);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __BUNDLE_H
+#define __BUNDLE_H
+
+
+#include <stdio.h>
+#include <stddef.h>
+
+
+#define BND_NAME   64     // maximum member name length, including the 0
+#define BND_ENTRY  80     // size of a table of contents entry
+#define BND_ALIGN  4096   // alignment of the members in the file
+
+
+// A complete instrument in one file: the definition, presets, stops
+// (.ae0) and wavetables (.ae1), under the names they have in their
+// directories. A 16 byte header ("aeb", version, number of members)
+// is followed by the table of contents, sorted by name, each entry
+// being the name and the offset and size of the member as 64-bit
+// integers. Members start on a BND_ALIGN boundary, so the file can
+// be mapped and the wavetables used where they are.
+//
+class Bundle
+{
+public:
+
+    Bundle (void);
+    ~Bundle (void);
+
+    int  open (const char *path);
+    void close (void);
+
+    bool        isopen (void) const { return _addr != 0; }
+    const char *path (void) const { return _path; }
+    const char *find (const char *name, size_t *size) const;
+    FILE       *fopen (const char *name) const;
+
+    static int write (const char *path, int nmemb, const char *const *names, const char *const *files);
+
+private:
+
+    Bundle (const Bundle&);
+    Bundle& operator=(const Bundle&);
+
+    char    _path [1024];
+    char   *_addr;
+    size_t  _size;
+    int     _nmemb;
+};
+
+
+#endif
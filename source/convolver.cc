@@ -0,0 +1,252 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#include <algorithm>
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include "convolver.h"
+
+
+typedef std::complex <float> cfloat;
+
+
+// Partition k of this level holds samples offs + k * size to
+// offs + (k + 1) * size of each IR channel, zero padded to twice the
+// size. The scale includes the 1 / size for the unnormalised FFT.
+//
+Convlevel::Convlevel (int size, int npart, int offs, const float *ir, int nchan, int nfram, float scale) :
+    _size (size), _npart (npart), _ipart (0), _fft (2 * size),
+    _ipos (0), _nsent (0), _rdbuf (1), _valid (true), _ndone (0)
+{
+    int  c, i, j, k, nb;
+
+    nb = size + 1;
+    _tbuf = std::make_unique <float []> (2 * size);
+    _prev = std::make_unique <float []> (size);
+    _hspec = std::make_unique <cfloat []> (NCVOUT * npart * nb);
+    _xspec = std::make_unique <cfloat []> (npart * nb);
+    _yspec = std::make_unique <cfloat []> (nb);
+    _inpbuf = std::make_unique <float []> (2 * size);
+    _outbuf = std::make_unique <float []> (2 * NCVOUT * size);
+
+    for (c = 0; c < nchan; c++)
+    {
+        for (k = 0; k < npart; k++)
+        {
+            std::fill_n (_tbuf.get (), 2 * size, 0.0f);
+            for (i = 0, j = offs + k * size; (i < size) && (j < nfram); i++, j++)
+            {
+                _tbuf [i] = scale * ir [j * nchan + c] / size;
+            }
+            _fft.forward (_tbuf.get (), _hspec.get () + (c * npart + k) * nb);
+        }
+    }
+}
+
+
+// Process one block of _size samples. Overlap-save: the FFT covers the
+// previous and the current input block, and the last half of the
+// inverse is the output.
+//
+void Convlevel::compute (const float *inp, float *out)
+{
+    int     c, i, k, j, nb;
+    cfloat  *X, *H, *Y;
+
+    nb = _size + 1;
+    std::copy_n (_prev.get (), _size, _tbuf.get ());
+    std::copy_n (inp, _size, _tbuf.get () + _size);
+    std::copy_n (inp, _size, _prev.get ());
+    _fft.forward (_tbuf.get (), _xspec.get () + _ipart * nb);
+
+    Y = _yspec.get ();
+    for (c = 0; c < NCVOUT; c++)
+    {
+        std::fill_n (Y, nb, cfloat (0, 0));
+        for (k = 0, j = _ipart; k < _npart; k++)
+        {
+            X = _xspec.get () + j * nb;
+            H = _hspec.get () + (c * _npart + k) * nb;
+            for (i = 0; i < nb; i++) Y [i] += X [i] * H [i];
+            if (--j < 0) j += _npart;
+        }
+        _fft.inverse (Y, _tbuf.get ());
+        std::copy_n (_tbuf.get () + _size, _size, out + c * _size);
+    }
+    if (++_ipart == _npart) _ipart = 0;
+}
+
+
+// The IR must have 1 channel (W only) or 4 (FuMa W, X, Y, Z). Since
+// W has no -3 dB adjustment inside Aeolus, it is scaled by sqrt (2)
+// for the latter. The IR is normalised to unit energy in W.
+//
+Convolver::Convolver (const float *ir, int nchan, int nfram) :
+    _nlev (0), _threads (false), _stop (false), _nlate (0), _nquiet (0)
+{
+    int     i, size, offs, next, npart;
+    double  e;
+    float   scale;
+
+    e = 0;
+    for (i = 0; i < nfram; i++) e += ir [i * nchan] * ir [i * nchan];
+    if (nchan == 4) e *= 2;
+    scale = (e > 0) ? 1 / sqrt (e) : 0;
+
+    offs = 0;
+    size = PERIOD;
+    while (offs < nfram)
+    {
+        next = 16 * size;
+        if ((_nlev == NCVLEV - 1) || (next >= nfram)) next = nfram;
+        npart = (next - offs + size - 1) / size;
+        _levels [_nlev] = std::unique_ptr <Convlevel> (new Convlevel (size, npart, offs, ir, nchan, nfram, scale));
+        if (nchan == 4)
+        {
+            // Undo the -3 dB on W. Partitions are linear, so scaling
+            // the spectra is the same as scaling the IR.
+            Convlevel *L = _levels [_nlev].get ();
+            for (i = 0; i < npart * (size + 1); i++) L->_hspec [i] *= (float) M_SQRT2;
+        }
+        _nlev++;
+        offs = npart * size + offs;
+        size *= 8;
+    }
+    // The longest level holds two blocks of input beyond the end of
+    // the response.
+    _ntail = offs + 2 * size / 8;
+}
+
+
+Convolver::~Convolver (void)
+{
+    _stop = true;
+    for (int i = 1; i < _nlev; i++)
+    {
+        if (_levels [i]->_thread.joinable ())
+        {
+            _levels [i]->_trig.release ();
+            _levels [i]->_thread.join ();
+        }
+    }
+}
+
+
+// Start one thread per level after the first. Lower priority for
+// longer partitions, which also have the longer deadlines. Without
+// threads, all levels are computed in the audio thread.
+//
+void Convolver::start (int policy, int relpri)
+{
+    int                 i;
+    struct sched_param  spar;
+
+    for (i = 1; i < _nlev; i++)
+    {
+        _levels [i]->_thread = std::thread (&Convolver::worker, this, _levels [i].get ());
+        if (policy != SCHED_OTHER)
+        {
+            spar.sched_priority = sched_get_priority_max (policy) + relpri - 10 - i;
+            if (pthread_setschedparam (_levels [i]->_thread.native_handle (), policy, &spar))
+            {
+                fprintf (stderr, "Warning: can't run convolution thread %d in RT mode.\n", i);
+            }
+        }
+    }
+    _threads = true;
+}
+
+
+void Convolver::worker (Convlevel *L)
+{
+    int n;
+
+    while (true)
+    {
+        L->_trig.acquire ();
+        if (_stop) break;
+        n = L->_ndone.load (std::memory_order_relaxed);
+        L->compute (L->_inpbuf.get () + (n & 1) * L->_size, L->_outbuf.get () + (n & 1) * NCVOUT * L->_size);
+        L->_ndone.store (n + 1, std::memory_order_release);
+    }
+}
+
+
+void Convolver::process (float gain, const float *R, float *W, float *X, float *Y, float *Z)
+{
+    int        c, i, j, n;
+    float      *out [NCVOUT] = { W, X, Y, Z };
+    float      *p;
+    Convlevel  *L;
+
+    // When the input has been exactly zero for longer than the response
+    // and all partition buffers, every level has zero state and output,
+    // and there is nothing to do until the input becomes non-zero.
+    for (i = 0; (i < PERIOD) && (R [i] == 0.0f); i++);
+    if (i < PERIOD) _nquiet = 0;
+    else if (_nquiet < _ntail) _nquiet += PERIOD;
+    else return;
+
+    // First level, directly.
+    L = _levels [0].get ();
+    L->compute (R, _out);
+    for (c = 0; c < NCVOUT; c++)
+    {
+        for (i = 0; i < PERIOD; i++) out [c][i] += gain * _out [c * PERIOD + i];
+    }
+
+    for (j = 1; j < _nlev; j++)
+    {
+        L = _levels [j].get ();
+        n = L->_size;
+        if (L->_valid)
+        {
+            p = L->_outbuf.get () + L->_rdbuf * NCVOUT * n + L->_ipos;
+            for (c = 0; c < NCVOUT; c++)
+            {
+                for (i = 0; i < PERIOD; i++) out [c][i] += gain * p [c * n + i];
+            }
+        }
+        std::copy_n (R, PERIOD, L->_inpbuf.get () + (L->_nsent & 1) * n + L->_ipos);
+        L->_ipos += PERIOD;
+        if (L->_ipos == n)
+        {
+            // The block just completed is sent to the worker. Its
+            // output is needed from the end of the next block, while
+            // that of the previous block is played now.
+            L->_ipos = 0;
+            L->_rdbuf = (L->_nsent - 1) & 1;
+            if (_threads)
+            {
+                L->_valid = (L->_ndone.load (std::memory_order_acquire) == L->_nsent);
+                if (! L->_valid) _nlate++;
+                L->_nsent++;
+                L->_trig.release ();
+            }
+            else
+            {
+                L->compute (L->_inpbuf.get () + (L->_nsent & 1) * n, L->_outbuf.get () + (L->_nsent & 1) * NCVOUT * n);
+                L->_nsent++;
+            }
+        }
+    }
+}
@@ -0,0 +1,111 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#ifndef __CONVOLVER_H
+#define __CONVOLVER_H
+
+
+#include <atomic>
+#include <complex>
+#include <memory>
+#include <semaphore>
+#include <thread>
+#include "asection.h"
+#include "fft.h"
+
+
+#define NCVOUT 4   // W, X, Y, Z
+#define NCVLEV 4   // maximum number of partition sizes
+
+
+// One partition size of a non-uniformly partitioned convolution.
+// Level L has partitions of PERIOD * 8^L samples and covers the part
+// of the impulse response from twice its own partition size to twice
+// that of the next level. Each level uses overlap-save with a
+// frequency domain delay line.
+//
+class Convlevel
+{
+private:
+
+    friend class Convolver;
+
+    Convlevel (int size, int npart, int offs, const float *ir, int nchan, int nfram, float scale);
+
+    void compute (const float *inp, float *out);
+
+    int        _size;    // partition size
+    int        _npart;   // number of partitions
+    int        _ipart;   // delay line index of the most recent input
+    Rfft       _fft;
+    std::unique_ptr <float []> _tbuf;
+    std::unique_ptr <float []> _prev;
+    std::unique_ptr <std::complex <float> []> _hspec;
+    std::unique_ptr <std::complex <float> []> _xspec;
+    std::unique_ptr <std::complex <float> []> _yspec;
+
+    // Used only for levels computed by a worker thread.
+    std::unique_ptr <float []> _inpbuf;  // 2 blocks, written by process ()
+    std::unique_ptr <float []> _outbuf;  // 2 blocks of NCVOUT channels
+    int        _ipos;    // position in the current block
+    int        _nsent;   // number of blocks sent to the worker
+    int        _rdbuf;   // output buffer being read
+    bool       _valid;   // output buffer is complete
+    std::atomic <int>  _ndone;
+    std::counting_semaphore <> _trig { 0 };
+    std::thread  _thread;
+};
+
+
+// Convolution reverb, replacing the Reverb for instruments that
+// define an impulse response. The input is the mono reverb send,
+// the outputs are W, X, Y, Z. The first level runs in the audio
+// thread and has no latency beyond the period. The longer ones run
+// in worker threads, each with a deadline equal to its partition
+// length, and with priorities decreasing with partition size.
+//
+class Convolver
+{
+public:
+
+    Convolver (const float *ir, int nchan, int nfram);
+    ~Convolver (void);
+
+    void start (int policy, int relpri);
+    void process (float gain, const float *R, float *W, float *X, float *Y, float *Z);
+    int  nlate (void) const { return _nlate; }
+
+private:
+
+    void worker (Convlevel *L);
+
+    int        _nlev;
+    std::unique_ptr <Convlevel> _levels [NCVLEV];
+    bool       _threads;
+    std::atomic <bool> _stop;
+    int        _nlate;
+    int        _ntail;   // samples after which all state is zero
+    int        _nquiet;  // samples since the last non-zero input
+    float      _out [NCVOUT * PERIOD];
+};
+
+
+#endif
@@ -0,0 +1,200 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include "diskstream.h"
+
+
+#define DS_POLL  10   // I/O thread wakeup interval in ms
+
+
+Diskstream::Diskstream (void) :
+    _thread (false), _stop (false), _nunder (0)
+{
+    _slots = std::make_unique <Slot []> (DS_NSLOT);
+    for (int i = 0; i < DS_NSLOT; i++)
+    {
+        _slots [i]._state = FREE;
+        _slots [i]._buff = std::make_unique <float []> (DS_SIZE);
+    }
+}
+
+
+Diskstream::~Diskstream (void)
+{
+    _stop = true;
+    if (_worker.joinable ())
+    {
+        _trig.release ();
+        _worker.join ();
+    }
+}
+
+
+void Diskstream::start (void)
+{
+    _worker = std::thread (&Diskstream::worker, this);
+    _thread = true;
+}
+
+
+// Start streaming nfram frames from offs in the file. Returns the
+// stream slot, or -1 if all are in use. The path must be shorter
+// than DS_PATH.
+//
+int Diskstream::open (const char *path, long offs, int nfram, float gain)
+{
+    int   i, k;
+    Slot  *S;
+
+    for (i = 0, S = _slots.get (); i < DS_NSLOT; i++, S++)
+    {
+        if (S->_state.load (std::memory_order_acquire) == FREE)
+	{
+            for (k = 0; path [k] && (k < DS_PATH - 1); k++) S->_path [k] = path [k];
+            S->_path [k] = 0;
+            S->_offs = offs;
+            S->_nfram = nfram;
+            S->_gain = gain;
+            S->_nwr.store (0, std::memory_order_relaxed);
+            S->_nrd.store (0, std::memory_order_relaxed);
+            S->_state.store (OPEN, std::memory_order_release);
+            if (_thread) _trig.release ();
+            else service (S);
+            return i;
+	}
+    }
+    _nunder++;
+    return -1;
+}
+
+
+// Read the next nfram frames of a stream. Frames that have not
+// arrived yet are replaced by zeros.
+//
+void Diskstream::read (int slot, float *data, int nfram)
+{
+    int   i;
+    long  nrd, nwr;
+    Slot  *S;
+
+    S = _slots.get () + slot;
+    nrd = S->_nrd.load (std::memory_order_relaxed);
+    if (! _thread)
+    {
+        while ((S->_nwr.load (std::memory_order_relaxed) < nrd + nfram) && service (S));
+    }
+    nwr = S->_nwr.load (std::memory_order_acquire);
+    for (i = 0; i < nfram; i++)
+    {
+        data [i] = (nrd + i < nwr) ? S->_buff [(nrd + i) & (DS_SIZE - 1)] : 0.0f;
+    }
+    if ((nwr < nrd + nfram) && (nwr < S->_nfram)) _nunder++;
+    S->_nrd.store (nrd + nfram, std::memory_order_release);
+}
+
+
+void Diskstream::close (int slot)
+{
+    Slot  *S;
+
+    S = _slots.get () + slot;
+    S->_state.store (CLOSE, std::memory_order_release);
+    if (_thread) _trig.release ();
+    else service (S);
+}
+
+
+// Do the next step for one stream. Returns true if there was
+// something to do.
+//
+bool Diskstream::service (Slot *S)
+{
+    int   i, n, s;
+    long  nrd, nwr;
+
+    switch (S->_state.load (std::memory_order_acquire))
+    {
+    case OPEN:
+        // If the file can't be opened the stream is silent. The
+        // stream may have been closed while the file was opened.
+        S->_file.open (S->_path);
+        s = OPEN;
+        if (! S->_state.compare_exchange_strong (s, RUN, std::memory_order_acq_rel)) S->_file.close ();
+        return true;
+
+    case RUN:
+        nwr = S->_nwr.load (std::memory_order_relaxed);
+        nrd = S->_nrd.load (std::memory_order_acquire);
+        // Skip any part the reader has passed already.
+        if (nwr < nrd) nwr = nrd;
+        n = (int) std::min (nrd + DS_SIZE, (long) S->_nfram) - nwr;
+        if (n <= 0)
+	{
+            if (nwr >= S->_nfram) S->_file.close ();
+            return false;
+	}
+        i = nwr & (DS_SIZE - 1);
+        n = std::min (n, std::min (DS_READ, DS_SIZE - i));
+        if (S->_file.read (S->_buff.get () + i, S->_offs + nwr, n, S->_gain) != n)
+	{
+            S->_file.close ();
+            return false;
+	}
+        S->_nwr.store (nwr + n, std::memory_order_release);
+        return true;
+
+    case CLOSE:
+        S->_file.close ();
+        S->_state.store (FREE, std::memory_order_release);
+        return true;
+    }
+    return false;
+}
+
+
+void Diskstream::worker (void)
+{
+    int   i, n, r;
+    bool  busy;
+
+    auto t = std::chrono::steady_clock::now ();
+    for (r = 0; ! _stop; )
+    {
+        (void) _trig.try_acquire_for (std::chrono::milliseconds (DS_POLL));
+        do
+	{
+            busy = false;
+            for (i = 0; (i < DS_NSLOT) && ! _stop; i++) busy |= service (_slots.get () + i);
+	}
+        while (busy && ! _stop);
+        // Report new underruns at most once per second.
+        if (std::chrono::steady_clock::now () - t >= std::chrono::seconds (1))
+	{
+            n = _nunder;
+            if (n != r) fprintf (stderr, "Disk streams: %d underruns\n", n - r);
+            r = n;
+            t = std::chrono::steady_clock::now ();
+	}
+    }
+}
@@ -0,0 +1,91 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#ifndef __DISKSTREAM_H
+#define __DISKSTREAM_H
+
+
+#include <atomic>
+#include <memory>
+#include <semaphore>
+#include <thread>
+#include "wavfile.h"
+
+
+#define DS_NSLOT  128     // maximum number of streams
+#define DS_SIZE   16384   // stream buffer size in frames, a power of 2
+#define DS_READ   4096    // maximum frames read at once
+#define DS_PATH   1024    // maximum path length
+
+
+// Streams ranges of sample files from disk for the audio thread.
+// Each stream has a ring buffer that an I/O thread keeps filled up
+// to DS_SIZE frames ahead of the reader. Data that is not there in
+// time is replaced by silence and counted as an underrun, and the
+// stream skips ahead. Without start (), the data is read on demand
+// in the calling thread, which is what offline rendering needs.
+//
+class Diskstream
+{
+public:
+
+    Diskstream (void);
+    ~Diskstream (void);
+
+    void start (void);
+
+    // Called by the audio thread.
+    int  open (const char *path, long offs, int nfram, float gain);
+    void read (int slot, float *data, int nfram);
+    void close (int slot);
+
+    int  nunder (void) const { return _nunder; }
+
+private:
+
+    enum { FREE, OPEN, RUN, CLOSE };
+
+    struct Slot
+    {
+        std::atomic <int>   _state;
+        std::atomic <long>  _nwr;     // frames written by the I/O thread
+        std::atomic <long>  _nrd;     // frames consumed by the audio thread
+        char                _path [DS_PATH];
+        long                _offs;    // first frame in the file
+        int                 _nfram;   // number of frames to stream
+        float               _gain;
+        Wavfile             _file;
+        std::unique_ptr <float []> _buff;
+    };
+
+    bool service (Slot *S);
+    void worker (void);
+
+    std::unique_ptr <Slot []> _slots;
+    bool                      _thread;
+    std::atomic <bool>        _stop;
+    std::atomic <int>         _nunder;
+    std::counting_semaphore <> _trig { 0 };
+    std::thread               _worker;
+};
+
+
+#endif
@@ -55,26 +55,42 @@ Division::Division (Asection *asect, float fsam) :
     _fsam (fsam),
     _swel (1.0f), _swel_last (1.0f),
     _gain (0.1f),
+    _vol (1.0f),
     _w (0.0f),
     _c (1.0f),
     _s (0.0f),
     _m (0.0f),
     _swel_alpha (compute_lowpass_alpha ((160.0f / fsam) * (2.0f * std::numbers::pi_v<float>))),
-    _swel_y1 { }
+    _swel_y1 { },
+    _buff { },
+    _pmlive (false)
 {
 }
 
 
-void Division::process (void) 
+void Division::process (float **out, float vol)
 {
     int    i;
+    bool   active;
     float  d, g, t;
-    float  *p, *q; 
+    float  *p, *q [NCHANN];
 
-    std::fill_n (_buff, NCHANN * PERIOD, 0);
+    active = false;
     for (i = 0; i < _nrank; i++)
-        if (_ranks [i])
+        if (_ranks [i] && _ranks [i]->active ())
+	{
             _ranks [i]->play (1);
+            active = true;
+	}
+    if (_premix)
+    {
+        for (i = 0; i < _premix->_nrank; i++)
+            if (_premix->_ranks [i]->active ())
+	    {
+                _premix->_ranks [i]->play (1);
+                active = true;
+	    }
+    }
 
     g = 1.0f;
     if (_trem)
@@ -98,31 +114,56 @@ void Division::process (void)
     t = 0.95f * _gain;
     if (g < t) g = t;
 
+    // If no pipe is sounding and the swell filter has decayed there is
+    // nothing to mix, and the asection is not woken up.
+    if (! active)
+    {
+        for (i = 0; i < NCHANN; i++) if (fabsf (_swel_y1 [i]) >= IDLE_LEVEL) active = true;
+    }
+    if (! active)
+    {
+        std::fill_n (_swel_y1, NCHANN, 0.0f);
+        _gain = g;
+        _vol = vol;
+        _swel_last = _swel;
+        return;
+    }
+    if (! out) _asect->wake ();
+
     d = (g - _gain) / PERIOD;    
     g = _gain;
     p = _buff;
     float swel = _swel_last;
     const float swel_d = (_swel - swel) / PERIOD;
-    q = _asect->get_wptr ();
+    // The volume is interpolated as well, it is used for crossfades.
+    float v = _vol;
+    const float v_d = (vol - v) / PERIOD;
+    // Mix into the asection, or write the channels to 'out' if given.
+    for (i = 0; i < NCHANN; i++) q [i] = out ? out [i] : _asect->get_wptr () + i * PERIOD * MIXLEN;
 
     float swel_y1 [NCHANN];
     std::copy_n (_swel_y1, NCHANN, swel_y1);
 
+    // The NCHANN channels are processed side by side, and each sample
+    // of _buff is cleared as it is consumed so the ranks find an empty
+    // buffer in the next period without a separate pass over it.
     for (i = 0; i < PERIOD; i++)
     {
         g += d;
         swel += swel_d;
+        v += v_d;
+        const float gv = g * v;
         for (int j = 0; j < NCHANN; j++)
         {
-            const float x0 = p [j * PERIOD] * g;
-            const float swel_y0 = _swel_alpha * x0 + (1.0f - _swel_alpha) * swel_y1 [j];
-            q [j * PERIOD * MIXLEN] += std::lerp (swel_y0, x0, swel);
-            swel_y1 [j] = swel_y0;
+            const float x0 = p [j * PERIOD] * gv;
+            p [j * PERIOD] = 0.0f;
+            swel_y1 [j] += _swel_alpha * (x0 - swel_y1 [j]);
+            q [j][i] += swel_y1 [j] + swel * (x0 - swel_y1 [j]);
         }
         p++;
-        q++;
     }
     _gain = g;
+    _vol = vol;
     _swel_last = swel;
     std::copy_n (swel_y1, NCHANN, _swel_y1);
 }
@@ -132,6 +173,7 @@ void Division::process (void)
 //
 void Division::set_rank (int ind, std::unique_ptr <Rankwave> W, int pan, int del)
 {
+    drop_premix ();
     if (_ranks [ind])
     {
         W->_nmask = _ranks [ind]->_nmask | NMASK_SET;
@@ -141,6 +183,8 @@ void Division::set_rank (int ind, std::unique_ptr <Rankwave> W, int pan, int del
     del = (int)(1e-3f * del * _fsam / PERIOD);
     if (del > 31) del = 31;
     _ranks [ind]->set_param (_buff, del, pan);
+    _rpan [ind] = pan;
+    _rdel [ind] = del;
     if (_nrank < ++ind) _nrank = ind;
 }
 
@@ -165,6 +209,15 @@ void Division::update (int note, int16_t mask)
 	    else W->note_off (note + 36);
 	}
     }
+    if (_pmlive)
+    {
+        for (r = 0; r < _premix->_nrank; r++)
+	{
+	    W = _premix->_ranks [r].get ();
+	    if (fullmask & W->_nmask) W->note_on (note + 36);
+	    else W->note_off (note + 36);
+	}
+    }
 }
 
 
@@ -207,6 +260,7 @@ void Division::set_div_mask (int bit, int linkage)
     int       r;
     Rankwave *W;
 
+    drop_premix ();
     _dmask |= 1 << (bit + linkage * (NKEYBD + 1));
     for (r = 0; r < _nrank; r++)
     {
@@ -228,6 +282,7 @@ void Division::clr_div_mask (int bit, int linkage)
     int       r;
     Rankwave *W;
 
+    drop_premix ();
     _dmask &= ~(1 << (bit + linkage * (NKEYBD + 1)));
     if (((_dmask >> bit) & NMASK_LINKREPL) != 0) return;
     for (r = 0; r < _nrank; r++)
@@ -247,6 +302,8 @@ void Division::clr_div_mask (int bit, int linkage)
 
 void Division::set_rank_mask (int ind, int bit, int linkage)
 {
+    if ((ind >= _nrank) || ! _ranks [ind]) return;
+    drop_premix ();
     int b = 1 << (bit + linkage * (NKEYBD + 1));
     Rankwave *W = _ranks [ind].get ();
     if (bit == NKEYBD) b |= merged_dmask () << (linkage * (NKEYBD + 1));
@@ -257,6 +314,8 @@ void Division::set_rank_mask (int ind, int bit, int linkage)
 
 void Division::clr_rank_mask (int ind, int bit, int linkage)
 {
+    if ((ind >= _nrank) || ! _ranks [ind]) return;
+    drop_premix ();
     int b = 1 << (bit + linkage * (NKEYBD + 1));
     Rankwave *W = _ranks [ind].get ();
     if (bit == NKEYBD) b |= merged_dmask () << (linkage * (NKEYBD + 1));
@@ -265,6 +324,107 @@ void Division::clr_rank_mask (int ind, int bit, int linkage)
 }
 
 
+// List the drawn ranks for the premix compiler. Returns false if
+// there is nothing to merge, or a premix is in use already.
+//
+bool Division::get_premix (Premix *X)
+{
+    int        i, k;
+    Rankwave  *W;
+
+    if (_pmlive) return false;
+    for (i = k = 0; i < _nrank; i++)
+    {
+        W = _ranks [i].get ();
+        if (W && (W->_nmask & NMASK_ALL))
+	{
+            X->_srcw [i] = W;
+            X->_srcm [i] = W->_nmask & NMASK_ALL;
+            X->_srcp [i] = _rpan [i];
+            X->_srcd [i] = _rdel [i];
+            k++;
+	}
+        else X->_srcw [i] = 0;
+    }
+    X->_nsrc = _nrank;
+    return k > 1;
+}
+
+
+// Install the premix X if its sources are still drawn with the same
+// note masks and have no update pending, and nothing of the current
+// one is sounding. Notes that are sounding keep their pipes until
+// released. Returns the premix to be destroyed by the model thread.
+//
+Premix *Division::set_premix (Premix *X)
+{
+    int        i, r;
+    Rankwave  *W;
+    Premix    *P;
+
+    if (_pmlive || ! X->_nrank || (_premix && _premix->active ())) return X;
+    for (i = 0; i < X->_nsrc; i++)
+    {
+        if (! X->_srcw [i]) continue;
+        W = _ranks [i].get ();
+        if ((W != X->_srcw [i]) || (W->_nmask != X->_srcm [i])) return X;
+    }
+    P = _premix.release ();
+    _premix.reset (X);
+    for (r = 0; r < X->_nrank; r++)
+    {
+        i = X->_rsrc [r];
+        X->_ranks [r]->set_param (_buff, X->_srcd [i], X->_srcp [i]);
+        X->_ranks [r]->_nmask = X->_srcm [i];
+    }
+    skip_premix (true);
+    _pmlive = true;
+    return P;
+}
+
+
+// Mark the pipes replaced by the premix in their source ranks.
+//
+void Division::skip_premix (bool s)
+{
+    int        i, r, n, n0;
+    uint32_t   b;
+    Rankwave  *W;
+
+    for (r = 0; r < _premix->_nrank; r++)
+    {
+        W = _premix->_ranks [r].get ();
+        n0 = W->n0 ();
+        for (n = n0; n <= W->n1 (); n++)
+	{
+            for (i = 0, b = _premix->_memb [r][n - n0]; b; i++, b >>= 1)
+	    {
+                if (b & 1) _ranks [i]->set_skip (n, s);
+	    }
+	}
+    }
+}
+
+
+// Give the notes back to the source ranks when the registration
+// changes. Sounding merged pipes are released, and the source ranks
+// restart them on the next update.
+//
+void Division::drop_premix (void)
+{
+    int i;
+
+    if (! _pmlive) return;
+    skip_premix (false);
+    for (i = 0; i < _premix->_nrank; i++) _premix->_ranks [i]->all_off ();
+    for (i = 0; i < _premix->_nsrc; i++)
+    {
+        if (_premix->_srcw [i]) _ranks [i]->_nmask |= NMASK_SET;
+    }
+    _pmlive = false;
+}
+
+
 int Division::merged_dmask () const
 {
     int merged = _dmask;
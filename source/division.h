@@ -25,6 +25,7 @@
 #include <memory>
 #include <numbers>
 #include "asection.h"
+#include "premix.h"
 #include "rankwave.h"
 
 
@@ -45,9 +46,11 @@ public:
     void trem_on (int linkage = 0);
     void trem_off (int linkage = 0);
 
-    void process (void);
+    void process (float **out = 0, float vol = 1.0f);
     void update (int note, int16_t mask);
     void update (uint16_t *keys);
+    bool get_premix (Premix *X);
+    Premix *set_premix (Premix *X);
 
 private:
    
@@ -59,6 +62,7 @@ private:
     float      _fsam;
     float      _swel, _swel_last;
     float      _gain;
+    float      _vol;
     float      _w;    
     float      _c;
     float      _s;
@@ -66,8 +70,14 @@ private:
     float      _swel_alpha;
     float      _swel_y1 [NCHANN];
     float      _buff [NCHANN * PERIOD];
+    int        _rpan [NRANKS];
+    int        _rdel [NRANKS];
+    std::unique_ptr <Premix> _premix;
+    bool       _pmlive;
 
     int merged_dmask () const;
+    void skip_premix (bool s);
+    void drop_premix (void);
 };
 
 
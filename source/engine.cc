@@ -0,0 +1,269 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#include <clthreads.h>
+#include "engine.h"
+#include "audio_host.h"
+#include "diskstream.h"
+#include "messages.h"
+#include "model.h"
+#include "rankwave.h"
+#include "slave.h"
+
+
+// Takes the place of the user interface plugin. It receives what the
+// model thread sends to the interface, and keeps what the engine needs
+// to answer the host.
+//
+class Hostiface : public A_thread
+{
+public:
+
+    Hostiface (Engine *engine) : A_thread ("Iface"), _engine (engine) {}
+    virtual ~Hostiface (void) {}
+
+    void terminate (void) {  put_event (EV_EXIT, 1); }
+
+private:
+
+    virtual void thr_main (void);
+
+    Engine  *_engine;
+};
+
+
+void Hostiface::thr_main (void)
+{
+    ITC_mesg *M;
+    int      i, j;
+
+    while (get_event () != EV_EXIT)
+    {
+	M = get_message ();
+        if (! M) continue;
+
+        switch (M->type ())
+	{
+            case MT_IFC_INIT:
+            {
+                // A new instrument, its labels are copied as the model
+                // may replace them.
+                M_ifc_init *X = (M_ifc_init *) M;
+                std::lock_guard <std::mutex> lock (_engine->_mutex);
+                _engine->_ready = false;
+                _engine->_labels.resize (X->_ngroup);
+                for (i = 0; i < X->_ngroup; i++)
+		{
+                    std::vector <std::string> &L = _engine->_labels [i];
+                    L.clear ();
+                    L.push_back (X->_groupd [i]._label);
+                    for (j = 0; j < X->_groupd [i]._nifelm; j++) L.push_back (X->_groupd [i]._ifelmd [j]._label);
+		}
+                break;
+	    }
+
+            case MT_IFC_READY:
+                _engine->_ready = true;
+                break;
+	}
+        M->recover ();
+    }
+    send_event (EV_EXIT, 1);
+}
+
+
+Engine::Engine (void) :
+    _ready (false)
+{
+}
+
+
+Engine::~Engine (void)
+{
+    close ();
+}
+
+
+// Open the instrument 'instr' in the stops directory, for output at
+// sample rate fsamp, in stereo or in Ambisonics B format. This returns
+// at once, the wavetables are ready when ready () becomes true. With
+// worker set, the host must call worker () from a thread of its own.
+//
+int Engine::open (const char *stops, const char *instr, int fsamp, bool bform, bool worker)
+{
+    M_midi_info  *M;
+
+    if (isopen () || (fsamp < 22050)) return 1;
+    _stops = stops;
+    _instr = instr;
+    _ready = false;
+
+    _qnote = std::make_unique <Lfq_u32> (256);
+    _qcomm = std::make_unique <Lfq_u32> (256);
+    _qmidi = std::make_unique <Lfq_u8> (1024);
+    _itcc = std::make_unique <ITC_ctrl> ();
+    _dstream = std::make_unique <Diskstream> ();
+    Rankwave::set_stream (_dstream.get ());
+
+    _audio = std::make_unique <Audio_host> ("aeolus", _qnote.get (), _qcomm.get (), _qmidi.get (), fsamp, bform);
+    _model = std::make_unique <Model> (_qcomm.get (), _qmidi.get (), _audio->midimap (), _audio->appname (),
+                                       _stops.c_str (), _instr.c_str (), "waves", nullptr, false);
+    _slave = std::make_unique <Slave> ();
+    _iface = std::make_unique <Hostiface> (this);
+
+    ITC_ctrl::connect (_audio.get (), EV_QMIDI, _model.get (), EV_QMIDI);
+    ITC_ctrl::connect (_audio.get (), TO_MODEL, _model.get (), FM_AUDIO);
+    ITC_ctrl::connect (_model.get (), EV_EXIT,  _itcc.get (), EV_EXIT);
+    ITC_ctrl::connect (_model.get (), TO_AUDIO, _audio.get (), FM_MODEL);
+    ITC_ctrl::connect (_model.get (), TO_SLAVE, _slave.get (), FM_MODEL);
+    ITC_ctrl::connect (_model.get (), TO_IFACE, _iface.get (), FM_MODEL);
+    ITC_ctrl::connect (_slave.get (), EV_EXIT,  _itcc.get (), EV_EXIT);
+    ITC_ctrl::connect (_slave.get (), TO_AUDIO, _audio.get (), FM_SLAVE);
+    ITC_ctrl::connect (_slave.get (), TO_MODEL, _model.get (), FM_SLAVE);
+    ITC_ctrl::connect (_iface.get (), EV_EXIT,  _itcc.get (), EV_EXIT);
+    ITC_ctrl::connect (_itcc.get (),  TO_MODEL, _model.get (), FM_IFACE);
+
+    // There is no MIDI thread, but the model waits for its info.
+    M = new M_midi_info ();
+    M->_client = 0;
+    M->_ipport = 0;
+    std::fill_n (M->_chbits, 16, 0);
+    _itcc->send_event (TO_MODEL, M);
+
+    _audio->start ();
+    _model->thr_start (SCHED_OTHER, 0, 0);
+    if (! worker) _slave->thr_start (SCHED_OTHER, 0, 0);
+    _dstream->start ();
+    _iface->thr_start (SCHED_OTHER, 0, 0);
+    return 0;
+}
+
+
+// Stop the threads and destroy the instrument. The host must no longer
+// call process (), and if it runs worker () that must still be running.
+//
+void Engine::close (void)
+{
+    int  n;
+
+    if (! isopen ()) return;
+    _model->terminate ();
+    _slave->terminate ();
+    _iface->terminate ();
+    for (n = 0; n < 3; n++) _itcc->get_event (1 << EV_EXIT);
+
+    _audio.reset ();
+    _model.reset ();
+    _slave.reset ();
+    _iface.reset ();
+    _dstream.reset ();
+    _itcc.reset ();
+    _qnote.reset ();
+    _qcomm.reset ();
+    _qmidi.reset ();
+    _ready = false;
+    std::lock_guard <std::mutex> lock (_mutex);
+    _labels.clear ();
+}
+
+
+// Compute and load wavetables on the calling thread, until the engine
+// is closed. Only if open () was called with worker set.
+//
+void Engine::worker (void)
+{
+    if (_slave) _slave->run ();
+}
+
+
+int Engine::nchan (void) const
+{
+    return _audio ? _audio->nplay () : 0;
+}
+
+
+int Engine::key_event (int time, int keybd, int note, bool on)
+{
+    return _audio ? _audio->key_event (time, keybd, note, on) : 1;
+}
+
+
+int Engine::midi_event (int time, const uint8_t *data, int size)
+{
+    if (! _audio || (size < 1)) return 1;
+    return _audio->midi_event (time, data [0], (size > 1) ? data [1] : 0, (size > 2) ? data [2] : 0);
+}
+
+
+// Output nframes on nchan () channels. Any number of frames can be
+// asked for, but the output is computed in periods of PERIOD frames.
+//
+void Engine::process (int nframes, float **outputs)
+{
+    if (_audio) _audio->process (nframes, outputs);
+}
+
+
+int Engine::ngroup (void) const
+{
+    std::lock_guard <std::mutex> lock (_mutex);
+    return _labels.size ();
+}
+
+
+int Engine::nifelm (int group) const
+{
+    std::lock_guard <std::mutex> lock (_mutex);
+    if ((group < 0) || (group >= (int) _labels.size ())) return 0;
+    return _labels [group].size () - 1;
+}
+
+
+// The label of a group, or with ifelm >= 0 that of one of its elements.
+//
+std::string Engine::label (int group, int ifelm) const
+{
+    std::lock_guard <std::mutex> lock (_mutex);
+    if ((group < 0) || (group >= (int) _labels.size ())) return "";
+    if ((ifelm < -1) || (ifelm + 1 >= (int) _labels [group].size ())) return "";
+    return _labels [group][ifelm + 1];
+}
+
+
+void Engine::set_stop (int group, int ifelm, bool on)
+{
+    if (_itcc) _itcc->send_event (TO_MODEL, new M_ifc_ifelm (on ? MT_IFC_ELSET : MT_IFC_ELCLR, group, ifelm));
+}
+
+
+void Engine::recall (int bank, int pres)
+{
+    if (_itcc) _itcc->send_event (TO_MODEL, new M_ifc_preset (MT_IFC_PRRCL, bank, pres, 0, 0));
+}
+
+
+// Replace the instrument by another one in the stops directory, with
+// a crossfade as the 'i' command of the text interface.
+//
+void Engine::load_instr (const char *instr)
+{
+    if (_itcc) _itcc->send_event (TO_MODEL, new M_ifc_instr (instr));
+}
@@ -0,0 +1,113 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __ENGINE_H
+#define __ENGINE_H
+
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+class ITC_ctrl;
+class Lfq_u8;
+class Lfq_u32;
+class Audio_host;
+class Diskstream;
+class Hostiface;
+class Model;
+class Slave;
+
+
+// Aeolus as a library (libaeolus). The host opens an instrument and
+// calls process () from its own audio thread, there is no JACK, ALSA
+// or user interface plugin. The model thread, that reads the instrument
+// and handles stops and presets, and the slave, that computes or loads
+// the wavetables, run as in the program. The slave can also be run on
+// a thread of the host, by calling worker () on it. The new ranks are
+// taken into use by process (), so it must be called while they are
+// loaded as well, as a JACK callback would be.
+//
+// The synthesis settings of Rankwave and Audio are global, so there can
+// be only one engine open in a process. They must be set before open ().
+//
+class Engine
+{
+public:
+
+    Engine (void);
+    ~Engine (void);
+
+    int  open (const char *stops, const char *instr, int fsamp, bool bform = false, bool worker = false);
+    void close (void);
+    void worker (void);
+
+    bool isopen (void) const { return _audio != nullptr; }
+    bool ready (void) const { return _ready; }
+    int  nchan (void) const;
+
+    // Called by the audio thread, or by one thread between calls of
+    // process (). Events have a time in frames from the start of the
+    // next process () call, and must be given in time order. They are
+    // applied at the start of the PERIOD that contains them. Notes are
+    // 0..60 on a keyboard, MIDI messages are routed as in the program.
+    int  key_event (int time, int keybd, int note, bool on);
+    int  midi_event (int time, const uint8_t *data, int size);
+    void process (int nframes, float **outputs);
+
+    // Called by any other thread. Stops are elements of the groups in
+    // the instrument definition, and are set by the model thread.
+    int  ngroup (void) const;
+    int  nifelm (int group) const;
+    std::string label (int group, int ifelm = -1) const;
+    void set_stop (int group, int ifelm, bool on);
+    void recall (int bank, int pres);
+    void load_instr (const char *instr);
+
+private:
+
+    Engine (const Engine&);
+    Engine& operator=(const Engine&);
+
+    friend class Hostiface;
+
+    std::string                   _stops;
+    std::string                   _instr;
+    std::unique_ptr <Lfq_u32>     _qnote;
+    std::unique_ptr <Lfq_u32>     _qcomm;
+    std::unique_ptr <Lfq_u8>      _qmidi;
+    std::unique_ptr <ITC_ctrl>    _itcc;
+    std::unique_ptr <Diskstream>  _dstream;
+    std::unique_ptr <Audio_host>  _audio;
+    std::unique_ptr <Model>       _model;
+    std::unique_ptr <Slave>       _slave;
+    std::unique_ptr <Hostiface>   _iface;
+    std::atomic <bool>            _ready;
+    mutable std::mutex            _mutex;
+    // For each group its label, followed by those of its elements.
+    std::vector <std::vector <std::string> > _labels;
+};
+
+
+#endif
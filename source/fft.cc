@@ -0,0 +1,125 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#include <math.h>
+#include <numbers>
+#include "fft.h"
+
+
+typedef std::complex <float> cfloat;
+
+
+Rfft::Rfft (int n) : _n (n), _m (n / 2)
+{
+    int     i, j, k;
+    double  a;
+
+    _brev = std::make_unique <int []> (_m);
+    _twc = std::make_unique <cfloat []> (_m / 2);
+    _twr = std::make_unique <cfloat []> (_m + 1);
+    _work = std::make_unique <cfloat []> (_m);
+
+    for (i = j = 0; i < _m; i++)
+    {
+        _brev [i] = j;
+        for (k = _m >> 1; k && (j & k); k >>= 1) j ^= k;
+        j |= k;
+    }
+    for (i = 0; i < _m / 2; i++)
+    {
+        a = -2 * std::numbers::pi * i / _m;
+        _twc [i] = cfloat (cos (a), sin (a));
+    }
+    for (i = 0; i <= _m; i++)
+    {
+        a = -2 * std::numbers::pi * i / _n;
+        _twr [i] = cfloat (cos (a), sin (a));
+    }
+}
+
+
+// In-place radix 2 complex FFT of _m points, input in bit reversed
+// order. The inverse uses conjugated twiddles.
+//
+void Rfft::cfft (cfloat *z, bool inv)
+{
+    int     i, j, k, h, s;
+    cfloat  t, w;
+
+    for (h = 1, s = _m / 2; h < _m; h <<= 1, s >>= 1)
+    {
+        for (i = 0; i < _m; i += 2 * h)
+        {
+            for (j = i, k = 0; j < i + h; j++, k += s)
+            {
+                w = inv ? std::conj (_twc [k]) : _twc [k];
+                t = w * z [j + h];
+                z [j + h] = z [j] - t;
+                z [j] += t;
+            }
+        }
+    }
+}
+
+
+void Rfft::forward (const float *x, cfloat *X)
+{
+    int     k;
+    cfloat  a, b, e, o;
+    cfloat  *z = _work.get ();
+
+    for (k = 0; k < _m; k++) z [_brev [k]] = cfloat (x [2 * k], x [2 * k + 1]);
+    cfft (z, false);
+
+    X [0] = cfloat (z [0].real () + z [0].imag (), 0);
+    X [_m] = cfloat (z [0].real () - z [0].imag (), 0);
+    for (k = 1; k < _m; k++)
+    {
+        a = z [k];
+        b = std::conj (z [_m - k]);
+        e = 0.5f * (a + b);
+        o = cfloat (0, -0.5f) * (a - b);
+        X [k] = e + _twr [k] * o;
+    }
+}
+
+
+void Rfft::inverse (const cfloat *X, float *x)
+{
+    int     k;
+    cfloat  a, b, e, o;
+    cfloat  *z = _work.get ();
+
+    for (k = 0; k < _m; k++)
+    {
+        a = X [k];
+        b = std::conj (X [_m - k]);
+        e = 0.5f * (a + b);
+        o = 0.5f * (a - b) * std::conj (_twr [k]);
+        z [_brev [k]] = e + cfloat (0, 1) * o;
+    }
+    cfft (z, true);
+    for (k = 0; k < _m; k++)
+    {
+        x [2 * k] = z [k].real ();
+        x [2 * k + 1] = z [k].imag ();
+    }
+}
@@ -0,0 +1,59 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#ifndef __FFT_H
+#define __FFT_H
+
+
+#include <complex>
+#include <memory>
+
+
+// Real FFT of n points, n a power of 2 and at least 4, computed as
+// a complex FFT of n / 2 points plus a split step. The spectrum has
+// n / 2 + 1 bins. Neither direction is normalised, so inverse () of
+// forward () returns the input multiplied by n / 2.
+//
+class Rfft
+{
+public:
+
+    Rfft () = default;
+    Rfft (int n);
+
+    int  size (void) const { return _n; }
+    void forward (const float *x, std::complex <float> *X);
+    void inverse (const std::complex <float> *X, float *x);
+
+private:
+
+    void cfft (std::complex <float> *z, bool inv);
+
+    int        _n;
+    int        _m;
+    std::unique_ptr <int []> _brev;
+    std::unique_ptr <std::complex <float> []> _twc;  // complex FFT twiddles
+    std::unique_ptr <std::complex <float> []> _twr;  // split step twiddles
+    std::unique_ptr <std::complex <float> []> _work;
+};
+
+
+#endif
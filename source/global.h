@@ -22,6 +22,7 @@
 #define __GLOBAL_H
 
 #include <cstdint>
+#include <cstring>
 #include <endian.h>
 #ifdef __BYTE_ORDER
 #if (__BYTE_ORDER == __LITTLE_ENDIAN)
@@ -44,6 +45,25 @@
 #include "lfqueue.h"
 
 
+// 64-bit hash, FNV-1a on words rather than bytes, with a shift so
+// the high bits also affect the low ones. Pass the previous result
+// as h to hash more than one block.
+//
+inline uint64_t hash64 (const char *p, size_t n, uint64_t h = 0xcbf29ce484222325ULL)
+{
+    uint64_t w;
+
+    for (; n >= 8; n -= 8, p += 8)
+    {
+        memcpy (&w, p, 8);
+        h = (h ^ w) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    while (n--) h = (h ^ (unsigned char)(*p++)) * 0x100000001b3ULL;
+    return h;
+}
+
+
 // GLOBAL LIMITS
 static constexpr int
     NASECT = 4,
@@ -57,6 +77,10 @@ static constexpr int
     NLINKS = 3;  // maximum number of linkages to a rank (e.g. drawstop + Sfz + GC)
 
 
+// Render quality profiles, selected with the -Q option.
+enum { PROF_FULL, PROF_BALANCED, PROF_LITE, NPROF };
+
+
 enum class midictl: std::uint8_t
 {
     cresc = 4,  // grand crescendo / foot controller
@@ -42,3 +42,11 @@ Lfq_u32::Lfq_u32 (int size) : _size (size), _mask (_size - 1), _nwr (0), _nrd (0
     assert (!(_size & _mask));
     _data = std::make_unique <uint32_t []> (_size);
 }
+
+
+Lfq_audio::Lfq_audio (int nblock, int nchan, int bsize) :
+    _nblock (nblock), _nchan (nchan), _bsize (bsize), _iwr (0), _ird (0), _nfill (0)
+{
+    assert (_nblock > 0);
+    _data = std::make_unique <float []> (_nblock * _nchan * _bsize);
+}
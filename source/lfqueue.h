@@ -22,6 +22,7 @@
 #define __LFQUEUE_H
 
 
+#include <atomic>
 #include <memory>
 #include <stdint.h>
 
@@ -98,5 +99,36 @@ private:
 };
 
 
+// Single reader, single writer queue of multichannel audio blocks.
+// The number of blocks need not be a power of 2.
+
+class Lfq_audio
+{
+public:
+
+    Lfq_audio (int nblock, int nchan, int bsize);
+
+    int       write_avail (void) const { return _nblock - _nfill.load (std::memory_order_acquire); }
+    void      write_commit (void) { if (++_iwr == _nblock) _iwr = 0; _nfill.fetch_add (1, std::memory_order_release); }
+    float    *write_ptr (int c) { return _data.get () + (_iwr * _nchan + c) * _bsize; }
+
+    int       read_avail (void) const { return _nfill.load (std::memory_order_acquire); }
+    void      read_commit (void) { if (++_ird == _nblock) _ird = 0; _nfill.fetch_sub (1, std::memory_order_release); }
+    float    *read_ptr (int c) { return _data.get () + (_ird * _nchan + c) * _bsize; }
+
+    int       nblock (void) const { return _nblock; }
+
+private:
+
+    std::unique_ptr <float []> _data;
+    int       _nblock;
+    int       _nchan;
+    int       _bsize;
+    int       _iwr;
+    int       _ird;
+    std::atomic <int> _nfill;
+};
+
+
 #endif
 
@@ -39,22 +39,27 @@
 #endif
 #include "model.h"
 #include "slave.h"
+#include "diskstream.h"
 #include "iface.h"
 
 
 static const char *options =
-    "htuJaBM:N:S:I:W:s:"
+    "htquPHUJaBM:N:S:I:W:F:s:o:Q:Z:T:V:"
 #if LIBSPATIALAUDIO_VERSION
     "b"
 #endif
 #ifdef __linux__
-    "Ad:r:p:n:"
+    "Ad:r:p:n:L:"
 #elif __APPLE__
     "Cr:p:"
 #endif
 ;
 static char  optline [1024];
 static bool  t_opt = false;
+static bool  q_opt = false;
+static bool  P_opt = false;
+static bool  H_opt = false;
+static bool  U_opt = false;
 static bool  u_opt = false;
 static bool  A_opt = false;
 static bool  a_opt = false;
@@ -68,12 +73,20 @@ static int   r_val = 44100;
 #endif
 static int   p_val = 1024;
 static int   n_val = 2;
+static int   o_val = Audio::OUT_MIXED;
+static int   L_val = 0;
 static const char *N_val = "aeolus";
 static const char *S_val = "stops";
 static const char *I_val = "Aeolus";
 static const char *W_val = "waves";
+static const char *F_val = 0;
+static const char *M_val = 0;
 static const char *d_val = "default";
 static const char *s_val = 0;
+static int   Q_val = PROF_FULL;
+static uint32_t Z_val = 0;
+static float T_val = 0;
+static int   V_val = 0;
 static Lfq_u32  note_queue (256);
 static Lfq_u32  comm_queue (256);
 static Lfq_u8   midi_queue (1024);
@@ -88,10 +101,20 @@ static void help (void)
     fprintf (stderr, "  -h                 Display this text\n");
     fprintf (stderr, "  -t                 Text mode user interface\n");
     fprintf (stderr, "  -u                 Use presets file in user's home dir\n");
+    fprintf (stderr, "  -q                 Reduce quality when the DSP load is too high\n");
+    fprintf (stderr, "  -P                 Merge pipes of a stable registration into premixed tables\n");
+    fprintf (stderr, "  -H                 Store bass and mid range tables at a lower rate\n");
+    fprintf (stderr, "  -U                 Render at a half or a quarter of a high device rate and upsample\n");
     fprintf (stderr, "  -N <name>          Name to use as JACK and ALSA client [aeolus]\n");   
     fprintf (stderr, "  -S <stops>         Name of stops directory [stops]\n");   
     fprintf (stderr, "  -I <instr>         Name of instrument directory [Aeolus]\n");   
     fprintf (stderr, "  -W <waves>         Name of waves directory [waves]\n");   
+    fprintf (stderr, "  -F <bundle>        Instrument, stops and waves from a bundle (aeolus_pack)\n");
+    fprintf (stderr, "  -M <dir>           Share wavetables with other processes in <dir>, e.g. /dev/shm\n");
+    fprintf (stderr, "  -Q <profile>       Render quality: full, balanced, lite [full]\n");
+    fprintf (stderr, "  -Z <seed>          Seed for reproducible random detune and instability\n");
+    fprintf (stderr, "  -T <dB>            End releases when their gain falls below this, -20..0 [off]\n");
+    fprintf (stderr, "  -V <voices>        Maximum number of sounding pipes per rank [no limit]\n");
 #if LIBSPATIALAUDIO_VERSION
     fprintf (stderr, "  -b                 Binaural (HRTF) output\n");
 #endif
@@ -99,11 +122,13 @@ static void help (void)
     fprintf (stderr, "    -s               Select JACK server\n");
     fprintf (stderr, "    -a               Autoconnect audio output and MIDI input\n");
     fprintf (stderr, "    -B               Ambisonics B format output\n");
+    fprintf (stderr, "    -o <ports>       Output ports: mixed, asect, divis [mixed]\n");
     fprintf (stderr, "  -A                 Use ALSA, with options:\n");
     fprintf (stderr, "    -d <device>        Alsa device [default]\n");
     fprintf (stderr, "    -r <rate>          Sample frequency [48000]\n");
     fprintf (stderr, "    -p <period>        Period size [1024]\n");
-    fprintf (stderr, "    -n <nfrags>        Number of fragments [2]\n\n");
+    fprintf (stderr, "    -n <nfrags>        Number of fragments [2]\n");
+    fprintf (stderr, "    -L <periods>       Render ahead by this many periods [0]\n\n");
 #if __APPLE__
     fprintf (stderr, "  -C                 Use CoreAudio rather than Jack\n");
     fprintf (stderr, "    -r <rate>          Sample frequency [44100]\n");
@@ -133,6 +158,10 @@ static void procoptions (int ac, char *av [], const char *where)
         case 'h' : help (); exit (0);
  	case 't' : t_opt = true;  break;
  	case 'u' : u_opt = true;  break;
+ 	case 'q' : q_opt = true;  break;
+ 	case 'P' : P_opt = true;  break;
+ 	case 'H' : H_opt = true;  break;
+ 	case 'U' : U_opt = true;  break;
  	case 'A' : A_opt = true;  break;
 	case 'J' : A_opt = false; break;
 	case 'a' : a_opt = true; break;
@@ -142,12 +171,40 @@ static void procoptions (int ac, char *av [], const char *where)
         case 'r' : r_val = atoi (optarg); break;
         case 'p' : p_val = atoi (optarg); break;
         case 'n' : n_val = atoi (optarg); break;
+        case 'L' : L_val = atoi (optarg); break;
         case 'N' : N_val = optarg; break; 
         case 'S' : S_val = optarg; break; 
         case 'I' : I_val = optarg; break; 
         case 'W' : W_val = optarg; break; 
+        case 'F' : F_val = optarg; break; 
+        case 'M' : M_val = optarg; break; 
         case 'd' : d_val = optarg; break; 
 	case 's' : s_val = optarg; break;
+        case 'Q' :
+            if      (! strcmp (optarg, "full"))     Q_val = PROF_FULL;
+            else if (! strcmp (optarg, "balanced")) Q_val = PROF_BALANCED;
+            else if (! strcmp (optarg, "lite"))     Q_val = PROF_LITE;
+            else
+            {
+                fprintf (stderr, "\n%s\n", where);
+                fprintf (stderr, "  Unknown quality profile '%s'.\n", optarg);
+                exit (1);
+            }
+            break;
+        case 'Z' : Z_val = strtoul (optarg, 0, 0); break;
+        case 'T' : T_val = atof (optarg); break;
+        case 'V' : V_val = atoi (optarg); break;
+        case 'o' :
+            if      (! strcmp (optarg, "mixed")) o_val = Audio::OUT_MIXED;
+            else if (! strcmp (optarg, "asect")) o_val = Audio::OUT_ASECT;
+            else if (! strcmp (optarg, "divis")) o_val = Audio::OUT_DIVIS;
+            else
+            {
+                fprintf (stderr, "\n%s\n", where);
+                fprintf (stderr, "  Unknown output topology '%s'.\n", optarg);
+                exit (1);
+            }
+            break;
         case '?':
             fprintf (stderr, "\n%s\n", where);
             if (optopt != ':' && strchr (options, optopt)) fprintf (stderr, "  Missing argument for '-%c' option.\n", optopt); 
@@ -203,6 +260,7 @@ static void sigint_handler (int)
 int main (int ac, char *av [])
 {
     ITC_ctrl       itcc;
+    Diskstream     dstream;
     std::unique_ptr <Audio> audio;
     std::unique_ptr <Imidi> imidi;
     std::unique_ptr <Model> model;
@@ -219,7 +277,18 @@ int main (int ac, char *av [])
     if (readconfig (s)) readconfig ("/etc/aeolus.conf"); 
     procoptions (ac, av, "On command line:");
 
-    if (mlockall (MCL_CURRENT | MCL_FUTURE)) fprintf (stderr, "Warning: memory lock failed.\n");
+    Rankwave::set_seed (Z_val);
+    Rankwave::set_release_floor (T_val);
+    Rankwave::set_voice_limit (V_val);
+    Audio::set_adaptive (q_opt);
+    Audio::set_profile (Q_val);
+    Audio::set_upsample (U_opt);
+    Model::set_premix (P_opt);
+    Rankwave::set_profile (Q_val);
+    Rankwave::set_decimate (H_opt);
+    Rankwave::set_stream (&dstream);
+
+    if (mlockall (MCL_CURRENT | MCL_FUTURE)) fprintf (stderr, "Warning: memory lock failed, wavetables will be locked individually.\n");
 
     if (t_opt) sprintf (s, "%s/aeolus_txt.so", LIBDIR);
     else       sprintf (s, "%s/aeolus_x11.so", LIBDIR);
@@ -239,20 +308,20 @@ int main (int ac, char *av [])
 
 #ifdef __linux__
     if (A_opt)
-        audio = std::make_unique <Audio_alsa> (N_val, &note_queue, &comm_queue, d_val, r_val, p_val, n_val, b_opt);
+        audio = std::make_unique <Audio_alsa> (N_val, &note_queue, &comm_queue, d_val, r_val, p_val, n_val, L_val, b_opt);
 #elif __APPLE__
     if (C_opt)
         audio = std::make_unique <Audio_coreaudio> (N_val, &note_queue, &comm_queue, r_val, p_val, b_opt);
 #endif
     if (!audio)
-        audio = std::make_unique <Audio_jack> (N_val, &note_queue, &comm_queue, s_val, a_opt, B_opt, b_opt, &midi_queue);
-    model = std::make_unique <Model> (&comm_queue, &midi_queue, audio->midimap (), audio->appname (), S_val, I_val, W_val, u_opt);
+        audio = std::make_unique <Audio_jack> (N_val, &note_queue, &comm_queue, s_val, a_opt, B_opt, b_opt, o_val, &midi_queue);
+    model = std::make_unique <Model> (&comm_queue, &midi_queue, audio->midimap (), audio->appname (), S_val, I_val, W_val, F_val, u_opt);
 #if __linux__
     imidi = std::make_unique <Imidi_alsa> (&note_queue, &midi_queue, audio->midimap (), audio->appname ());
 #elif __APPLE__
     imidi = std::make_unique <Imidi_coremidi> (&note_queue, &midi_queue, audio->midimap (), audio->appname ());
 #endif
-    slave = std::make_unique <Slave> ();
+    slave = std::make_unique <Slave> (M_val);
     iface = std::unique_ptr <Iface> (so_create (ac, av));
 
     ITC_ctrl::connect (audio.get (), EV_EXIT,  &itcc, EV_EXIT);
@@ -283,6 +352,7 @@ int main (int ac, char *av [])
 	model->thr_start (SCHED_OTHER, 0, 0);
     }
     slave->thr_start (SCHED_OTHER, 0, 0);
+    dstream.start ();
     iface->thr_start (SCHED_OTHER, 0, 0);
 
     signal (SIGINT, sigint_handler); 
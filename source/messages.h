@@ -22,14 +22,22 @@
 #define __MESSAGES_H
 
 #include <algorithm>
+#include <atomic>
 #include <clthreads.h>
 #include <string.h>
+#include <stdio.h>
 #include "rankwave.h"
 #include "asection.h"
 #include "addsynth.h"
 #include "global.h"
 
 
+class Convolver;
+class Division;
+class Premix;
+class Bundle;
+
+
 enum
 {
     FM_SLAVE =  8,
@@ -68,6 +76,11 @@ enum
     MT_CALC_RANK,
     MT_LOAD_RANK,
     MT_SAVE_RANK,
+    MT_LOAD_CONV,
+    MT_GET_PREMIX,
+    MT_CALC_PREMIX,
+    MT_NEW_INSTR,
+    MT_FREE_TABS,
 
     MT_IFC_INIT,
     MT_IFC_READY,
@@ -92,7 +105,9 @@ enum
     MT_IFC_EDIT,
     MT_IFC_APPLY,
     MT_IFC_SAVE,
-    MT_IFC_TXTIP
+    MT_IFC_TXTIP,
+    MT_IFC_QUALITY,
+    MT_IFC_INSTR
 };
 
 
@@ -112,6 +127,10 @@ public:
     int             _nasect;
     Fparm          *_instrpar;
     Fparm          *_asectpar [NASECT];
+    std::atomic <int>  *_tid;    // id of the thread running the synthesis
+    std::atomic <int>  *_qstat;  // quality level and DSP load in percent
+    int             _policy;
+    int             _relpri;
 };
 
 
@@ -158,6 +177,58 @@ public:
     Addsynth       *_synth;
     Rankwave       *_rwave;
     const char     *_path;
+    const char     *_smpdir; // sampled pipes, see Rankwave::load_samples ()
+    const Bundle   *_bundle; // if not zero, the wavetables are looked for here first
+    size_t          _resid;  // wavetable bytes in memory
+    size_t          _locked; // wavetable bytes locked
+};
+
+
+class M_load_conv : public ITC_mesg
+{
+public:
+
+    M_load_conv (void) : ITC_mesg (MT_LOAD_CONV), _conv (0) {}
+
+    char            _path [1024];
+    float           _fsamp;
+    int             _policy;
+    int             _relpri;
+    Convolver      *_conv;   // new one from slave to audio, old one from audio to model
+};
+
+
+class M_premix : public ITC_mesg
+{
+public:
+
+    M_premix (int type, int divis, int count) :
+        ITC_mesg (type),
+        _divis (divis),
+        _count (count),
+        _stat (false),
+        _npipe (0),
+        _nmerg (0),
+        _premix (0)
+    {}
+
+    int             _divis;
+    int             _count;   // rank calculation count when requested
+    bool            _stat;    // ranks to merge, or merged ranks installed
+    int             _npipe;   // number of pipes replaced
+    int             _nmerg;   // by this number of merged pipes
+    Premix         *_premix;  // to audio, and replaced one back to model
+};
+
+
+class M_new_instr : public ITC_mesg
+{
+public:
+
+    M_new_instr (void) : ITC_mesg (MT_NEW_INSTR), _ndivis (0) {}
+
+    int             _ndivis;
+    Division       *_divis [NDIVIS];  // old ones, from audio to model
 };
 
 
@@ -344,5 +415,34 @@ public:
 };
 
 
+class M_ifc_quality : public ITC_mesg
+{
+public:
+
+    M_ifc_quality (int q, int l) :
+        ITC_mesg (MT_IFC_QUALITY),
+        _level (q),
+        _load (l)
+    {}
+
+    int    _level;   // 0 is full quality
+    int    _load;    // DSP load in percent
+};
+
+
+class M_ifc_instr : public ITC_mesg
+{
+public:
+
+    M_ifc_instr (const char *path) :
+        ITC_mesg (MT_IFC_INSTR)
+    {
+        snprintf (_path, sizeof (_path), "%s", path);
+    }
+
+    char  _path [1024];
+};
+
+
 #endif
  
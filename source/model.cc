@@ -25,13 +25,23 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <time.h>
+#include <type_traits>
 #include <utility>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "model.h"
 #include "audio.h"
 #include "scales.h"
 #include "global.h"
 
 
+#define PREMIX_WAIT 40  // timer ticks without stop changes before merging
+#define CACHE_VERS  1   // version of the instrument cache format
+
+
+bool Model::_pmix = false;
+
+
 Divis::Divis (void) :
     _flags (0),
     _dmask (0),
@@ -84,6 +94,7 @@ Model::Model (Lfq_u32      *qcomm,
               const char   *stopsdir,
               const char   *instrdir,
               const char   *wavesdir,
+              const char   *bundle,
               bool          uhome) :
     A_thread ("Model"),
     _qcomm (qcomm),
@@ -91,8 +102,10 @@ Model::Model (Lfq_u32      *qcomm,
     _midimap (midimap),
     _appname (appname),
     _stopsdir (stopsdir),
+    _bndfile (bundle),
     _uhome (uhome),
     _ready (false), 
+    _swap (0),
     _nasect (0),
     _ndivis (0),
     _nkeybd (0),
@@ -106,10 +119,15 @@ Model::Model (Lfq_u32      *qcomm,
     _sfz_depressed (false),
     _sfz_engaged (false),
     _audio (0),
-    _midi (0)
+    _midi (0),
+    _pgflt { 0, 0 },
+    _qlevel (0),
+    _pmwait (-1)
 {
     sprintf (_instrdir, "%s/%s", stopsdir, instrdir);
     sprintf (_wavesdir, "%s/%s", stopsdir, wavesdir);
+    sprintf (_smpdir, "%s/samples", stopsdir);
+    *_convfile = 0;
     std::fill_n (_midimap, 16, 0);
 }
 
@@ -142,6 +160,9 @@ void Model::thr_main (void)
 	case EV_TIME:    
 	    inc_time (50000);
 	    proc_qmidi ();
+            check_pgflt ();
+            check_quality ();
+            check_premix ();
 	    break;
 
 	case EV_QMIDI:
@@ -159,7 +180,9 @@ void Model::thr_main (void)
 
 void Model::init (void)
 {
-    read_instr ();
+    // Without the bundle, the separate files are used.
+    if (_bndfile && ! _bundle.open (_bndfile)) printf ("Using bundle '%s'\n", _bndfile);
+    if (read_cache () && ! read_instr ()) write_cache ();
     read_presets ();
 }
 
@@ -277,6 +300,8 @@ void Model::proc_mesg (ITC_mesg *M)
 	// Store a preset.
 	M_ifc_preset  *X = (M_ifc_preset *) M;
         uint32_t       d [NGROUP];
+        // Not the empty stops of an instrument still being built.
+        if (_swap == 1) break;
         get_state (d);
         set_preset (X->_bank, X->_pres, d);         
         break;
@@ -286,6 +311,7 @@ void Model::proc_mesg (ITC_mesg *M)
 	// Insert a preset.
 	M_ifc_preset *X = (M_ifc_preset *) M;
         uint32_t     d [NGROUP];
+        if (_swap == 1) break;
         get_state (d);
         ins_preset (X->_bank, X->_pres, d);         
         break;
@@ -331,12 +357,23 @@ void Model::proc_mesg (ITC_mesg *M)
 	save ();
         break;
 
+    case MT_IFC_INSTR:
+    {
+	// Replace the instrument.
+	M_ifc_instr *X = (M_ifc_instr *) M;
+        load_instr (X->_path);
+        break;
+    }
+
     case MT_LOAD_RANK:
     case MT_CALC_RANK:
     {
 	// Load a rank into a division.
         M_def_rank *X = (M_def_rank *) M; 
-        _divis [X->_divis]._ranks [X->_rank]._rwave = X->_rwave;
+        Rank       *R = _divis [X->_divis]._ranks + X->_rank;
+        R->_rwave = X->_rwave;
+        R->_resid = X->_resid;
+        R->_locked = X->_locked;
 	break;
     }
     case MT_AUDIO_INFO:
@@ -348,6 +385,7 @@ void Model::proc_mesg (ITC_mesg *M)
             init_audio ();
             init_iface ();
             init_ranks (MT_LOAD_RANK);
+            init_convol ();
 	}
 	break;
 
@@ -360,14 +398,75 @@ void Model::proc_mesg (ITC_mesg *M)
             init_audio ();
             init_iface ();
             init_ranks (MT_LOAD_RANK);
+            init_convol ();
 	}
 	break;
 
+    case MT_LOAD_CONV:
+    {
+	// Convolver replaced by the audio thread, destroy the old one.
+        M_load_conv *X = (M_load_conv *) M;
+        if (X->_conv && X->_conv->nlate ())
+        {
+            fprintf (stderr, "Convolution: %d late blocks\n", X->_conv->nlate ());
+        }
+        delete X->_conv;
+	break;
+    }
+
     case MT_AUDIO_SYNC:
 	// Wavetable calculation done.
+        print_memstat ();
         send_event (TO_IFACE, new ITC_mesg (MT_IFC_READY));
         _ready = true;
+        _pmwait = PREMIX_WAIT;
+        // The ranks replaced have been destroyed by the audio thread.
+        send_event (TO_SLAVE, new ITC_mesg (MT_FREE_TABS));
+        if (_swap == 1)
+	{
+	    // A new instrument is fading in, recall the current preset.
+            _swap = 2;
+            set_state (_bank, _pres);
+	}
+	break;
+
+    case MT_NEW_INSTR:
+    {
+	// Crossfade done, destroy the previous instrument.
+        M_new_instr *X = (M_new_instr *) M;
+        for (int d = 0; d < X->_ndivis; d++) delete X->_divis [d];
+        send_event (TO_SLAVE, new ITC_mesg (MT_FREE_TABS));
+        _swap = 0;
+	break;
+    }
+
+    case MT_GET_PREMIX:
+    {
+	// Drawn ranks listed by the audio thread. The slave may read
+	// them only if no rank has been replaced since the request.
+        M_premix *X = (M_premix *) M;
+        if (X->_stat && _ready && (X->_count == _count))
+	{
+            M_premix *Y = new M_premix (MT_CALC_PREMIX, X->_divis, X->_count);
+            Y->_premix = X->_premix;
+            X->_premix = 0;
+            send_event (TO_SLAVE, Y);
+	}
+        delete X->_premix;
+	break;
+    }
+    case MT_CALC_PREMIX:
+    {
+	// Premix installed or rejected by the audio thread, destroy
+	// the one that is returned.
+        M_premix *X = (M_premix *) M;
+        if (X->_stat)
+	{
+            printf ("Division '%s': %d pipes premixed into %d\n", _divis [X->_divis]._label, X->_npipe, X->_nmerg);
+	}
+        delete X->_premix;
 	break;
+    }
 
     default:
         fprintf (stderr, "Model: unexpected message, type = %ld\n", M->type ());
@@ -384,8 +483,10 @@ void Model::proc_qmidi (void)
     // from either the midi thread (ALSA), or the audio thread
     // (JACK). They are encoded as raw MIDI, except that all
     // messages are 3 bytes. All command have already been
-    // checked at the sending side.
+    // checked at the sending side. While a new instrument is
+    // built they are left in the queue.
 
+    if (_swap == 1) return;
     while (_qmidi->read_avail () >= 3)
     {
 	t = _qmidi->read (0);
@@ -480,6 +581,8 @@ void Model::init_audio (void)
     Divis        *D;
     M_new_divis  *M;
 
+    // The divisions are sent through the slave, so they reach the
+    // audio thread before any of their ranks.
     for (d = 0, D = _divis; d < _ndivis; d++, D++)
     {
         M = new M_new_divis (); 
@@ -489,7 +592,7 @@ void Model::init_audio (void)
         M->_swell = D->_param [Divis::SWELL]._val;
         M->_tfreq = D->_param [Divis::TFREQ]._val;
         M->_tmodd = D->_param [Divis::TMODD]._val;
-        send_event (TO_AUDIO, M);  
+        send_event (TO_SLAVE, M);  
     }
 }
 
@@ -586,6 +689,229 @@ void Model::init_ranks (int comm)
 }
 
 
+// Ask the slave to load the instrument's impulse response, if any.
+// The convolver is then passed to the audio thread.
+//
+void Model::init_convol (void)
+{
+    M_load_conv  *M;
+
+    if (! *_convfile) return;
+    M = new M_load_conv ();
+    if (*_convfile == '/') snprintf (M->_path, sizeof (M->_path), "%s", _convfile);
+    else snprintf (M->_path, sizeof (M->_path), "%s/%s", _instrdir, _convfile);
+    M->_fsamp = _audio->_fsamp;
+    M->_policy = _audio->_policy;
+    M->_relpri = _audio->_relpri;
+    send_event (TO_SLAVE, M);
+}
+
+
+// Replace the instrument by the one in directory instr of the stops
+// directory, without stopping. It is read and its ranks are loaded
+// while the current one is playing, then the audio thread crossfades
+// from one to the other. If it can't be read the current one is kept.
+//
+void Model::load_instr (const char *instr)
+{
+    int       g, i, j;
+    bool      conv;
+    float     fbase;
+    int       itemp;
+    char      prev [1024];
+    int       state [NGROUP][Group::NIFELM];
+    std::unique_ptr <Divis []> D;
+
+    if (! _ready || _swap)
+    {
+        fprintf (stderr, "Can't change the instrument now, try again later\n");
+        return;
+    }
+    if (_bundle.isopen ())
+    {
+        fprintf (stderr, "The instrument is a bundle, it can't be changed\n");
+        return;
+    }
+    write_presets ();
+
+    // Keep what is not in the definition, in case the new one fails.
+    strcpy (prev, _instrdir);
+    for (g = 0; g < _ngroup; g++)
+    {
+        for (i = 0; i < _group [g]._nifelm; i++) state [g][i] = _group [g]._ifelms [i]._state;
+    }
+    D = std::make_unique <Divis []> (NDIVIS);
+    std::move (_divis, _divis + NDIVIS, D.get ());
+    fbase = _fbase;
+    itemp = _itemp;
+    conv = *_convfile;
+
+    snprintf (_instrdir, sizeof (_instrdir), "%s/%s", _stopsdir, instr);
+    clear_instr ();
+    if (read_cache ())
+    {
+        if (read_instr ())
+	{
+            fprintf (stderr, "Keeping instrument '%s'\n", prev);
+            strcpy (_instrdir, prev);
+            clear_instr ();
+            if (read_cache ()) read_instr ();
+            std::move (D.get (), D.get () + NDIVIS, _divis);
+            for (g = 0; g < _ngroup; g++)
+	    {
+                for (i = 0; i < _group [g]._nifelm; i++) _group [g]._ifelms [i]._state = state [g][i];
+	    }
+            _fbase = fbase;
+            _itemp = itemp;
+            return;
+	}
+        write_cache ();
+    }
+    for (i = 0; i < NBANK; i++)
+    {
+        for (j = 0; j < NPRES; j++) _preset [i][j].reset ();
+    }
+    read_presets ();
+    _cresc_pos = 0;
+    _sfz_engaged = false;
+
+    // The audio sections start from their defaults, as they do
+    // when Aeolus is started with the new instrument. This also
+    // resets those the new one does not use.
+    for (i = 0; i < _audio->_nasect; i++) Asection::init_apar (_audio->_asectpar [i]);
+
+    // Build the new divisions next to the current ones. Until
+    // they are complete no stop, preset or division parameter
+    // is changed, as the audio thread still plays the current
+    // divisions. MIDI messages wait in qmidi until then.
+    _swap = 1;
+    send_event (TO_SLAVE, new M_new_instr ());
+    init_audio ();
+    init_iface ();
+    init_ranks (MT_LOAD_RANK);
+    if (*_convfile) init_convol ();
+    else if (conv) send_event (TO_AUDIO, new M_load_conv ());
+}
+
+
+// Forget the instrument, before reading another one.
+//
+void Model::clear_instr (void)
+{
+    int    g, i;
+    Group  *G;
+    Ifelm  *I;
+
+    std::fill_n (_keybd, NKEYBD, Keybd ());
+    for (i = 0; i < NDIVIS; i++) _divis [i] = Divis ();
+    for (g = 0, G = _group; g < NGROUP; g++, G++)
+    {
+        *G->_label = 0;
+        G->_nifelm = 0;
+        for (i = 0, I = G->_ifelms; i < Group::NIFELM; i++, I++)
+	{
+            *I->_label = 0;
+            *I->_mnemo = 0;
+            I->_state = 0;
+#if MULTISTOP
+            std::fill_n (I->_action [0], 16, 0);
+#else
+            I->_action0 = I->_action1 = 0;
+#endif
+	}
+    }
+    _nasect = 0;
+    _nkeybd = 0;
+    _ndivis = 0;
+    _ngroup = 0;
+    *_convfile = 0;
+}
+
+
+void Model::print_memstat (void)
+{
+    int     d, r;
+    size_t  resid, locked;
+    Rank    *R;
+
+    resid = locked = 0;
+    for (d = 0; d < _ndivis; d++)
+    {
+        for (r = 0; r < _divis [d]._nrank; r++)
+        {
+            R = _divis [d]._ranks + r;
+            if (! R->_rwave) continue;
+            resid += R->_resid;
+            locked += R->_locked;
+        }
+    }
+    printf ("Wavetables: %.1lf MB resident, %.1lf MB locked\n", resid / 1048576.0, locked / 1048576.0);
+}
+
+
+void Model::check_pgflt (void)
+{
+    int   tid, k;
+    long  minflt, majflt;
+    char  s [256];
+    char  *p;
+    FILE  *F;
+
+    // Report page faults taken by the audio thread. These are read
+    // here from /proc, so that the audio thread has no system call.
+    if (! _audio || ! _ready) return;
+    tid = _audio->_tid->load (std::memory_order_relaxed);
+    if (! tid) return;
+    snprintf (s, 256, "/proc/self/task/%d/stat", tid);
+    if (! (F = fopen (s, "r"))) return;
+    k = fread (s, 1, 255, F);
+    fclose (F);
+    s [k] = 0;
+    // The thread name may contain spaces, the fields follow the last ')'.
+    if (! (p = strrchr (s, ')'))) return;
+    if (sscanf (p + 1, " %*c %*d %*d %*d %*d %*d %*u %ld %*u %ld", &minflt, &majflt) != 2) return;
+    if ((minflt != _pgflt [0]) || (majflt != _pgflt [1]))
+    {
+        printf ("Audio thread page faults: %ld minor, %ld major\n", minflt, majflt);
+        _pgflt [0] = minflt;
+        _pgflt [1] = majflt;
+    }
+}
+
+
+void Model::check_quality (void)
+{
+    int  level, load;
+
+    // Report changes of the audio thread's quality level.
+    if (! _audio || ! _ready) return;
+    level = _audio->_qstat [0].load (std::memory_order_relaxed);
+    if (level != _qlevel)
+    {
+        load = _audio->_qstat [1].load (std::memory_order_relaxed);
+        send_event (TO_IFACE, new M_ifc_quality (level, load));
+        _qlevel = level;
+    }
+}
+
+
+void Model::check_premix (void)
+{
+    int       d;
+    M_premix  *M;
+
+    // When the stops have not changed for PREMIX_WAIT, ask the audio
+    // thread to list the drawn ranks of each division.
+    if (! _pmix || ! _ready || (_pmwait < 0) || _pmwait--) return;
+    for (d = 0; d < _ndivis; d++)
+    {
+        M = new M_premix (MT_GET_PREMIX, d, _count);
+        M->_premix = new Premix ();
+        send_event (TO_AUDIO, M);
+    }
+}
+
+
 void Model::proc_rank (int g, int i, int comm)
 {
     int         d, r;
@@ -617,6 +943,7 @@ void Model::proc_rank (int g, int i, int comm)
 	        M->_synth = R->_synth.get ();
 	        M->_rwave = R->_rwave;
 	        M->_path  = _wavesdir;
+	        M->_bundle = 0;
 	        send_event (TO_SLAVE, M);
 	    }
 	}
@@ -634,6 +961,8 @@ void Model::proc_rank (int g, int i, int comm)
 	    M->_synth = R->_synth.get ();
 	    M->_rwave = R->_rwave;
 	    M->_path  = _wavesdir;
+	    M->_smpdir = _smpdir;
+	    M->_bundle = _bundle.isopen () ? &_bundle : 0;
 	    send_event (TO_SLAVE, M);
 	}
 #if MULTISTOP
@@ -650,12 +979,13 @@ void Model::set_ifelm (int g, int i, int m)
     Group  *G;    
 
     G = _group + g;
-    if ((! _ready) || (g >= _ngroup) || (i >= G->_nifelm)) return;
+    if ((! _ready) || (_swap == 1) || (g >= _ngroup) || (i >= G->_nifelm)) return;
     I = G->_ifelms + i;
     s = (m == 2) ? (I->_state & 1) ^ 1 : m;
     if ((I->_state & 1) != s)
     {
 	I->_state = (I->_state & ~1) | s;
+        _pmwait = PREMIX_WAIT;
         if (_qcomm->write_avail ())
 	{
 #if MULTISTOP
@@ -683,12 +1013,13 @@ void Model::set_linkage (int group_idx, int ifelm_idx, int state, int linkage)
     Group  *G;
 
     G = _group + group_idx;
-    if ((! _ready) || (group_idx >= _ngroup) || (ifelm_idx >= G->_nifelm) ||
+    if ((! _ready) || (_swap == 1) || (group_idx >= _ngroup) || (ifelm_idx >= G->_nifelm) ||
         (linkage < 1) || (linkage >= NLINKS)) return;
     I = G->_ifelms + ifelm_idx;
     if (((I->_state >> linkage) & 1) != state)
     {
 	I->_state = (I->_state & ~(1 << linkage)) | (state << linkage);
+        _pmwait = PREMIX_WAIT;
         if (_qcomm->write_avail ())
 	{
 #if MULTISTOP
@@ -714,7 +1045,7 @@ void Model::clr_group (int g)
     Group  *G;    
 
     G = _group + g;
-    if ((! _ready) || (g >= _ngroup)) return;
+    if ((! _ready) || (_swap == 1) || (g >= _ngroup)) return;
 
     for (i = 0; i < G->_nifelm; i++)
     {
@@ -722,6 +1053,7 @@ void Model::clr_group (int g)
         if (I->_state & 1)
         {
 	    I->_state &= ~1;
+            _pmwait = PREMIX_WAIT;
             if (_qcomm->write_avail ())
 	    {
 #if MULTISTOP
@@ -770,6 +1102,8 @@ void Model::set_state (int bank, int pres)
 
     _bank = bank;
     _pres = pres;
+    // While a new instrument is built it is recalled when that is done.
+    if (_swap == 1) return;
     if (get_preset (bank, pres, d))
     {
         for (g = 0; g < _ngroup; g++)
@@ -883,6 +1217,8 @@ void Model::set_dipar (int s, int d, dipar p, float v)
     Fparm  *P;
     union { uint32_t i; float f; } u;
     
+    // Not while the divisions of a new instrument are being built.
+    if (_swap == 1) return;
     P = _divis [d]._param + static_cast<int>(p);
     if (v < P->_min) v = P->_min;
     if (v > P->_max) v = P->_max;
@@ -995,8 +1331,17 @@ int Model::read_instr (void)
            BAD_SCOPE, BAD_ASECT, BAD_RANK, BAD_DIVIS, BAD_KEYBD, BAD_IFACE,
            BAD_STR1, BAD_STR2 };
 
-    sprintf (buff, "%s/definition", _instrdir);
-    if (! (F = fopen (buff, "r"))) 
+    if (_bundle.isopen ())
+    {
+        sprintf (buff, "%s:definition", _bundle.path ());
+        F = _bundle.fopen ("definition");
+    }
+    else
+    {
+        sprintf (buff, "%s/definition", _instrdir);
+        F = fopen (buff, "r");
+    }
+    if (! F) 
     {
 	fprintf (stderr, "Can't open '%s' for reading\n", buff);
         return 1;
@@ -1128,6 +1473,16 @@ int Model::read_instr (void)
             else if (sscanf (q, "%f%d%n", &_fbase, &_itemp, &n) != 2) stat = ARGS;
             else q += n;
 	}
+        else if (! strcmp (p, "/convol"))
+        {
+	    if (D || G) stat = BAD_SCOPE;
+            else if (sscanf (q, "%255s%n", t1, &n) != 1) stat = ARGS;
+            else
+            {
+                q += n;
+                strcpy (_convfile, t1);
+            }
+	}
         else if (! strcmp (p, "/rank"))
         {
 	    if (!D && G) stat = BAD_SCOPE;
@@ -1145,7 +1500,7 @@ int Model::read_instr (void)
 		{
                     A = std::make_unique <Addsynth> ();
         	    strcpy (A->_filename, t1);
-                    if (A->load (_stopsdir))
+                    if (load_stop (A.get ()))
 		    {
 			stat = ERROR;
 			A.reset ();
@@ -1158,6 +1513,8 @@ int Model::read_instr (void)
                         R->_count = 0;
                         R->_synth = std::move (A);
                         R->_rwave = 0;
+                        R->_resid = 0;
+                        R->_locked = 0;
 		    }
  		}
 	    }
@@ -1352,6 +1709,315 @@ int Model::read_instr (void)
 }
 
 
+// The resolved instrument, with the data of all its stops, is cached
+// in the waves directory as '<instr>.ae2'. It is used instead of the
+// definition if that has the same hash, and every stop file the same
+// modification time and size, as when the cache was written. Then no
+// stop file has to be opened. The cache starts with a 32 byte header
+// ("ae2", version, hash of all that follows, hash of the definition,
+// number of ranks, size of an Addsynth), then for each rank 80 bytes:
+// the name of its stop file and its time and size as 64-bit integers,
+// then the model. The Addsynth objects are stored as they are in
+// memory, which is why the cache is only for this build and machine.
+//
+static_assert (std::is_trivially_copyable <Addsynth>::value, "Addsynth is cached as raw memory");
+
+
+void Model::cache_name (char *name, int size)
+{
+    const char *p;
+
+    p = strrchr (_instrdir, '/');
+    snprintf (name, size, "%s/%s.ae2", _wavesdir, p ? p + 1 : _instrdir);
+}
+
+
+// Hash of the definition file and the program version, so a new
+// version doesn't use a cache that an older one wrote, or zero if
+// the file can't be read.
+//
+uint64_t Model::instr_hash (void)
+{
+    FILE   *F;
+    char   name [1200];
+    long   k, n;
+    std::unique_ptr <char []> B;
+
+    sprintf (name, "%s/definition", _instrdir);
+    if (! (F = fopen (name, "r"))) return 0;
+    fseek (F, 0, SEEK_END);
+    k = ftell (F);
+    fseek (F, 0, SEEK_SET);
+    B = std::make_unique <char []> (k + 1);
+    n = fread (B.get (), 1, k, F);
+    fclose (F);
+    if (n != k) return 0;
+    return hash64 (B.get (), k) ^ hash64 (VERSION, strlen (VERSION));
+}
+
+
+int Model::read_cache (void)
+{
+    FILE          *F;
+    int           d, g, i, r, n;
+    long          k;
+    char          name [1200];
+    char          *p;
+    struct stat   S;
+    Keybd         *K;
+    Divis         *D;
+    Rank          *R;
+    Group         *G;
+    Ifelm         *I;
+    std::unique_ptr <char []> B;
+
+    if (_bundle.isopen ()) return 1;
+    cache_name (name, sizeof (name));
+    if (! (F = fopen (name, "rb"))) return 1;
+    fseek (F, 0, SEEK_END);
+    k = ftell (F);
+    fseek (F, 0, SEEK_SET);
+    if (k < 32)
+    {
+        fclose (F);
+        return 1;
+    }
+    B = std::make_unique <char []> (k);
+    n = fread (B.get (), 1, k, F);
+    fclose (F);
+
+    // A damaged or incomplete cache fails the first hash, so the data
+    // can be read without checking it again.
+    p = B.get ();
+    if (   (n != k) || strcmp (p, "ae2") || (p [4] != CACHE_VERS) || (p [5] != MULTISTOP)
+        || (*((int32_t *)(p + 28)) != sizeof (Addsynth))
+        || (*((uint64_t *)(p + 8)) != hash64 (p + 16, k - 16))
+        || (*((uint64_t *)(p + 16)) != instr_hash ()))
+    {
+#ifdef DEBUG
+	fprintf (stderr, "Cache '%s' is out of date\n", name);
+#endif
+	return 1;
+    }
+    n = *((int32_t *)(p + 24));
+    if (32 + 80L * n > k) return 1;
+    for (i = 0, p += 32; i < n; i++, p += 80)
+    {
+        snprintf (name, sizeof (name), "%s/%s", _stopsdir, p);
+        if (   stat (name, &S)
+            || (*((int64_t *)(p + 64)) != (int64_t)(S.st_mtime))
+            || (*((int64_t *)(p + 72)) != (int64_t)(S.st_size)))
+	{
+#ifdef DEBUG
+	    fprintf (stderr, "Stop '%s' has changed\n", name);
+#endif
+	    return 1;
+	}
+    }
+    if (! (F = fmemopen (p, k - (p - B.get ()), "rb"))) return 1;
+
+    fread (&_fbase, sizeof (float), 1, F);
+    fread (&_itemp, sizeof (int), 1, F);
+    fread (_convfile, 1, sizeof (_convfile), F);
+    fread (&_nasect, sizeof (int), 1, F);
+    fread (&_nkeybd, sizeof (int), 1, F);
+    for (K = _keybd; K < _keybd + _nkeybd; K++)
+    {
+        fread (K->_label, 1, sizeof (K->_label), F);
+        fread (&K->_pedal, sizeof (bool), 1, F);
+    }
+    fread (&_ndivis, sizeof (int), 1, F);
+    for (d = 0, D = _divis; d < _ndivis; d++, D++)
+    {
+        fread (D->_label, 1, sizeof (D->_label), F);
+        fread (&D->_flags, sizeof (int), 1, F);
+        fread (&D->_dmask, sizeof (int), 1, F);
+        fread (&D->_nrank, sizeof (int), 1, F);
+        fread (&D->_asect, sizeof (int), 1, F);
+        fread (&D->_keybd, sizeof (int), 1, F);
+        fread (D->_param, sizeof (Fparm), Divis::NPARAM, F);
+        for (r = 0, R = D->_ranks; r < D->_nrank; r++, R++)
+	{
+            R->_count = 0;
+            R->_synth = std::make_unique <Addsynth> ();
+            R->_rwave = 0;
+            R->_resid = 0;
+            R->_locked = 0;
+            fread (R->_synth.get (), sizeof (Addsynth), 1, F);
+	}
+    }
+    fread (&_ngroup, sizeof (int), 1, F);
+    for (g = 0, G = _group; g < _ngroup; g++, G++)
+    {
+        fread (G->_label, 1, sizeof (G->_label), F);
+        fread (&G->_nifelm, sizeof (int), 1, F);
+        for (i = 0, I = G->_ifelms; i < G->_nifelm; i++, I++)
+	{
+            fread (I->_label, 1, sizeof (I->_label), F);
+            fread (I->_mnemo, 1, sizeof (I->_mnemo), F);
+            fread (&I->_type, sizeof (int), 1, F);
+            fread (&I->_keybd, sizeof (int), 1, F);
+#if MULTISTOP
+            fread (I->_action, 1, sizeof (I->_action), F);
+#else
+            fread (&I->_action0, sizeof (uint32_t), 1, F);
+            fread (&I->_action1, sizeof (uint32_t), 1, F);
+#endif
+	}
+    }
+    fclose (F);
+    cache_name (name, sizeof (name));
+    printf ("Reading '%s'\n", name);
+    return 0;
+}
+
+
+int Model::write_cache (void)
+{
+    FILE          *F;
+    int           d, g, i, r, n;
+    char          *b;
+    size_t        k;
+    char          name [1200];
+    char          tmp [1220];
+    char          data [80];
+    struct stat   S;
+    Keybd         *K;
+    Divis         *D;
+    Rank          *R;
+    Group         *G;
+    Ifelm         *I;
+
+    if (_bundle.isopen ()) return 1;
+
+    // Written to memory first, for the hash in the header.
+    if (! (F = open_memstream (&b, &k))) return 1;
+    std::fill_n (data, 32, 0);
+    fwrite (data, 1, 32, F);
+    for (d = n = 0, D = _divis; d < _ndivis; d++, D++)
+    {
+        for (r = 0, R = D->_ranks; r < D->_nrank; r++, R++, n++)
+	{
+            snprintf (name, sizeof (name), "%s/%s", _stopsdir, R->_synth->_filename);
+            if (stat (name, &S))
+	    {
+		fclose (F);
+                free (b);
+                return 1;
+	    }
+            std::fill_n (data, 80, 0);
+            strcpy (data, R->_synth->_filename);
+            *((int64_t *)(data + 64)) = S.st_mtime;
+            *((int64_t *)(data + 72)) = S.st_size;
+            fwrite (data, 1, 80, F);
+	}
+    }
+
+    fwrite (&_fbase, sizeof (float), 1, F);
+    fwrite (&_itemp, sizeof (int), 1, F);
+    fwrite (_convfile, 1, sizeof (_convfile), F);
+    fwrite (&_nasect, sizeof (int), 1, F);
+    fwrite (&_nkeybd, sizeof (int), 1, F);
+    for (K = _keybd; K < _keybd + _nkeybd; K++)
+    {
+        fwrite (K->_label, 1, sizeof (K->_label), F);
+        fwrite (&K->_pedal, sizeof (bool), 1, F);
+    }
+    fwrite (&_ndivis, sizeof (int), 1, F);
+    for (d = 0, D = _divis; d < _ndivis; d++, D++)
+    {
+        fwrite (D->_label, 1, sizeof (D->_label), F);
+        fwrite (&D->_flags, sizeof (int), 1, F);
+        fwrite (&D->_dmask, sizeof (int), 1, F);
+        fwrite (&D->_nrank, sizeof (int), 1, F);
+        fwrite (&D->_asect, sizeof (int), 1, F);
+        fwrite (&D->_keybd, sizeof (int), 1, F);
+        fwrite (D->_param, sizeof (Fparm), Divis::NPARAM, F);
+        for (r = 0, R = D->_ranks; r < D->_nrank; r++, R++)
+	{
+            fwrite (R->_synth.get (), sizeof (Addsynth), 1, F);
+	}
+    }
+    fwrite (&_ngroup, sizeof (int), 1, F);
+    for (g = 0, G = _group; g < _ngroup; g++, G++)
+    {
+        fwrite (G->_label, 1, sizeof (G->_label), F);
+        fwrite (&G->_nifelm, sizeof (int), 1, F);
+        for (i = 0, I = G->_ifelms; i < G->_nifelm; i++, I++)
+	{
+            fwrite (I->_label, 1, sizeof (I->_label), F);
+            fwrite (I->_mnemo, 1, sizeof (I->_mnemo), F);
+            fwrite (&I->_type, sizeof (int), 1, F);
+            fwrite (&I->_keybd, sizeof (int), 1, F);
+#if MULTISTOP
+            fwrite (I->_action, 1, sizeof (I->_action), F);
+#else
+            fwrite (&I->_action0, sizeof (uint32_t), 1, F);
+            fwrite (&I->_action1, sizeof (uint32_t), 1, F);
+#endif
+	}
+    }
+    fclose (F);
+
+    strcpy (b, "ae2");
+    b [4] = CACHE_VERS;
+    b [5] = MULTISTOP;
+    *((uint64_t *)(b + 16)) = instr_hash ();
+    *((int32_t *)(b + 24)) = n;
+    *((int32_t *)(b + 28)) = sizeof (Addsynth);
+    *((uint64_t *)(b + 8)) = hash64 (b + 16, k - 16);
+
+    // Written to a temporary file that is then renamed, so that
+    // another process never reads one that is half written.
+    cache_name (name, sizeof (name));
+    snprintf (tmp, sizeof (tmp), "%s.%d", name, (int) getpid ());
+    if (! (F = fopen (tmp, "wb")))
+    {
+#ifdef DEBUG
+	fprintf (stderr, "Can't open '%s' for writing\n", tmp);
+#endif
+        free (b);
+        return 1;
+    }
+    fwrite (b, 1, k, F);
+    free (b);
+    if (fflush (F) || ferror (F) || fsync (fileno (F)))
+    {
+        fprintf (stderr, "Error writing '%s'\n", tmp);
+        fclose (F);
+        unlink (tmp);
+        return 1;
+    }
+    fclose (F);
+    if (rename (tmp, name))
+    {
+        fprintf (stderr, "Can't rename '%s' to '%s'\n", tmp, name);
+        unlink (tmp);
+        return 1;
+    }
+    return 0;
+}
+
+
+// Read a stop from the bundle if there is one, else from its file.
+//
+int Model::load_stop (Addsynth *A)
+{
+    FILE  *F;
+    int   r;
+
+    if (! _bundle.isopen ()) return A->load (_stopsdir);
+    if (! (F = _bundle.fopen (A->_filename)))
+    {
+        fprintf (stderr, "Can't find '%s' in '%s'\n", A->_filename, _bundle.path ());
+        return 1;
+    }
+    r = A->load (F);
+    fclose (F);
+    return r;
+}
+
+
 int Model::write_instr (void)
 {
     FILE          *F;
@@ -1364,6 +2030,11 @@ int Model::write_instr (void)
     Ifelm         *I;
     Addsynth      *A;
 
+    if (_bundle.isopen ())
+    {
+	fprintf (stderr, "The instrument is a bundle, its definition is not saved\n");
+        return 1;
+    }
     sprintf (buff, "%s/definition", _instrdir);
     if (! (F = fopen (buff, "w"))) 
     {
@@ -1378,6 +2049,7 @@ int Model::write_instr (void)
 
     fprintf (F, "\n/instr/new\n");
     fprintf (F, "/tuning %5.1f %d\n", _fbase, _itemp); 
+    if (*_convfile) fprintf (F, "/convol %s\n", _convfile);
 
     fprintf (F, "\n# Keyboards\n#\n");
     for (k = 0; k < _nkeybd; k++)
@@ -1533,11 +2205,17 @@ int Model::read_presets (void)
         if (p) sprintf (name, "%s/.aeolus-presets", p);
         else strcpy (name, ".aeolus-presets");
     }
+    else if (_bundle.isopen ())
+    {
+	sprintf (name, "%s:presets", _bundle.path ());
+    }
     else
     {
 	sprintf (name, "%s/presets", _instrdir);
     }
-    if (! (F = fopen (name, "r"))) 
+    if (_bundle.isopen () && ! _uhome) F = _bundle.fopen ("presets");
+    else F = fopen (name, "r");
+    if (! F) 
     {
 	fprintf (stderr, "Can't open '%s' for reading\n", name);
         return 1;
@@ -1612,6 +2290,11 @@ int Model::write_presets (void)
         if (p) sprintf (name, "%s/.aeolus-presets", p);
         else strcpy (name, ".aeolus-presets");
     }
+    else if (_bundle.isopen ())
+    {
+	fprintf (stderr, "The instrument is a bundle, use -u to save presets\n");
+        return 1;
+    }
     else
     {
 	sprintf (name, "%s/presets", _instrdir);
@@ -28,6 +28,7 @@
 #include "lfqueue.h"
 #include "addsynth.h"
 #include "rankwave.h"
+#include "bundle.h"
 #include "global.h"
 
 #ifndef MULTISTOP
@@ -51,6 +52,8 @@ public:
     int         _count;
     std::unique_ptr <Addsynth> _synth;
     Rankwave   *_rwave;
+    size_t      _resid;
+    size_t      _locked;
 };
 
     
@@ -155,12 +158,15 @@ public:
            const char   *stops,
            const char   *instr,
            const char   *waves,
+           const char   *bundle,
            bool          uhome);
 
     virtual ~Model (void);
    
     void terminate (void) {  put_event (EV_EXIT, 1); }
 
+    static void set_premix (bool on) { _pmix = on; }
+
 private:
 
     virtual void thr_main (void);
@@ -172,6 +178,13 @@ private:
     void init_audio (void);
     void init_iface (void);
     void init_ranks (int comm);
+    void init_convol (void);
+    void load_instr (const char *instr);
+    void clear_instr (void);
+    void print_memstat (void);
+    void check_pgflt (void);
+    void check_quality (void);
+    void check_premix (void);
     void proc_rank (int g, int i, int comm);
     void set_ifelm (int g, int i, int m);
     void set_linkage (int group_idx, int ifelm_idx, int state, int linkage);
@@ -194,6 +207,11 @@ private:
     void save (void);
     Rank *find_rank (int g, int i);
     int  read_instr (void);
+    int  load_stop (Addsynth *A);
+    int  read_cache (void);
+    int  write_cache (void);
+    void cache_name (char *name, int size);
+    uint64_t instr_hash (void);
     int  write_instr (void);
     int  get_preset (int bank, int pres, uint32_t *bits);
     void set_preset (int bank, int pres, uint32_t *bits);
@@ -209,8 +227,13 @@ private:
     const char     *_stopsdir;
     char            _instrdir [1024];
     char            _wavesdir [1024];
+    char            _smpdir [1024];
+    char            _convfile [256];
+    const char     *_bndfile;
+    Bundle          _bundle;
     bool            _uhome;
     bool            _ready;
+    int             _swap;   // 1 while a new instrument is built, 2 while it fades in
 
     Asect           _asect [NASECT];
     Keybd           _keybd [NKEYBD];
@@ -236,6 +259,11 @@ private:
     std::unique_ptr <Preset> _preset [NBANK][NPRES];
     M_audio_info   *_audio;
     M_midi_info    *_midi;
+    long            _pgflt [2];
+    int             _qlevel;
+    int             _pmwait;
+
+    static bool     _pmix;
 };
 
 
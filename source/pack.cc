@@ -0,0 +1,140 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string>
+#include <vector>
+#include "bundle.h"
+
+
+static const char *options = "hS:I:W:";
+static const char *S_val = "stops";
+static const char *I_val = "Aeolus";
+static const char *W_val = "waves";
+
+static std::vector <std::string> names;
+static std::vector <std::string> files;
+
+
+static void help (void)
+{
+    fprintf (stderr, "\nAeolus bundle packer %s\n\n", VERSION);
+    fprintf (stderr, "Usage: aeolus_pack <options> <bundle>\n");
+    fprintf (stderr, "Options:\n");
+    fprintf (stderr, "  -h                 Display this text\n");
+    fprintf (stderr, "  -S <stops>         Name of stops directory [stops]\n");
+    fprintf (stderr, "  -I <instr>         Name of instrument directory [Aeolus]\n");
+    fprintf (stderr, "  -W <waves>         Name of waves directory [waves]\n");
+    fprintf (stderr, "The bundle holds the instrument definition and presets, all\n");
+    fprintf (stderr, "stops and the saved wavetables. It is replaced atomically.\n");
+    exit (1);
+}
+
+
+static void procoptions (int ac, char *av [])
+{
+    int k;
+
+    while ((k = getopt (ac, av, options)) != -1)
+    {
+        if (optarg && (*optarg == '-'))
+        {
+	    fprintf (stderr, "\n%s\n", "Missing argument");
+            help ();
+	}
+	switch (k)
+	{
+        case 'S' : S_val = optarg; break;
+        case 'I' : I_val = optarg; break;
+        case 'W' : W_val = optarg; break;
+        case 'h' :
+        case '?':
+            help ();
+        }
+    }
+    if (optind != ac - 1) help ();
+}
+
+
+static void add (const char *dir, const char *name)
+{
+    names.push_back (name);
+    files.push_back (std::string (dir) + "/" + name);
+}
+
+
+// Add all files in dir with the extension ext.
+//
+static int addall (const char *dir, const char *ext)
+{
+    DIR            *D;
+    struct dirent  *E;
+    const char     *p;
+    int            n;
+
+    if (! (D = opendir (dir))) return -1;
+    n = 0;
+    while ((E = readdir (D)))
+    {
+        p = strrchr (E->d_name, '.');
+        if (p && ! strcmp (p, ext))
+	{
+	    add (dir, E->d_name);
+            n++;
+	}
+    }
+    closedir (D);
+    return n;
+}
+
+
+int main (int ac, char *av [])
+{
+    int          i, n0, n1;
+    char         idir [1024];
+    char         wdir [1024];
+    std::vector <const char *> N, F;
+
+    procoptions (ac, av);
+    snprintf (idir, sizeof (idir), "%s/%s", S_val, I_val);
+    snprintf (wdir, sizeof (wdir), "%s/%s", S_val, W_val);
+
+    add (idir, "definition");
+    if (! access ((std::string (idir) + "/presets").c_str (), R_OK)) add (idir, "presets");
+    if ((n0 = addall (S_val, ".ae0")) < 0)
+    {
+        fprintf (stderr, "Can't read directory '%s'\n", S_val);
+        return 1;
+    }
+    if ((n1 = addall (wdir, ".ae1")) < 0) n1 = 0;
+
+    for (i = 0; i < (int) names.size (); i++)
+    {
+        N.push_back (names [i].c_str ());
+        F.push_back (files [i].c_str ());
+    }
+    if (Bundle::write (av [optind], N.size (), N.data (), F.data ())) return 1;
+    printf ("Wrote '%s': %d stops, %d wavetable files\n", av [optind], n0, n1);
+    return 0;
+}
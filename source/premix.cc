@@ -0,0 +1,128 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#include <algorithm>
+#include <memory>
+#include "premix.h"
+
+
+Premix::Premix (void) :
+    _nsrc (0),
+    _nrank (0),
+    _npipe (0),
+    _nmerg (0)
+{
+}
+
+
+bool Premix::active (void) const
+{
+    int r;
+
+    for (r = 0; r < _nrank; r++) if (_ranks [r]->active ()) return true;
+    return false;
+}
+
+
+// Sources with the same note mask and routing form a group. For each
+// note, the pipes of a group are divided by their loop key, and each
+// set of two or more becomes a pipe of a merged rank. A group needs
+// as many merged ranks as it has such sets for any note.
+//
+void Premix::compile (void)
+{
+    int       i, j, k, l, c, n, n0, n1, b, key;
+    uint32_t  m, u, v, g;
+    Rankwave  *W [NRANKS];
+
+    _nrank = 0;
+    _npipe = 0;
+    _nmerg = 0;
+    g = 0;
+    for (i = 0; i < _nsrc; i++)
+    {
+        if (! _srcw [i] || (g & (1u << i))) continue;
+        m = 0;
+        n0 = _srcw [i]->n0 ();
+        n1 = _srcw [i]->n1 ();
+        for (j = i; j < _nsrc; j++)
+        {
+            if (   _srcw [j]
+                && (_srcm [j] == _srcm [i])
+                && (_srcp [j] == _srcp [i])
+                && (_srcd [j] == _srcd [i]))
+	    {
+                m |= 1u << j;
+                n0 = std::min (n0, _srcw [j]->n0 ());
+                n1 = std::max (n1, _srcw [j]->n1 ());
+	    }
+        }
+        g |= m;
+        if (! (m & (m - 1))) continue;
+
+        b = _nrank;
+        for (n = n0; n <= n1; n++)
+	{
+            c = b;
+            u = 0;
+            for (j = i; j < _nsrc; j++)
+	    {
+                if (! (m & (1u << j)) || (u & (1u << j))) continue;
+                key = _srcw [j]->loopkey (n);
+                if (key < 0) continue;
+                for (l = j, k = 0, v = 0; l < _nsrc; l++)
+		{
+                    if ((m & (1u << l)) && (_srcw [l]->loopkey (n) == key))
+		    {
+                        W [k++] = _srcw [l];
+                        v |= 1u << l;
+		    }
+		}
+                u |= v;
+                if (k < 2) continue;
+                if (c == _nrank) add_rank (i, n0, n1);
+                _ranks [c]->merge (n, W, k);
+                _memb [c][n - n0] = v;
+                _npipe += k;
+                _nmerg++;
+                c++;
+	    }
+	}
+    }
+
+    for (c = 0; c < _nrank; c++)
+    {
+        std::size_t resid = 0, locked = 0;
+        _ranks [c]->prefault (&resid, &locked);
+    }
+}
+
+
+void Premix::add_rank (int src, int n0, int n1)
+{
+    int n;
+
+    _ranks [_nrank] = std::make_unique <Rankwave> (n0, n1);
+    for (n = n0; n <= n1; n++) _ranks [_nrank]->set_skip (n, true);
+    _memb [_nrank] = std::make_unique <uint32_t []> (n1 - n0 + 1);
+    _rsrc [_nrank] = src;
+    _nrank++;
+}
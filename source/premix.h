@@ -0,0 +1,69 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#ifndef __PREMIX_H
+#define __PREMIX_H
+
+
+#include <memory>
+#include "rankwave.h"
+#include "global.h"
+
+
+// A premix replaces, while the registration does not change, the
+// pipes of a division that can be summed exactly into one: those of
+// the same note in ranks with the same note mask and routing, and
+// with the same sample step and loop length. The sources are listed
+// by the audio thread, the merged ranks are computed by the slave
+// thread, and installed by the audio thread.
+
+class Premix
+{
+public:
+
+    Premix (void);
+
+    void compile (void);
+    bool active (void) const;
+
+    int         _nsrc;
+    Rankwave   *_srcw [NRANKS];  // source rank if it is drawn, else 0
+    int         _srcm [NRANKS];  // its note mask
+    int         _srcp [NRANKS];  // its pan
+    int         _srcd [NRANKS];  // its delay in periods
+
+    int         _nrank;
+    std::unique_ptr <Rankwave> _ranks [NRANKS];   // merged ranks
+    int         _rsrc [NRANKS];                   // a source with the same mask and routing
+    std::unique_ptr <uint32_t []> _memb [NRANKS]; // for each note, the sources replaced
+    int         _npipe;  // number of pipes replaced
+    int         _nmerg;  // number of merged pipes
+
+private:
+
+    Premix (const Premix&);
+    Premix& operator=(const Premix&);
+
+    void add_rank (int src, int n0, int n1);
+};
+
+
+#endif
@@ -19,14 +19,28 @@
 
 
 #include <algorithm>
+#include <atomic>
 #include <forward_list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <thread>
+#include <unistd.h>
 #include <utility>
+#include <vector>
+#include <sys/mman.h>
+#include "global.h"
 #include "rankwave.h"
+#include "diskstream.h"
+#include "wavfile.h"
+
+
+#define RED_VMAX 8        // voice limit at reduced quality
+#define RED_GMIN 0.316f   // release floor at reduced quality, -10 dB
 
 #ifndef REPETITION_POINTS // sp
 # define REPETITION_POINTS 1
@@ -34,9 +48,21 @@
 
 extern float exp2ap (float);
 
+uint32_t Pipewave::_seed = 0;
+float   Pipewave::_g_min = 0.0f;
+float   Pipewave::_f_max = 0.45f;
+int     Pipewave::_d_max = 1;
 Rngen   Pipewave::_rgen;
+Diskstream *Pipewave::_dstream = 0;
 std::unique_ptr <float []> Pipewave::_arg;
 std::unique_ptr <float []> Pipewave::_att;
+std::unique_ptr <float []> Pipewave::_rsk;
+std::mutex Pipewave::_lmutex;
+std::map <uintptr_t, Pipewave::Lockpage> Pipewave::_lpages;
+int     Rankwave::_vmax = 0;
+int     Rankwave::_vset = 0;
+float   Rankwave::_gset = 0.0f;
+bool    Rankwave::_reduce = false;
 
 
 void Pipewave::initstatic (float fsamp)
@@ -51,6 +77,14 @@ void Pipewave::initstatic (float fsamp)
 }   
 
 
+Pipewave::~Pipewave ()
+{
+    if (_i_p) _dstream->close (_s_p);
+    if (_s_t >= 0) _dstream->close (_s_t);
+    unlock ();
+}
+
+
 void Pipewave::play (void)
 {
     int     i, k;
@@ -87,10 +121,12 @@ void Pipewave::play (void)
         q = _out; 
 	g = _g_r;
         i = _i_r - 1;
+        if (g < _g_min) i = 0;  // final period, fade out
         dg = g / PERIOD;  
         if (i) dg *= _m_r ;
  
-        if (r < _p1)
+        if (_k_d > 1) r = play_herm (r, q, &_y_r, (r < _p1) ? 0.0f : _d_r, &g, dg);
+        else if (r < _p1)
         {
             while (k--)
             {
@@ -135,17 +171,33 @@ void Pipewave::play (void)
     { 
         k = PERIOD;             
         q = _out;
-        if (p < _p1)
+        if (_k_d > 1)
+	{
+            // The attack ends at a period boundary, and has no
+            // instability, so it is always played with zero fraction.
+            if ((p < _p1) || (_d_a == 0.0f)) p = play_deci (p, q);
+            else
+	    {
+                _z_p += _d_w * (_d_a * (urandf () - 0.5f) - _z_p);
+                p = play_herm (p, q, &_y_p, _z_p / _k_d, 0, 0.0f);
+	    }
+	}
+        else if (p < _p1)
         {
             while (k--)
             {
 		*q++ += *p++;
 	    }
         }
+        else if (_d_a == 0.0f)
+	{
+            // Without instability _z_p and _y_p remain zero.
+            p = play_steady (p, q);
+	}
         else 
 	{
             y = _y_p;
-            _z_p += _d_w * (_d_a * (_rgen.urandf () - 0.5f) - _z_p);
+            _z_p += _d_w * (_d_a * (urandf () - 0.5f) - _z_p);
             dy = _z_p * _k_s;
             while (k--)
 	    {            
@@ -173,36 +225,334 @@ void Pipewave::play (void)
 }               
 
 
-void Pipewave::genwave (Addsynth *D, int n, float fsamp, float fpipe)
+// Sampled pipes have no instability or release detune, and the
+// loop is released by fading it out while the release tail plays.
+// A note on while the tail is still sounding restarts the attack,
+// and a note off restarts the tail. If the loop is still fading
+// out in the streamed part of the attack, a new attack cuts it.
+//
+void Pipewave::play_smp (void)
 {
-    int    h, i, k, nc;
-    float  f0, f1, f, m, t, v, v0;
+    int     i, k, n;
+    float   g, dg;
+    float   *p, *q, *r;
+    float   d [PERIOD];
+    Smpdata *S = _smp.get ();
 
-    m = D->_n_att.vi (n); // m is maximum attack duration in seconds
-    for (h = 0; h < N_HARM; h++)
+    p = _p_p;
+    r = _p_r;
+
+    if (_sdel & 1)
     {
-	t = D->_h_att.vi (h, n);
-        if (t > m) m = t;
+	if (! p) 
+	{
+            if (r && _i_p)
+	    {
+                _dstream->close (_s_p);
+                r = 0;
+	    }
+	    p = _p0.get();
+            // Without a free stream, the attack goes to the loop
+            // when its resident part ends.
+            _i_p = S->_n_a;
+            if (_i_p && ((_s_p = _dstream->open (S->_path.c_str (), S->_o_a, _i_p, S->_gain)) < 0)) _i_p = 0;
+        }
+    }
+    else if (! r && p)
+    {
+        r = p;
+        p = 0;
+        _g_r = 1.0f;
+        _i_r = _k_r;     
+        if (S->_l_t)
+	{
+            if (_s_t >= 0) _dstream->close (_s_t);
+            _s_t = -1;
+            _i_t = S->_l_t;
+            if (S->_n_t && ((_s_t = _dstream->open (S->_path.c_str (), S->_o_t, S->_n_t, S->_gain)) >= 0)) _i_t += S->_n_t;
+	}
     }
-    _l0 = (int)(fsamp * m + 0.5); // _l0 is maximum attack duration in samples
-    _l0 = (_l0 + PERIOD - 1) & ~(PERIOD - 1); // rounded up to an integer number of PERIODs (if PERIOD is a power of 2)
 
-    f1 = (fpipe + D->_n_off.vi (n) + D->_n_ran.vi (n) * (2 * _rgen.urand () - 1)) / fsamp; // f1 is effective pipe frequency in terms of sampling rate
+    if (r)
+    {
+        q = _out; 
+	g = _g_r;
+        i = _i_r - 1;
+        if (g < _g_min) i = 0;  // final period, fade out
+        dg = g / PERIOD;  
+        if (i) dg *= _m_r ;
+        // The stream belongs to the release if there is no new attack.
+        r = sustain (r, d, ! p);
+        for (k = 0; k < PERIOD; k++)
+	{
+            q [k] += g * d [k];
+            g -= dg;
+	}
+        if (i) 
+	{
+	    _g_r = g;
+            _i_r = i;
+	}
+        else
+	{
+            r = 0;
+            if (_i_p && ! p)
+	    {
+                _dstream->close (_s_p);
+                _i_p = 0;
+	    }
+	}
+    }	
+
+    if (p) 
+    { 
+        q = _out;
+        if ((p < _p1) || _i_p)
+	{
+            p = sustain (p, d, true);
+            for (k = 0; k < PERIOD; k++) q [k] += d [k];
+	}
+        else p = play_steady (p, q);
+    }
+
+    if (_i_t)
+    {
+        q = _out;
+        n = PERIOD;
+        k = S->_l_t + ((_s_t >= 0) ? S->_n_t : 0) - _i_t;
+        for (; n && (k < S->_l_t); n--, k++, _i_t--) *q++ += S->_tail [k];
+        if (n && _i_t)
+	{
+            if (n > _i_t) n = _i_t;
+            _dstream->read (_s_t, d, n);
+            for (k = 0; k < n; k++) q [k] += d [k];
+            _i_t -= n;
+	}
+        if (! _i_t && (_s_t >= 0))
+	{
+            _dstream->close (_s_t);
+            _s_t = -1;
+	}
+    }
+
+    _p_p = p;
+    _p_r = r;
+}               
+
+
+// Write the next PERIOD samples of the attack and loop of a sampled
+// pipe, starting at p, to d. Returns the new play pointer. While the
+// streamed part of the attack plays, p stays at the loop start. If
+// not strm, the attack stream is used by another pointer and is
+// skipped.
+//
+float *Pipewave::sustain (float *p, float *d, bool strm)
+{
+    int  k, n;
+
+    if (p < _p1)
+    {
+        // The resident attack is a multiple of PERIOD.
+        std::copy_n (p, PERIOD, d);
+        return p + PERIOD;
+    }
+    n = PERIOD;
+    if (strm && _i_p)
+    {
+        k = (n < _i_p) ? n : _i_p;
+        _dstream->read (_s_p, d, k);
+        _i_p -= k;
+        if (! _i_p) _dstream->close (_s_p);
+        d += k;
+        n -= k;
+    }
+    while (n--)
+    {
+        *d++ = *p++;
+        if (p == _p2) p = _p1;
+    }
+    return p;
+}
+
+
+// Play PERIOD samples from the loop without modulation, as a strided
+// copy in runs up to the loop end.
+//
+float *Pipewave::play_steady (float *p, float *q)
+{
+    int  i, k, n;
+
+    for (k = PERIOD; k; k -= n)
+    {
+        n = (int)((_p2 - p + _k_s - 1) / _k_s);
+        if (n > k) n = k;
+        if (_k_s == 1)
+	{
+            for (i = 0; i < n; i++) q [i] += p [i];
+	}
+        else
+	{
+            for (i = 0; i < n; i++) q [i] += p [i * _k_s];
+	}
+        q += n;
+        p += n * _k_s;
+        if (p >= _p2) p -= _l1;
+    }
+    return p;
+}
+
+
+// Cubic Hermite interpolation between p [1] and p [2], at fraction t.
+// Only samples ahead of p are used, so a decimated table is read with
+// a constant delay of one table sample, and needs no data before the
+// attack or the loop start.
+//
+static inline float hermite (const float *p, float t)
+{
+    float c1, c2, c3;
+
+    c1 = 0.5f * (p [2] - p [0]);
+    c2 = p [0] - 2.5f * p [1] + 2.0f * p [2] - 0.5f * p [3];
+    c3 = 0.5f * (p [3] - p [0]) + 1.5f * (p [1] - p [2]);
+    return ((c3 * t + c2) * t + c1) * t + p [1];
+}
+
+
+// Play PERIOD samples from a decimated table, starting at p with
+// fractional position *y, which advances by 1 / _k_d + dy for each
+// sample. If pg is not zero a gain starting at *pg and decreasing by
+// dg for each sample is applied. Returns the new play pointer.
+//
+float *Pipewave::play_herm (float *p, float *q, float *y, float dy, float *pg, float dg)
+{
+    int    k;
+    float  g, v;
+
+    v = *y;
+    dy += 1.0f / _k_d;
+    if (pg)
+    {
+        g = *pg;
+        for (k = 0; k < PERIOD; k++)
+	{
+            q [k] += g * hermite (p, v);
+            g -= dg;
+            v += dy;
+            if (v >= 1.0f)
+	    {
+                v -= 1.0f;
+                if (++p >= _p2) p -= _l1;
+	    }
+	}
+        *pg = g;
+    }
+    else
+    {
+        for (k = 0; k < PERIOD; k++)
+	{
+            q [k] += hermite (p, v);
+            v += dy;
+            if (v >= 1.0f)
+	    {
+                v -= 1.0f;
+                if (++p >= _p2) p -= _l1;
+	    }
+	}
+    }
+    *y = v;
+    return p;
+}
+
+
+// Play PERIOD samples from a decimated table, without modulation.
+// The _k_d fractions are the same for each table sample, so this is
+// a polyphase filter with fixed weights. Used for the attack as well,
+// which ends at a period boundary.
+//
+float *Pipewave::play_deci (float *p, float *q)
+{
+    int    i, j;
+    float  t, w [4][4];
+
+    for (j = 0; j < _k_d; j++)
+    {
+        t = (float) j / _k_d;
+        w [j][0] = 0.5f * t * ((2.0f - t) * t - 1.0f);
+        w [j][1] = 0.5f * ((3.0f * t - 5.0f) * t * t + 2.0f);
+        w [j][2] = 0.5f * t * ((4.0f - 3.0f * t) * t + 1.0f);
+        w [j][3] = 0.5f * (t - 1.0f) * t * t;
+    }
+    if (_k_d == 2)
+    {
+        for (i = 0; i < PERIOD / 2; i++)
+	{
+            q [0] += w [0][0] * p [0] + w [0][1] * p [1] + w [0][2] * p [2] + w [0][3] * p [3];
+            q [1] += w [1][0] * p [0] + w [1][1] * p [1] + w [1][2] * p [2] + w [1][3] * p [3];
+            q += 2;
+            if (++p >= _p2) p -= _l1;
+	}
+        return p;
+    }
+    for (i = 0; i < PERIOD / _k_d; i++)
+    {
+        for (j = 0; j < _k_d; j++)
+	{
+            q [j] += w [j][0] * p [0] + w [j][1] * p [1] + w [j][2] * p [2] + w [j][3] * p [3];
+	}
+        q += _k_d;
+        if (++p >= _p2) p -= _l1;
+    }
+    return p;
+}
+
+
+void Pipewave::genwave (Addsynth *D, int n, float fsamp, float fpipe)
+{
+    int    h, i, k, nc;
+    float  f0, f1, f, fm, fs, m, t, v, v0;
+
+    f1 = (fpipe + D->_n_off.vi (n) + D->_n_ran.vi (n) * (2 * urandf () - 1)) / fsamp; // f1 is effective pipe frequency in terms of sampling rate
     f0 = f1 * exp2ap (D->_n_atd.vi (n) / 1200.0f); // f0 is detuned pipe frequency during attack
 
     for (h = N_HARM - 1; h >= 0; h--)
     {
         f = (h + 1) * f1;
-	if ((f < 0.45f) && (D->_h_lev.vi (h, n) >= -40.0f)) break;
+	if ((f < _f_max) && (D->_h_lev.vi (h, n) >= -40.0f)) break;
     }
     // f is frequency of highest relevant harmonics in terms of sampling rate
     if      (f > 0.250f) _k_s = 3; // choose sample step according to required
     else if (f > 0.125f) _k_s = 2; // temporal resolution
     else                 _k_s = 1;
+    // If decimation is enabled and the highest relevant harmonic is
+    // below DEC_FREL of fsamp / _k_d, the table is stored at that rate
+    // and played with cubic interpolation. The interpolation error is
+    // then below -40 dB for that harmonic, and less for lower ones.
+    // Weaker harmonics are kept up to DEC_FMAX of the table rate.
+    for (_k_d = _d_max; (_k_d > 1) && (f * _k_d > DEC_FREL); _k_d >>= 1);
+    fs = fsamp / _k_d; // fs is the table sample rate
+    fm = _f_max;
+    if (_k_d > 1)
+    {
+        _k_s = 1;
+        f0 *= _k_d;
+        f1 *= _k_d;
+        fm = std::min (_f_max * _k_d, DEC_FMAX);
+    }
+
+    m = D->_n_att.vi (n); // m is maximum attack duration in seconds
+    for (h = 0; h < N_HARM; h++)
+    {
+	t = D->_h_att.vi (h, n);
+        if (t > m) m = t;
+    }
+    _l0 = (int)(fs * m + 0.5); // _l0 is maximum attack duration in samples
+    k = PERIOD / _k_d;
+    _l0 = (_l0 + k - 1) & ~(k - 1); // rounded up to an integer number of PERIODs (if PERIOD is a power of 2)
+
     // _l1 is loop length in samples, computed by an intractable procedure
     // inside looplen()
     // nc appears to be the number of cycles in the loop (see below)
-    looplen (f1 * fsamp, _k_s * fsamp, (int)(fsamp / 6.0f), &_l1, &nc);
+    looplen (f1 * fs, _k_s * fs, (int)(fs / 6.0f), &_l1, &nc);
     // round up _l1 to the nearest multiple of (_k_s * PERIOD)
     if (_l1 < _k_s * PERIOD)
     {
@@ -210,10 +560,12 @@ void Pipewave::genwave (Addsynth *D, int n, float fsamp, float fpipe)
         _l1 *= k;
         nc *= k;
     }
+    _n_c = nc;
 
     // k is the number of samples to allocate
     k = _l0 + _l1 + _k_s * (PERIOD + 4);       
 
+    unlock ();
     _p0 = std::make_unique <float []> (k);
     _p1 = _p0.get () + _l0; // begin of loop
     _p2 = _p1 + _l1; // end of loop
@@ -224,7 +576,7 @@ void Pipewave::genwave (Addsynth *D, int n, float fsamp, float fpipe)
     // _m_r is multiplier to apply for each PERIOD
     _m_r = 1.0f - powf (0.1, 1.0 / _k_r);
     // _d_r is release detune scaled to _k_s
-    _d_r = _k_s * (exp2ap (D->_n_dcd.vi (n) / 1200.0f) - 1.0f);
+    _d_r = _k_s * (exp2ap (D->_n_dcd.vi (n) / 1200.0f) - 1.0f) / _k_d;
 
     v = D->_n_ins.vi (n);
     _d_a = v * fsamp / 960e3;
@@ -236,7 +588,7 @@ void Pipewave::genwave (Addsynth *D, int n, float fsamp, float fpipe)
     // during attack, interpolate between detuned and nominal
     // frequency such that nominal frequency is reached at the
     // pipe's attack duration
-    k = (int)(fsamp * D->_n_att.vi (n) + 0.5);
+    k = (int)(fs * D->_n_att.vi (n) + 0.5);
     for (i = 0; i <= _l0; i++)
     {
         _arg [i] = t - floorf (t + 0.5);
@@ -255,15 +607,18 @@ void Pipewave::genwave (Addsynth *D, int n, float fsamp, float fpipe)
     v0 = exp2ap (0.1661 * D->_n_vol.vi (n));
     for (h = 0; h < N_HARM; h++)
     {
-        // abort when harmonic frequency approaches Nyquist frequency
-        if ((h + 1) * f1 > 0.45) break;
+        // abort when harmonic frequency approaches Nyquist frequency,
+        // or the lower limit set by the quality profile. That limit
+        // does not apply to the fundamental, so that high pipes still
+        // sound, only without their upper partials.
+        if ((h + 1) * f1 > (h ? fm : 0.5f)) break;
         // here, v is the harmonic's level in dB
         v = D->_h_lev.vi (h, n);          
         if (v < -80.0) continue;
         // here, v is the harmonic's final amplitude after applying random variation
-        v = v0 * exp2ap (0.1661 * (v + D->_h_ran.vi (h, n) * (2 * _rgen.urand () - 1)));
+        v = v0 * exp2ap (0.1661 * (v + D->_h_ran.vi (h, n) * (2 * urandf () - 1)));
         // k is the harmonic's attack duration in samples
-        k = (int)(fsamp * D->_h_att.vi (h, n) + 0.5);
+        k = (int)(fs * D->_h_att.vi (h, n) + 0.5);
         // attgain() computes the harmonic's attack gain over
         // the attack period and stores it in the _att array
         attgain (k, D->_h_atp.vi (h, n));            
@@ -282,6 +637,149 @@ void Pipewave::genwave (Addsynth *D, int n, float fsamp, float fpipe)
 }
 
 
+// Make this pipe the sum of the k pipes P, which must have the same
+// sample step, decimation and loop length. The loop starts after the
+// longest attack, and each pipe's loop is continued up to there, so
+// the sum is exact. The attack is played one sample per frame and the
+// loop _k_s samples per frame, so table positions are mapped by the
+// time they are played at. Decimated tables have _k_s = 1, and both
+// parts advance one sample per _k_d frames. The release is that of
+// the pipe with the longest one, and the instability is the mean of
+// all.
+//
+void Pipewave::merge (Pipewave **P, int k)
+{
+    int    i, j, l, m, n, t;
+    float  *p, *q;
+
+    _k_s = P [0]->_k_s;
+    _k_d = P [0]->_k_d;
+    _l1 = P [0]->_l1;
+    _n_c = 0;
+    _l0 = 0;
+    _d_a = 0.0f;
+    _d_w = 0.0f;
+    for (i = j = 0; i < k; i++)
+    {
+        if (P [i]->_l0 > _l0) _l0 = P [i]->_l0;
+        if (P [i]->_k_r > P [j]->_k_r) j = i;
+        _d_a += P [i]->_d_a / k;
+        _d_w += P [i]->_d_w / k;
+    }
+    _k_r = P [j]->_k_r;
+    _m_r = P [j]->_m_r;
+    _d_r = P [j]->_d_r;
+    _r_s = P [0]->_r_s;
+
+    n = _l0 + _l1 + _k_s * (PERIOD + 4);
+    unlock ();
+    _p0 = std::make_unique <float []> (n);
+    _p1 = _p0.get () + _l0;
+    _p2 = _p1 + _l1;
+    std::fill_n (_p0.get (), n, 0);
+    for (i = 0, q = _p0.get (); i < k; i++)
+    {
+        p = P [i]->_p0.get ();
+        m = P [i]->_l0;
+        l = (_l0 - m) * _k_s;
+        for (t = 0; t < m; t++) q [t] += p [t];
+        for (; t < _l0; t++) q [t] += p [m + ((t - m) * _k_s) % _l1];
+        for (; t < n; t++) q [t] += p [m + (t - _l0 + l) % _l1];
+    }
+}
+
+
+// Make this a sampled pipe, played from the WAV file path which must
+// have the same sample rate and a loop in its 'smpl' chunk. The frames
+// after the loop are the release tail. Up to SMP_HEAD frames of the
+// attack, the loop, and up to SMP_TAIL frames of the release are kept
+// in memory, the rest is streamed. The level is set by the note volume
+// of the additive synthesis parameters. A resident attack is extended
+// to a multiple of PERIOD, with the loop rotated to match.
+//
+int Pipewave::sample (const char *path, Addsynth *D, int n, float fsamp)
+{
+    Wavfile  W;
+    int      a, b, i, k, m;
+    float    g;
+
+    if (W.open (path)) return 1;
+    if (W.rate () != (int) fsamp)
+    {
+        fprintf (stderr, "Sample '%s' has sample rate %d, need %d\n", path, W.rate (), (int) fsamp);
+        return 1;
+    }
+    if (W.loop0 () < 0)
+    {
+        fprintf (stderr, "Sample '%s' has no loop\n", path);
+        return 1;
+    }
+    if (strlen (path) >= DS_PATH)
+    {
+        fprintf (stderr, "Sample path '%s' is too long\n", path);
+        return 1;
+    }
+
+    auto S = std::make_unique <Smpdata> ();
+    a = W.loop0 ();
+    b = W.loop1 ();
+    g = exp2ap (0.1661 * D->_n_vol.vi (n));
+    S->_path = path;
+    S->_gain = g;
+    if (a > SMP_HEAD)
+    {
+        _l0 = SMP_HEAD;
+        S->_o_a = SMP_HEAD;
+        S->_n_a = a - SMP_HEAD;
+    }
+    else
+    {
+        _l0 = (a + PERIOD - 1) & ~(PERIOD - 1);
+        S->_o_a = 0;
+        S->_n_a = 0;
+    }
+    _l1 = b - a;
+    _k_s = 1;
+    _k_d = 1;
+    _n_c = 0;
+    k = _l0 + _l1 + PERIOD + 4;
+    std::unique_ptr <float []> L = std::make_unique <float []> (_l1);
+    unlock ();
+    _p0 = std::make_unique <float []> (k);
+    _p1 = _p0.get () + _l0;
+    _p2 = _p1 + _l1;
+    m = (a < _l0) ? a : _l0;
+    if ((W.read (_p0.get (), 0, m, g) != m) || (W.read (L.get (), a, _l1, g) != _l1))
+    {
+        fprintf (stderr, "Sample '%s' is truncated\n", path);
+        _p0.reset ();
+        return 1;
+    }
+    for (i = m; i < _l0; i++) _p0 [i] = L [(i - a) % _l1];
+    m = _l0 - m;
+    for (i = 0; i < _l1; i++) _p0 [_l0 + i] = L [(m + i) % _l1];
+    for (i = 0; i < PERIOD + 4; i++) _p0 [i + _l0 + _l1] = _p0 [i + _l0];
+
+    m = W.nfram () - b;
+    S->_l_t = (m < SMP_TAIL) ? m : SMP_TAIL;
+    S->_o_t = b + S->_l_t;
+    S->_n_t = m - S->_l_t;
+    if (S->_l_t)
+    {
+        S->_tail = std::make_unique <float []> (S->_l_t);
+        W.read (S->_tail.get (), b, S->_l_t, g);
+        _k_r = (int)(ceilf (SMP_FADE * fsamp / PERIOD) + 1);
+    }
+    else _k_r = (int)(ceilf (D->_n_dct.vi (n) * fsamp / PERIOD) + 1);
+    _m_r = 1.0f - powf (0.1, 1.0 / _k_r);
+    _d_r = 0.0f;
+    _d_a = 0.0f;
+    _d_w = 0.0f;
+    _smp = std::move (S);
+    return 0;
+}
+
+
 void Pipewave::looplen (float f, float fsamp, int lmax, int *aa, int *bb)
 {
     int     i, j, a, b, t;
@@ -352,6 +850,69 @@ void Pipewave::attgain (int n, float p)
 }
 
 
+void Pipewave::prefault (std::size_t *resid, std::size_t *locked)
+{
+    int            n;
+    long           page;
+    uintptr_t      a, b, c;
+    volatile float *p;
+    float          v;
+    unsigned char  r;
+
+    // Make sure the wavetable is in memory, so that the first
+    // note-on doesn't cause page faults in the audio thread.
+    // If the memory is not locked already by mlockall(), try
+    // to lock this table. Tables can share their first and last
+    // page with others, so pages are counted in _lpages, and only
+    // those not used yet by another table are locked and counted.
+
+    if (! _p0 || _locked) return;
+    page = sysconf (_SC_PAGESIZE);
+    n = _l0 + _l1 + _k_s * (PERIOD + 4);
+    a = (uintptr_t)(_p0.get ()) & ~(page - 1);
+    b = ((uintptr_t)(_p0.get () + n) + page - 1) & ~(page - 1);
+    madvise ((void *) a, b - a, MADV_WILLNEED);
+    v = 0;
+    for (p = _p0.get (); p < _p0.get () + n; p += page / sizeof (float)) v += *p;
+    (void) v;
+
+    std::lock_guard <std::mutex> lock (_lmutex);
+    for (c = a; c < b; c += page)
+    {
+        Lockpage &L = _lpages [c];
+        if (L._refs++) continue;
+        L._lock = ! mlock ((void *) c, page);
+        if (L._lock) *locked += page;
+        if (! mincore ((void *) c, page, &r) && (r & 1)) *resid += page;
+    }
+    _locked = b - a;
+}
+
+
+void Pipewave::unlock (void)
+{
+    long       page;
+    uintptr_t  a, c;
+
+    // Unlock the pages of this table that no other table uses.
+
+    if (_locked)
+    {
+        page = sysconf (_SC_PAGESIZE);
+        a = (uintptr_t)(_p0.get ()) & ~(page - 1);
+        std::lock_guard <std::mutex> lock (_lmutex);
+        for (c = a; c < a + _locked; c += page)
+        {
+            auto L = _lpages.find (c);
+            if ((L == _lpages.end ()) || --L->second._refs) continue;
+            if (L->second._lock) munlock ((void *) c, page);
+            _lpages.erase (L);
+	}
+        _locked = 0;
+    }
+}
+
+
 void Pipewave::save (FILE *F)
 {
     int  k;
@@ -370,7 +931,8 @@ void Pipewave::save (FILE *F)
     d.flt [4] = _d_r;
     d.flt [5] = _d_a;
     d.flt [6] = _d_w;
-    d.i32 [7] = 0;
+    d.i16 [14] = (_k_d > 1) ? _k_d : 0;
+    d.i16 [15] = _n_c;
     fwrite (&d, 1, 32, F);
     k = _l0 +_l1 + _k_s * (PERIOD + 4);
     if (k > 0)
@@ -378,9 +940,11 @@ void Pipewave::save (FILE *F)
 }
 
 
-void Pipewave::load (FILE *F)
+// Set the parameters from the 32 byte header that save () writes
+// before each table, and return the number of samples that follow.
+//
+int Pipewave::param (const void *data)
 {
-    int  k;
     union
     {
         int16_t i16 [16];
@@ -388,7 +952,7 @@ void Pipewave::load (FILE *F)
 	float   flt [8];
     } d;
 
-    fread (&d, 1, 32, F);
+    memcpy (&d, data, 32);
     _l0  = d.i32 [0];
     _l1  = d.i32 [1];
     _k_s = d.i16 [4];
@@ -397,7 +961,20 @@ void Pipewave::load (FILE *F)
     _d_r = d.flt [4];
     _d_a = d.flt [5];
     _d_w = d.flt [6];
-    k = _l0 +_l1 + _k_s * (PERIOD + 4);
+    _k_d = d.i16 [14] ? d.i16 [14] : 1;
+    _n_c = d.i16 [15];
+    return _l0 +_l1 + _k_s * (PERIOD + 4);
+}
+
+
+void Pipewave::load (FILE *F)
+{
+    int   k;
+    char  d [32];
+
+    fread (d, 1, 32, F);
+    k = param (d);
+    unlock ();
     _p0.reset();
     if (k > 0)
     {
@@ -409,14 +986,227 @@ void Pipewave::load (FILE *F)
 }
 
 
+// As above, but from memory, using the table where it is. Returns the
+// number of bytes used, or zero if there are not enough.
+//
+int Pipewave::load (const char *data, std::size_t size)
+{
+    int  k;
+
+    if (size < 32) return 0;
+    k = param (data);
+    if ((k < 0) || (size - 32 < k * sizeof (float))) return 0;
+    unlock ();
+    _p0.reset();
+    if (k > 0)
+    {
+      _p0 = std::unique_ptr <float [], Wavefree> ((float *)(data + 32), Wavefree (false));
+      _p1 = _p0.get() + _l0;
+      _p2 = _p1 + _l1;
+    }
+    return 32 + k * sizeof (float);
+}
 
 
-Rankwave::Rankwave (int n0, int n1) : _n0 (n0), _n1 (n1), _list (0), _modif (false)
+// Modified Bessel function I0, as power series.
+//
+static double bessel_i0 (double x)
+{
+    int     j;
+    double  s, t;
+
+    for (j = 1, s = t = 1.0; j < 40; j++)
+    {
+        t *= 0.25 * x * x / (j * j);
+        s += t;
+    }
+    return s;
+}
+
+
+// Kaiser windowed sinc, from 0 to RS_HLEN samples in steps
+// of 1 / RS_NPHS, with one extra point for interpolation.
+//
+void Pipewave::initresamp (void)
+{
+    int     i, n;
+    double  a, g, s, u;
+
+    n = RS_HLEN * RS_NPHS;
+    _rsk = std::make_unique <float []> (n + 2);
+    g = 1.0 / bessel_i0 (8.0);
+    for (i = 0; i < n; i++)
+    {
+        u = (double) i / RS_NPHS;
+        a = M_PI * u;
+        s = i ? sin (a) / a : 1.0;
+        u /= RS_HLEN;
+        _rsk [i] = s * g * bessel_i0 (8.0 * sqrt (1.0 - u * u));
+    }
+    _rsk [n] = _rsk [n + 1] = 0.0f;
+}
+
+
+// Polyphase filter, the resampling kernel scaled to s and tabulated
+// for RS_NPHS + 1 phases of 2 * _h taps. The kernel cuts at s / 2 of
+// the input rate. Values at fractional positions are interpolated
+// between the two nearest phases.
+//
+class Rsfilter
+{
+public:
+
+    Rsfilter (const float *K, double s);
+
+    int hlen (void) const { return _h; }
+    float value (const float *x, double t) const;
+
+private:
+
+    int                  _h;
+    std::vector <float>  _c;
+};
+
+
+Rsfilter::Rsfilter (const float *K, double s)
+{
+    int     i, j, k, n;
+    double  u;
+
+    _h = (int)(RS_HLEN / s) + 2;
+    n = 2 * _h;
+    _c.resize ((RS_NPHS + 1) * n);
+    for (i = 0; i <= RS_NPHS; i++)
+    {
+        for (j = 0; j < n; j++)
+	{
+            u = fabs (j - _h + 1 - (double) i / RS_NPHS) * s * RS_NPHS;
+            k = (int) u;
+            _c [i * n + j] = (k < RS_HLEN * RS_NPHS) ? s * (K [k] + (u - k) * (K [k + 1] - K [k])) : 0.0f;
+	}
+    }
+}
+
+
+// Value of x at t. Uses x [floor (t) - _h + 1] to x [floor (t) + _h].
+//
+float Rsfilter::value (const float *x, double t) const
+{
+    int          i, j, n;
+    float        a, s0, s1;
+    const float  *c0, *c1;
+
+    j = (int) floor (t);
+    a = (float)((t - j) * RS_NPHS);
+    i = (int) a;
+    a -= i;
+    n = 2 * _h;
+    c0 = _c.data () + i * n;
+    c1 = c0 + n;
+    x += j - _h + 1;
+    s0 = s1 = 0.0f;
+    for (i = 0; i < n; i++)
+    {
+        s0 += c0 [i] * x [i];
+        s1 += c1 [i] * x [i];
+    }
+    return s0 + a * (s1 - s0);
+}
+
+
+// Convert the table from sample rate fa to fb. The attack is
+// resampled at the ratio of the rates, and its length rounded up
+// as in genwave (). The loop has _n_c cycles of a periodic wave,
+// so it gets the loop length genwave () would choose at fb, and is
+// resampled to fit that exactly. The filter removes images when
+// upsampling. If the table has harmonics above half of fb, they
+// are removed as well, with the cutoff for the loop lowered by _k_s
+// as it is played _k_s samples per frame.
+//
+void Pipewave::resample (float fa, float fb)
+{
+    int     i, k, l0, l1, m, n, nc;
+    double  f, q, r, t;
+    float   fm, fs, *p;
+
+    fs = fb / _k_d;
+    r = (double) fa / fb;
+    k = PERIOD / _k_d;
+    l0 = ((int)(ceil (_l0 / r - 1e-6)) + k - 1) & ~(k - 1);
+    f = (double) _n_c * _k_s * fa / (_k_d * _l1);
+    looplen (f, _k_s * fs, (int)(fs / 6.0f), &l1, &nc);
+    if (l1 < _k_s * PERIOD)
+    {
+        k = (_k_s * PERIOD - 1) / l1 + 1;
+        l1 *= k;
+        nc *= k;
+    }
+    n = l0 + l1 + _k_s * (PERIOD + 4);
+    auto P = std::make_unique <float []> (n);
+    fm = (_k_d > 1) ? std::min (_f_max * _k_d, DEC_FMAX) : _f_max;
+    f = (fm * r > 0.5) ? 0.92 / r : 1.0;
+
+    // The attack, with the loop continued as it is played.
+    Rsfilter A (_rsk.get (), std::min (1.0, f));
+    m = A.hlen () + 1;
+    k = (int)(l0 * r) + m;
+    std::vector <float> X (k + m);
+    p = X.data () + m;
+    for (i = -m; i < k; i++)
+    {
+        if (i < 0) p [i] = 0.0f;
+        else if (i < _l0) p [i] = _p0 [i];
+        else p [i] = _p1 [((i - _l0) * _k_s) % _l1];
+    }
+    for (i = 0; i < l0; i++) P [i] = A.value (p, i * r);
+
+    // The loop, starting where the new attack ends.
+    Rsfilter L (_rsk.get (), std::min (1.0, f / _k_s));
+    t = fmod ((l0 * r - _l0) * _k_s, (double) _l1);
+    q = (double) _l1 * nc / ((double) _n_c * l1);
+    m = L.hlen () + 1;
+    k = (int)(t + l1 * q) + m;
+    X.resize (k + m);
+    p = X.data () + m;
+    for (i = -m; i < k; i++) p [i] = _p1 [(i % _l1 + _l1) % _l1];
+    for (i = 0; i < l1; i++) P [l0 + i] = L.value (p, t + i * q);
+    for (i = 0; i < _k_s * (PERIOD + 4); i++) P [l0 + l1 + i] = P [l0 + i];
+
+    unlock ();
+    _p0 = std::move (P);
+    _l0 = l0;
+    _l1 = l1;
+    _n_c = nc;
+    _p1 = _p0.get () + _l0;
+    _p2 = _p1 + _l1;
+
+    // Release length and instability scale with the rate.
+    _k_r = (int)(ceil ((_k_r - 1) / r)) + 1;
+    _m_r = 1.0f - powf (0.1, 1.0 / _k_r);
+    _d_a /= r;
+    _d_w *= r;
+}
+
+
+
+
+Rankwave::Rankwave (int n0, int n1) : _n0 (n0), _n1 (n1), _list (0), _modif (false), _users (0)
 {
     _pipes = std::make_unique <Pipewave []> (n1 - n0 + 1);
 }
 
 
+// This may run in the audio thread. The shared tables are unmapped
+// later by the slave thread (Tabstore::release ()), once the pipes
+// no longer use them.
+//
+Rankwave::~Rankwave (void)
+{
+    _pipes.reset ();
+    if (_users) _users->fetch_sub (1, std::memory_order_release);
+}
+
+
 #if REPETITION_POINTS
 namespace
 {
@@ -467,9 +1257,37 @@ std::forward_list <RepetitionPoint> ParseRepetitions(const char* s)
     
 
 
+// Each pipe has its own random generator, used for detuning
+// and harmonic levels in genwave() and for instability in play().
+// With a seed set, its state depends only on the seed, the stop
+// and the note, so output is reproducible.
+//
+void Rankwave::seed_pipes (Addsynth *D)
+{
+    int         n;
+    uint32_t    h;
+    const char  *p;
+    Pipewave    *P;
+
+    for (n = _n0, P = _pipes.get(); n <= _n1; n++, P++)
+    {
+        if (Pipewave::_seed)
+        {
+            // FNV-1a hash of seed, stop filename and note.
+            h = 2166136261u ^ Pipewave::_seed;
+            for (p = D->_filename; *p; p++) h = (h ^ (uint8_t)(*p)) * 16777619u;
+            h = (h ^ n) * 16777619u;
+            P->_r_s = h;
+        }
+        else P->_r_s = Pipewave::_rgen.irand ();
+    }
+}
+
+
 void Rankwave::gen_waves (Addsynth *D, float fsamp, float fbase, float *scale)
 {
     Pipewave::initstatic (fsamp);
+    seed_pipes (D);
 
 #if REPETITION_POINTS
     float fn = D->_fn, fd = D->_fd,
@@ -503,6 +1321,45 @@ void Rankwave::gen_waves (Addsynth *D, float fsamp, float fbase, float *scale)
 }
 
 
+// Make pipe n the sum of pipe n of the k ranks W.
+//
+void Rankwave::merge (int n, Rankwave **W, int k)
+{
+    int        i;
+    Pipewave  *P [NRANKS];
+
+    for (i = 0; i < k; i++) P [i] = &W [i]->_pipes [n - W [i]->_n0];
+    _pipes [n - _n0].merge (P, k);
+    _pipes [n - _n0]._skip = false;
+}
+
+
+// Replace the pipes for which a file path/<stop>/<note>.wav exists,
+// where <stop> is the name of the .ae0 file without extension and
+// <note> the three digit MIDI note number, by sampled pipes. Returns
+// the number of sampled pipes.
+//
+int Rankwave::load_samples (const char *path, Addsynth *D, float fsamp)
+{
+    int   i, k;
+    char  name [1024];
+    char  *p;
+
+    if (! Pipewave::_dstream) return 0;
+    sprintf (name, "%s/%s", path, D->_filename);
+    if ((p = strrchr (name, '.'))) *p = 0;
+    if (access (name, X_OK)) return 0;
+    p = name + strlen (name);
+    for (i = _n0, k = 0; i <= _n1; i++)
+    {
+        sprintf (p, "/%03d.wav", i);
+        if (access (name, R_OK)) continue;
+        if (! _pipes [i - _n0].sample (name, D, i - _n0, fsamp)) k++;
+    }
+    return k;
+}
+
+
 void Rankwave::set_param (float *out, int del, int pan)
 {
     int         n, a, b;
@@ -520,31 +1377,133 @@ void Rankwave::set_param (float *out, int del, int pan)
 }
 
 
+void Rankwave::prefault (std::size_t *resid, std::size_t *locked)
+{
+    int       n;
+    Pipewave  *P;
+
+    *resid = 0;
+    *locked = 0;
+    for (n = _n0, P = _pipes.get(); n <= _n1; n++, P++) P->prefault (resid, locked);
+}
+
+
 void Rankwave::play (int shift)
 {
+    int       n;
     Pipewave *P, *Q;
 
-    for (P = 0, Q = _list; Q; Q = Q->_link)
+    for (n = 0, P = 0, Q = _list; Q; Q = Q->_link)
     {
-	Q->play ();
+	if (Q->_smp) Q->play_smp ();
+	else Q->play ();
         if (shift) Q->_sdel = (Q->_sdel >> 1) | Q->_sbit;
-        if (Q->_sdel || Q->_p_p || Q->_p_r) P = Q;
+        if (Q->_sdel || Q->_p_p || Q->_p_r || Q->_i_t)
+	{
+	    P = Q;
+	    // Pipes in the last period of their release are not counted.
+	    if (Q->_sdel || Q->_p_p || (Q->_i_r > 1)) n++;
+	}
         else
 	{
   	    if (P) P->_link = Q->_link;
             else      _list = Q->_link;
 	}
     }
+    if (_vmax && (n > _vmax)) steal (n - _vmax);
+}
+
+
+// Make the n releasing pipes with the lowest release gain fade
+// out in the next period. Pipes that are on are never stolen.
+//
+void Rankwave::steal (int n)
+{
+    Pipewave *P, *Q;
+
+    while (n--)
+    {
+        for (P = 0, Q = _list; Q; Q = Q->_link)
+	{
+            if (Q->_p_r && ! Q->_p_p && ! (Q->_sdel & 1) && (Q->_i_r > 1) && (! P || (Q->_g_r < P->_g_r))) P = Q;
+	}
+        if (! P) return;
+        P->_i_r = 1;
+    }
+}
+
+
+void Rankwave::set_release_floor (float db)
+{
+    _gset = (db < 0) ? powf (10.0f, 0.05f * db) : 0.0f;
+    set_limits ();
+}
+
+
+void Rankwave::set_voice_limit (int n)
+{
+    _vset = n;
+    set_limits ();
+}
+
+
+// At reduced quality the voice limit and release floor are at
+// least as strict as RED_VMAX and RED_GMIN.
+//
+void Rankwave::set_reduced (bool on)
+{
+    _reduce = on;
+    set_limits ();
+}
+
+
+// Quality profiles. Lowering the harmonic limit below 0.25 and 0.125
+// of the sample rate avoids the larger sample steps, so tables are
+// shorter and play () reads fewer samples.
+//
+void Rankwave::set_profile (int prof)
+{
+    static const float fmax [NPROF] = { 0.45f, 0.25f, 0.125f };
+
+    Pipewave::_f_max = fmax [prof];
+}
+
+
+// Value stored in byte 6 of the .ae1 header, so tables made with a
+// different harmonic limit are not used. Zero for the full profile,
+// which is what older files contain.
+//
+int Rankwave::hcode (void)
+{
+    return (Pipewave::_f_max < 0.45f) ? (int)(256 * Pipewave::_f_max) : 0;
+}
+
+
+// Value stored in byte 7 of the .ae1 header, the maximum table
+// decimation, or zero without decimation as in older files.
+//
+int Rankwave::dcode (void)
+{
+    return (Pipewave::_d_max > 1) ? Pipewave::_d_max : 0;
+}
+
+
+void Rankwave::set_limits (void)
+{
+    _vmax = _vset;
+    Pipewave::_g_min = _gset;
+    if (_reduce)
+    {
+        if (! _vmax || (_vmax > RED_VMAX)) _vmax = RED_VMAX;
+        if (Pipewave::_g_min < RED_GMIN) Pipewave::_g_min = RED_GMIN;
+    }
 }
 
 
 int Rankwave::save (const char *path, Addsynth *D, float fsamp, float fbase, float *scale)
 {
     FILE      *F;
-    Pipewave  *P;
-    int        i;
     char       name [1024];
-    char       data [64];
     char      *p;
 
     sprintf (name, "%s/%s", path, D->_filename);
@@ -557,7 +1516,22 @@ int Rankwave::save (const char *path, Addsynth *D, float fsamp, float fbase, flo
 	fprintf (stderr, "Can't open waveform file '%s' for writing\n", name);
         return 1;
     }
-   
+    save (F, fsamp, fbase, scale);
+    fclose (F);
+
+    _modif = false;
+    return 0;
+}
+
+
+// Write the contents of a waveform file.
+//
+void Rankwave::save (FILE *F, float fsamp, float fbase, float *scale)
+{
+    Pipewave  *P;
+    int        i;
+    char       data [64];
+
     std::fill_n (data, 16, 0);
     strcpy (data, "ae1");
     data [4] = 2;
@@ -570,19 +1544,35 @@ int Rankwave::save (const char *path, Addsynth *D, float fsamp, float fbase, flo
     data [3] = 0;
     data [4] = _n0;
     data [5] = _n1;
-    data [6] = 0;
-    data [7] = 0;
+    data [6] = hcode ();
+    data [7] = dcode ();
     *((float *)(data +  8)) = fsamp;
     *((float *)(data + 12)) = fbase;
     std::copy_n (scale, 12, reinterpret_cast<float *>(data + 16));
     fwrite (data, 1, 64, F);
 
     for (i = _n0, P = _pipes.get(); i <= _n1; i++, P++) P->save (F);
+}
 
-    fclose (F);
 
-    _modif = false;
-    return 0;
+// Key of the shared wavetable store (Tabstore). Ranks with equal keys
+// have interchangeable tables: it covers the synthesis parameters of
+// the stop, the tuning, the table format and the random seed.
+//
+uint64_t Rankwave::tabkey (Addsynth *D, float fsamp, float fbase, float *scale)
+{
+    uint64_t  h;
+    int32_t   v [3];
+
+    h = hash64 (VERSION, strlen (VERSION));
+    h = hash64 (D->_filename, strlen (D->_filename), h);
+    h = hash64 ((const char *) &D->_n0, (const char *) &D->_pan - (const char *) &D->_n0, h);
+    h = hash64 ((const char *) scale, 12 * sizeof (float), h);
+    v [0] = (int32_t)(fsamp + 0.5f);
+    v [1] = 256 * hcode () + dcode ();
+    v [2] = Pipewave::_seed;
+    h = hash64 ((const char *) v, sizeof (v), h);
+    return hash64 ((const char *) &fbase, sizeof (float), h);
 }
 
 
@@ -592,9 +1582,9 @@ int Rankwave::load (const char *path, Addsynth *D, float fsamp, float fbase, flo
     Pipewave  *P;
     int        i;
     char       name [1024];
-    char       data [64];
+    char       data [80];
     char      *p;
-    float      f;
+    float      fa;
 
     sprintf (name, "%s/%s", path, D->_filename);
     if ((p = strrchr (name, '.'))) strcpy (p, ".ae1"); 
@@ -609,13 +1599,86 @@ int Rankwave::load (const char *path, Addsynth *D, float fsamp, float fbase, flo
         return 1;
     }
 
-    fread (data, 1, 16, F);
+    if ((fread (data, 1, 80, F) != 80) || check (name, data, fbase, scale))
+    {
+        fclose (F);
+        return 1;
+    }
+    fa = *((float *)(data + 24));
+
+    for (i = _n0, P = _pipes.get(); i <= _n1; i++, P++) P->load (F);
+    fclose (F);
+
+    // Tables made at another sample rate are converted, if they
+    // have the loop data needed for that. The file keeps its rate.
+    if ((fabsf (fa - fsamp) > 0.1f) && resample (fa, fsamp))
+    {
+#ifdef DEBUG
+	fprintf (stderr, "File '%s' has a different sample frequency (%3.1lf)\n", name, fa);
+#endif
+        return 1;
+    }
+    seed_pipes (D);
+
+    _modif = false;
+    return 0;
+}
+
+
+// Load from the contents of a waveform file in memory, normally a
+// member of a mapped bundle. The tables are used in place, so the
+// data must remain valid as long as they are not regenerated.
+//
+int Rankwave::load (const char *name, const char *data, std::size_t size, Addsynth *D, float fsamp, float fbase, float *scale)
+{
+    Pipewave     *P;
+    int          i;
+    std::size_t  k, n;
+    float        fa;
+
+    if ((size < 80) || check (name, data, fbase, scale)) return 1;
+    fa = *((float *)(data + 24));
+
+    for (i = _n0, P = _pipes.get(), k = 80; i <= _n1; i++, P++)
+    {
+        if (! (n = P->load (data + k, size - k)))
+	{
+#ifdef DEBUG
+	    fprintf (stderr, "File '%s' is truncated\n", name);
+#endif
+            return 1;
+	}
+        k += n;
+    }
+
+    if ((fabsf (fa - fsamp) > 0.1f) && resample (fa, fsamp))
+    {
+#ifdef DEBUG
+	fprintf (stderr, "File '%s' has a different sample frequency (%3.1lf)\n", name, fa);
+#endif
+        return 1;
+    }
+    seed_pipes (D);
+
+    _modif = false;
+    return 0;
+}
+
+
+// Check the 16 + 64 byte header of a waveform file against this rank
+// and the current tuning and temperament.
+//
+int Rankwave::check (const char *name, const char *data, float fbase, float *scale)
+{
+    int    i;
+    float  f;
+
+    (void) name; // only used with DEBUG
     if (strcmp (data, "ae1"))
     {
 #ifdef DEBUG
 	fprintf (stderr, "File '%s' is not an Aeolus waveform file\n", name);
 #endif
-        fclose (F);
         return 1;
     }
 
@@ -624,27 +1687,31 @@ int Rankwave::load (const char *path, Addsynth *D, float fsamp, float fbase, flo
 #ifdef DEBUG
 	fprintf (stderr, "File '%s' has an incompatible version tag (%d)\n", name, data [4]);
 #endif
-        fclose (F);
         return 1;
     }
 
-    fread (data, 1, 64, F);
+    data += 16;
     if (_n0 != data [4] || _n1 != data [5])
     {
 #ifdef DEBUG
 	fprintf (stderr, "File '%s' has an incompatible note range (%d %d), (%d %d)\n", name, _n0, _n1, data [4], data [5]);
 #endif
-        fclose (F);
         return 1;
     }
 
-    f = *((float *)(data + 8));
-    if (fabsf (f - fsamp) > 0.1f)
+    if (data [6] != hcode ())
     {
 #ifdef DEBUG
-	fprintf (stderr, "File '%s' has a different sample frequency (%3.1lf)\n", name, f);
+	fprintf (stderr, "File '%s' has a different harmonic limit (%d)\n", name, data [6]);
+#endif
+        return 1;
+    }
+
+    if (data [7] != dcode ())
+    {
+#ifdef DEBUG
+	fprintf (stderr, "File '%s' has a different table decimation (%d)\n", name, data [7]);
 #endif
-        fclose (F);
         return 1;
     }
 
@@ -654,7 +1721,6 @@ int Rankwave::load (const char *path, Addsynth *D, float fsamp, float fbase, flo
 #ifdef DEBUG
 	fprintf (stderr, "File '%s' has a different tuning (%3.1lf)\n", name, f);
 #endif
-        fclose (F);
         return 1;
     }
 
@@ -666,15 +1732,40 @@ int Rankwave::load (const char *path, Addsynth *D, float fsamp, float fbase, flo
 #ifdef DEBUG
 	    fprintf (stderr, "File '%s' has a different temperament\n", name);
 #endif
-            fclose (F);
             return 1;
         }
     }
+    return 0;
+}
 
-    for (i = _n0, P = _pipes.get(); i <= _n1; i++, P++) P->load (F);
-  
-    fclose (F);
 
-    _modif = false;
+// Convert all tables from sample rate fa to fb, on as many threads
+// as there are processors. Returns non-zero if a table does not have
+// the number of cycles in its loop, which older files don't store.
+//
+int Rankwave::resample (float fa, float fb)
+{
+    int   i, n;
+    std::atomic <int> next (0);
+    std::vector <std::thread> T;
+
+    n = _n1 - _n0 + 1;
+    for (i = 0; i < n; i++)
+    {
+        if (_pipes [i]._p0 && ! _pipes [i]._n_c) return 1;
+    }
+    if (! Pipewave::_rsk) Pipewave::initresamp ();
+
+    auto work = [this, fa, fb, n, &next]
+    {
+        int k;
+        while ((k = next++) < n)
+	{
+            if (_pipes [k]._p0) _pipes [k].resample (fa, fb);
+	}
+    };
+    for (i = std::thread::hardware_concurrency (); i > 1; i--) T.emplace_back (work);
+    work ();
+    for (auto &t : T) t.join ();
     return 0;
 }
@@ -22,46 +22,141 @@
 #define __RANKWAVE_H
 
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
 #include "addsynth.h"
 #include "rngen.h"
 
 
 #define PERIOD 64
 
+#define DEC_FREL 0.125f // highest relevant harmonic of a decimated table, relative to its rate
+#define DEC_FMAX 0.25f  // highest harmonic of a decimated table, relative to its rate
+
+#define RS_HLEN 32      // half length of the table resampling filter, at the lower rate
+#define RS_NPHS 256     // resampling filter phases per sample
+
+#define SMP_HEAD 16384  // resident attack of a sampled pipe, a multiple of PERIOD
+#define SMP_TAIL 8192   // resident release tail of a sampled pipe
+#define SMP_FADE 0.02f  // loop fade time when the release tail is sampled
+
+
+class Diskstream;
+
+
+// The parts of a sampled pipe that are streamed from its file. The
+// attack continues for _n_a frames from _o_a before the loop starts.
+// The release tail has _l_t frames in memory, and continues for _n_t
+// frames from _o_t.
+//
+class Smpdata
+{
+private:
+
+    friend class Pipewave;
+
+    std::string  _path;
+    float        _gain;
+    long         _o_a;
+    int32_t      _n_a;
+    long         _o_t;
+    int32_t      _n_t;
+    int32_t      _l_t;
+    std::unique_ptr <float []> _tail;
+};
+
+
+// Deletes a wavetable unless it is part of a mapped bundle, which
+// then owns it. Tables allocated with std::make_unique convert to this.
+//
+class Wavefree
+{
+public:
+
+    Wavefree (void) : _own (true) {}
+    Wavefree (std::default_delete <float []>) : _own (true) {}
+    explicit Wavefree (bool own) : _own (own) {}
+
+    void operator() (float *p) const { if (_own) delete [] p; }
+
+private:
+
+    bool  _own;
+};
+
 
 class Pipewave
 {
 private:
 
     Pipewave () :
-        _p1 (0), _p2 (0), _l0 (0), _l1 (0),
-        _k_s (0),  _k_r (0), 
+        _p1 (0), _p2 (0), _l0 (0), _l1 (0), _locked (0),
+        _k_s (0),  _k_d (1), _k_r (0), _n_c (0),
         _m_r (0), _d_r (0), _d_a (0), _d_w (0),
-	_link (0), _sbit (0), _sdel (0), 
-        _p_p (0), _p_f(0), _y_p (0), _z_p (0), _p_r (0), _y_r (0), _g_r (0), _i_r (0)
+	_link (0), _sbit (0), _sdel (0), _skip (false),
+        _p_p (0), _p_f(0), _y_p (0), _z_p (0), _p_r (0), _y_r (0), _g_r (0), _i_r (0), _r_s (0),
+        _i_p (0), _i_t (0), _s_p (-1), _s_t (-1)
     {}     
 
     friend class Rankwave;
+    friend class Bench;
     friend std::unique_ptr <Pipewave> std::make_unique <Pipewave> ();
     friend std::unique_ptr <Pipewave []> std::make_unique <Pipewave []> (std::size_t);
 
+public:
+
+    ~Pipewave ();
+
+private:
+
     void genwave (Addsynth *D, int n, float fsamp, float fpipe);
+    void merge (Pipewave **P, int k);
+    int  sample (const char *path, Addsynth *D, int n, float fsamp);
     void save (FILE *F);
     void load (FILE *F);
+    int  load (const char *data, std::size_t size);
+    int  param (const void *data);
+    void resample (float fa, float fb);
     void play (void);
+    void play_smp (void);
+    float *sustain (float *p, float *d, bool strm);
+    float *play_steady (float *p, float *q);
+    float *play_herm (float *p, float *q, float *y, float dy, float *pg, float dg);
+    float *play_deci (float *p, float *q);
+    void prefault (std::size_t *resid, std::size_t *locked);
+    void unlock (void);
+
+    float urandf (void)
+    {
+        _r_s = 1664525 * _r_s + 1013904223;
+        return _r_s / 4294967296.0f;
+    }
 
     static void looplen (float f, float fsamp, int lmax, int *aa, int *bb);
     static void attgain (int n, float p);
+    static void initresamp (void);
+
+    struct Lockpage
+    {
+        int   _refs;  // number of tables using the page
+        bool  _lock;  // page locked by prefault()
+    };
 
-    std::unique_ptr <float []> _p0;    // attack start
+    std::unique_ptr <float [], Wavefree> _p0; // attack start
     float     *_p1;    // loop start
     float     *_p2;    // loop end
     int32_t    _l0;    // attack length
     int32_t    _l1;    // loop length
+    std::size_t _locked; // number of bytes counted in _lpages by prefault()
     int16_t    _k_s;   // sample step
+    int16_t    _k_d;   // table decimation, 1, 2 or 4
     int16_t    _k_r;   // release lenght
+    int16_t    _n_c;   // number of cycles in the loop, 0 if not known
     float      _m_r;   // release multiplier
     float      _d_r;   // release detune
     float      _d_a;   // instability amplitude
@@ -70,6 +165,7 @@ private:
     Pipewave  *_link;  // link to next in active chain
     uint32_t   _sbit;  // on state bit  
     uint32_t   _sdel;  // delayed state
+    bool       _skip;  // note on is ignored
     float     *_out;   // audio output buffer
     float     *_p_p;   // play pointer
     float      _p_f;   // play pointer fraction
@@ -79,13 +175,27 @@ private:
     float      _y_r;   // release interpolation
     float      _g_r;   // release gain  
     int16_t    _i_r;   // release count
+    uint32_t   _r_s;   // random generator state
+    std::unique_ptr <Smpdata> _smp; // streamed parts of a sampled pipe
+    int32_t    _i_p;   // attack frames left to stream
+    int32_t    _i_t;   // release tail frames left
+    int16_t    _s_p;   // attack stream
+    int16_t    _s_t;   // release tail stream
 
 
     static void initstatic (float fsamp);
 
+    static   uint32_t _seed;  // if not zero, all random values are derived from this
+    static   float    _g_min; // release gain at which a release ends early
+    static   float    _f_max; // highest harmonic frequency, relative to fsamp
+    static   int      _d_max; // maximum table decimation
     static   Rngen   _rgen;
+    static   Diskstream *_dstream;
     static   std::unique_ptr <float []> _arg; // time parameter during waveform generation
     static   std::unique_ptr <float []> _att; // harmonic's attack gain time series
+    static   std::unique_ptr <float []> _rsk; // table resampling filter
+    static   std::mutex _lmutex;
+    static   std::map <uintptr_t, Lockpage> _lpages; // pages used by prefaulted tables
 };
 
 
@@ -94,13 +204,15 @@ class Rankwave
 public:
 
     Rankwave (int n0, int n1);
+    ~Rankwave (void);
 
     void note_on (int n)
     {
         if ((n < _n0) || (n > _n1)) return;
         Pipewave *P = &_pipes [n - _n0];
+        if (P->_skip) return;
         P->_sbit = _sbit;   
-        if (! (P->_sdel || P->_p_p || P->_p_r))
+        if (! (P->_sdel || P->_p_p || P->_p_r || P->_i_t))
         {
 	    P->_sdel |= _sbit;
             P->_link = _list;
@@ -122,28 +234,75 @@ public:
         for (P = _list; P; P = P->_link) P->_sbit = 0;
     }        
 
+    void set_skip (int n, bool s) { _pipes [n - _n0]._skip = s; }
+
+    // Pipes with equal keys have the same sample step, decimation
+    // and loop length, and can be merged. Returns -1 if there is no
+    // pipe or if it is sampled.
+    int loopkey (int n) const
+    {
+        if ((n < _n0) || (n > _n1)) return -1;
+        const Pipewave *P = &_pipes [n - _n0];
+        return (P->_p0 && ! P->_smp) ? 8 * (4 * P->_l1 + P->_k_s) + P->_k_d : -1;
+    }
+
     int  n0 (void) const { return _n0; }
     int  n1 (void) const { return _n1; }
     void play (int shift);
+    bool active (void) const { return _list != 0; }
     void set_param (float *out, int del, int pan);
     void gen_waves (Addsynth *D, float fsamp, float fbase, float *scale);
+    void merge (int n, Rankwave **W, int k);
+    int  load_samples (const char *path, Addsynth *D, float fsamp);
+    void prefault (std::size_t *resid, std::size_t *locked);
     int  save (const char *path, Addsynth *D, float fsamp, float fbase, float *scale);
+    void save (FILE *F, float fsamp, float fbase, float *scale);
     int  load (const char *path, Addsynth *D, float fsamp, float fbase, float *scale);
+    int  load (const char *name, const char *data, std::size_t size, Addsynth *D, float fsamp, float fbase, float *scale);
     bool modif (void) const { return _modif; }
+    void set_modif (bool m) { _modif = m; }
+    void set_users (std::atomic <int> *users) { _users = users; }
+
+    static uint64_t tabkey (Addsynth *D, float fsamp, float fbase, float *scale);
+
+    static void set_seed (uint32_t seed) { Pipewave::_seed = seed; }
+    static void set_stream (Diskstream *S) { Pipewave::_dstream = S; }
+    static void set_release_floor (float db);
+    static void set_voice_limit (int n);
+    static void set_reduced (bool on);
+    static void set_profile (int prof);
+    static void set_decimate (bool on) { Pipewave::_d_max = on ? 4 : 1; }
 
     int  _nmask;  // used by division logic
 
 private:
 
+    friend class Bench;
+
     Rankwave (const Rankwave&);
     Rankwave& operator=(const Rankwave&);
 
+    void seed_pipes (Addsynth *D);
+    int  check (const char *name, const char *data, float fbase, float *scale);
+    void steal (int n);
+    int  resample (float fa, float fb);
+
     int         _n0;
     int         _n1;
     uint32_t    _sbit;
     Pipewave   *_list;
     std::unique_ptr <Pipewave []> _pipes;
     bool        _modif;
+    std::atomic <int> *_users;  // if not zero, users of the shared tables played
+
+    static void set_limits (void);
+    static int  hcode (void);
+    static int  dcode (void);
+
+    static int   _vmax;   // if not zero, maximum number of sounding pipes
+    static int   _vset;   // voice limit set by the user
+    static float _gset;   // release floor set by the user
+    static bool  _reduce; // use the limits for reduced quality
 };
 
 
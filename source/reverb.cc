@@ -18,91 +18,164 @@
 // ----------------------------------------------------------------------------
 
 
+#include <algorithm>
 #include <stdio.h>
 #include <math.h>
 #include <memory>
 #include "reverb.h"
 
 
-Delelm::Delelm (int size, float fb)
+// FDN level below which the tail is considered to have decayed. This
+// is some 20 dB above the floor set by the anti-denormal offsets.
+//
+#define TAIL_LEVEL 1e-7f
+
+
+Delbank::Delbank (const int *sizes, const float *fb)
 {
-    _size = size;
-    _line = std::make_unique <float []> (size);
-    _i = 0;
-    _fb = fb;
-    _slo = 0;
-    _shi = 0;
+    int  k, n;
+
+    for (k = n = 0; k < NLANE; k++) n += sizes [k];
+    _data = std::make_unique <float []> (n);
+    for (k = n = 0; k < NLANE; k++)
+    {
+        _line [k] = _data.get () + n;
+        _size [k] = sizes [k];
+        _i [k] = 0;
+        _fb [k] = fb [k];
+        _slo [k] = 0;
+        _shi [k] = 0;
+        n += sizes [k];
+    }
 }
 
 
-void Delelm::set_t60mf (float tmf)
+void Delbank::set_t60mf (float tmf)
 {
-    _gmf = powf (0.001f, _size / tmf);
+    for (int k = 0; k < NLANE; k++) _gmf [k] = powf (0.001f, _size [k] / tmf);
 } 
 
  
-void Delelm::set_t60lo (float tlo, float wlo)
+void Delbank::set_t60lo (float tlo, float wlo)
 {
-    _glo = powf (0.001f, _size / tlo) / _gmf - 1.0f;
-    _wlo = wlo;    
+    for (int k = 0; k < NLANE; k++)
+    {
+        _glo [k] = powf (0.001f, _size [k] / tlo) / _gmf [k] - 1.0f;
+        _wlo [k] = wlo;    
+    }
 }
 
  
-void Delelm::set_t60hi (float thi, float chi)
+void Delbank::set_t60hi (float thi, float chi)
 {
     float g, t;
 
-    g = powf (0.001f, _size / thi) / _gmf;
-    t = (1 - g * g) / (2 * g * g * chi);
-    _whi = (sqrtf (1 + 4 * t) - 1) / (2 * t);
+    for (int k = 0; k < NLANE; k++)
+    {
+        g = powf (0.001f, _size [k] / thi) / _gmf [k];
+        t = (1 - g * g) / (2 * g * g * chi);
+        _whi [k] = (sqrtf (1 + 4 * t) - 1) / (2 * t);
+    }
 } 
 
  
-float Delelm::process (float x)
+// Read the next n <= RBLOCK delayed samples from each line and
+// apply the shelf filters. Result in s [j * NLANE + k] for sample j
+// and lane k.
+//
+void Delbank::read (int n, float *s)
 {
-    float t;
+    int   i, j, k, m;
+    float t, *p;
+    alignas (32) float slo [NLANE];
+    alignas (32) float shi [NLANE];
+
+    for (k = 0; k < NLANE; k++)
+    {
+        i = _i [k];
+        p = _line [k];
+        m = _size [k] - i;
+        if (m > n) m = n;
+        for (j = 0; j < m; j++) s [j * NLANE + k] = p [i + j];
+        for (; j < n; j++) s [j * NLANE + k] = p [i + j - _size [k]];
+    }
+
+    std::copy_n (_slo, NLANE, slo);
+    std::copy_n (_shi, NLANE, shi);
+    for (j = 0; j < n; j++, s += NLANE)
+    {
+        for (k = 0; k < NLANE; k++)
+        {
+            t = s [k] * _gmf [k];
+            slo [k] += _wlo [k] * (t - slo [k]);
+            t += _glo [k] * slo [k];
+            shi [k] += _whi [k] * (t - shi [k]);
+            s [k] = shi [k];
+        }
+    }
+    std::copy_n (slo, NLANE, _slo);
+    std::copy_n (shi, NLANE, _shi);
+}
+
+
+void Delbank::clear (void)
+{
+    int k, n;
+
+    for (k = n = 0; k < NLANE; k++) n += _size [k];
+    std::fill_n (_data.get (), n, 0.0f);
+    std::fill_n (_slo, NLANE, 0.0f);
+    std::fill_n (_shi, NLANE, 0.0f);
+}
+
+
+// Store the next n line inputs, from t [j * NLANE + k], at the
+// positions just read.
+//
+void Delbank::write (int n, const float *t)
+{
+    int   i, j, k, m;
+    float *p;
 
-    t = _line [_i] * _gmf;
-    _slo += _wlo * (t - _slo);
-    t += _glo * _slo;
-    _shi += _whi * (t - _shi);
-    t = x - _fb * _shi + 1e-10f;
-    _line [_i] = t;
-    if (++_i == _size) _i = 0;
-    return _shi + _fb * t;
+    for (k = 0; k < NLANE; k++)
+    {
+        i = _i [k];
+        p = _line [k];
+        m = _size [k] - i;
+        if (m > n) m = n;
+        for (j = 0; j < m; j++) p [i + j] = t [j * NLANE + k];
+        for (; j < n; j++) p [i + j - _size [k]] = t [j * NLANE + k];
+        i += n;
+        if (i >= _size [k]) i -= _size [k];
+        _i [k] = i;
+    }
 }
 
 
-void Delelm::print (void)
+void Delbank::print (void)
 {
-    printf ("%5d %6.3lf   %5.3lf %5.3lf   %6.4lf %6.4lf\n",
-            _size, _fb, _glo, _gmf, _wlo, _whi); 
+    for (int k = 0; k < NLANE; k++)
+    {
+        printf ("%5d %6.3lf   %5.3lf %5.3lf   %6.4lf %6.4lf\n",
+                _size [k], _fb [k], _glo [k], _gmf [k], _wlo [k], _whi [k]); 
+    }
 }
 
 
-int Reverb::_sizes [16] = 
+// Each FDN line consists of two delay elements, the first one
+// before and the second one after the Hadamard mixing matrix.
+//
+int Reverb::_sizes [2][NLANE] = 
 { 
-     839,  6732 -  839,
-    1181,  7339 - 1181,
-    1229,  8009 - 1229,
-    2477,  8731 - 2477,
-    2731,  9521 - 2731,
-    1361, 10381 - 1361,
-    3203, 11321 - 3203,
-    1949, 12347 - 1949
+    {  839,        1181,        1229,        2477,        2731,         1361,         3203,         1949 },
+    { 6732 -  839, 7339 - 1181, 8009 - 1229, 8731 - 2477, 9521 - 2731, 10381 - 1361, 11321 - 3203, 12347 - 1949 }
 };
 
 
-float Reverb::_feedb [16] = 
+float Reverb::_feedb [2][NLANE] = 
 {  
-   -0.6f,  0.1f,
-    0.6f,  0.1f,
-    0.6f,  0.1f,
-   -0.6f,  0.1f,
-    0.6f,  0.1f,
-   -0.6f,  0.1f,
-   -0.6f,  0.1f,
-    0.6f,  0.1f
+    { -0.6f, 0.6f, 0.6f, -0.6f, 0.6f, -0.6f, -0.6f, 0.6f },
+    {  0.1f, 0.1f, 0.1f,  0.1f, 0.1f,  0.1f,  0.1f, 0.1f }
 };
 
 
@@ -115,8 +188,23 @@ Reverb::Reverb (float rate)
     _line = std::make_unique <float []> (_size);
     _i = 0;
     m = (rate < 64e3) ? 1 : 2;    
-    for (int i = 0; i < 16; i++) _delm [i] = Delelm (m * _sizes [i], _feedb [i]);
-    _x0 = _x1 = _x2 = _x3 = _x4 = _x5 = _x6 = _x7 = _z = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        int sizes [NLANE];
+        for (int k = 0; k < NLANE; k++) sizes [k] = m * _sizes [i][k];
+        _dbank [i] = Delbank (sizes, _feedb [i]);
+    }
+    std::fill_n (_x, NLANE, 0.0f);
+    _z = 0;
+    _ntail = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        for (int k = 0; k < NLANE; k++) _ntail = std::max (_ntail, _dbank [i]._size [k]);
+    }
+    _nquiet = 0;
+    _nlow = 0;
+    _idle = false;
+    _reduce = false;
     set_delay (0.05);
     set_t60mf (4.0f);
     set_t60lo (5.0f, 250.0f);
@@ -124,6 +212,29 @@ Reverb::Reverb (float rate)
 }
 
 
+void Reverb::clear (void)
+{
+    std::fill_n (_line.get (), _size, 0.0f);
+    _dbank [0].clear ();
+    _dbank [1].clear ();
+    std::fill_n (_x, NLANE, 0.0f);
+    _z = 0;
+}
+
+
+// At reduced quality the second delay bank is bypassed, halving the
+// number of delay lines. Each element keeps its own decay gain, so
+// the reverb time is unchanged, but the echo density is lower.
+//
+void Reverb::set_reduced (bool on)
+{
+    if (on == _reduce) return;
+    _reduce = on;
+    _dbank [1].clear ();
+    std::fill_n (_sb, RBLOCK * NLANE, 0.0f);
+}
+
+
 void Reverb::set_delay (float del)
 {
     if (del < 0.01f) del = 0.01f;
@@ -138,7 +249,7 @@ void Reverb::set_t60mf (float tmf)
 
     _tmf = tmf;
     t = tmf * _rate;
-    for (int i = 0; i < 16; i++) _delm [i].set_t60mf (t);
+    for (int i = 0; i < 2; i++) _dbank [i].set_t60mf (t);
     _gain = 1.0f / sqrtf (tmf);
 }
 
@@ -151,7 +262,7 @@ void Reverb::set_t60lo (float tlo, float flo)
     _flo = flo;
     t = tlo * _rate;
     w = 2 * M_PI * flo / _rate;
-    for (int i = 0; i < 16; i++) _delm [i].set_t60lo (t, w);
+    for (int i = 0; i < 2; i++) _dbank [i].set_t60lo (t, w);
 }
 
 
@@ -163,72 +274,148 @@ void Reverb::set_t60hi (float thi, float fhi)
     _fhi = fhi;
     t = thi * _rate;
     c = 1 - cosf (2 * M_PI * fhi / _rate);
-    for (int i = 0; i < 16; i++) _delm [i].set_t60hi (t, c);
+    for (int i = 0; i < 2; i++) _dbank [i].set_t60hi (t, c);
 }
 
 
 void Reverb::print (void)
 {
-    for (int i = 0; i < 16; i++) _delm [i].print ();
+    for (int i = 0; i < 2; i++) _dbank [i].print ();
 }
 
 
+// In-place 8 point Hadamard transform, unnormalised. Written out
+// in full so the compiler can keep everything in registers.
+//
+static inline void hadamard (float *x)
+{
+    float a0, a1, a2, a3, a4, a5, a6, a7;
+    float b0, b1, b2, b3, b4, b5, b6, b7;
+
+    a0 = x [0] + x [1]; a1 = x [0] - x [1];
+    a2 = x [2] + x [3]; a3 = x [2] - x [3];
+    a4 = x [4] + x [5]; a5 = x [4] - x [5];
+    a6 = x [6] + x [7]; a7 = x [6] - x [7];
+    b0 = a0 + a2; b2 = a0 - a2;
+    b1 = a1 + a3; b3 = a1 - a3;
+    b4 = a4 + a6; b6 = a4 - a6;
+    b5 = a5 + a7; b7 = a5 - a7;
+    x [0] = b0 + b4; x [4] = b0 - b4;
+    x [1] = b1 + b5; x [5] = b1 - b5;
+    x [2] = b2 + b6; x [6] = b2 - b6;
+    x [3] = b3 + b7; x [7] = b3 - b7;
+}
+
+
+// The signal is processed in blocks of at most RBLOCK samples.
+// For each block, the filtered outputs of all delay lines are
+// computed first, then a per sample pass does the feedback and
+// mixing, and finally the new line inputs are written back.
+// Only the mixing pass has a dependency from one sample to the
+// next, and it works on all lanes at once.
+//
 void Reverb::process (int n, float gain, float *R, float *W, float *X, float *Y, float *Z)
 {	
-    int   i, j;
-    float t, g, x;
+    int   i, j, k, m;
+    float g, t, x;
+    float *sa, *sb, *ta, *tb;
+    const float *fa = _dbank [0]._fb;
+    const float *fb = _dbank [1]._fb;
+    alignas (32) float a [NLANE];
 
     g = sqrtf (0.125f);
     gain *= _gain;
 
-    i = _i;
-    while (n--)   
+    while (n)
     {
-        j = i - _idel;
-        if (j < 0) j += _size;
-        x = _line [j];
-        _z += 0.6f * (*R++ - _z) + 1e-10f;
-        _line [i] = _z;
-        if (++i == _size) i = 0;
-
-        _x0 = _delm  [0].process (g * _x0 + x); 
-        _x1 = _delm  [2].process (g * _x1 + x); 
-        _x2 = _delm  [4].process (g * _x2 + x); 
-        _x3 = _delm  [6].process (g * _x3 + x); 
-        _x4 = _delm  [8].process (g * _x4 + x); 
-        _x5 = _delm [10].process (g * _x5 + x); 
-        _x6 = _delm [12].process (g * _x6 + x); 
-        _x7 = _delm [14].process (g * _x7 + x); 
-
-        t = _x0 - _x1; _x0 += _x1;  _x1 = t;
-        t = _x2 - _x3; _x2 += _x3;  _x3 = t;
-        t = _x4 - _x5; _x4 += _x5;  _x5 = t;
-        t = _x6 - _x7; _x6 += _x7;  _x7 = t;
-
-        t = _x0 - _x2; _x0 += _x2;  _x2 = t;
-        t = _x1 - _x3; _x1 += _x3;  _x3 = t;
-        t = _x4 - _x6; _x4 += _x6;  _x6 = t;
-        t = _x5 - _x7; _x5 += _x7;  _x7 = t;
-
-        t = _x0 - _x4; _x0 += _x4;  _x4 = t;
-        t = _x1 - _x5; _x1 += _x5;  _x5 = t;
-        t = _x2 - _x6; _x2 += _x6;  _x6 = t;
-        t = _x3 - _x7; _x3 += _x7;  _x7 = t;
-
-        *W++ += 1.25f * gain * _x0; 
-        *X++ += gain * (_x1 - 0.05f * _x2);
-        *Y++ += gain * _x2;
-        *Z++ += gain * _x4;
-
-        _x0 = _delm  [1].process (_x0);
-        _x1 = _delm  [3].process (_x1); 
-        _x2 = _delm  [5].process (_x2); 
-        _x3 = _delm  [7].process (_x3); 
-        _x4 = _delm  [9].process (_x4); 
-        _x5 = _delm [11].process (_x5); 
-        _x6 = _delm [13].process (_x6); 
-        _x7 = _delm [15].process (_x7); 
+        m = (n < RBLOCK) ? n : RBLOCK;
+        n -= m;
+
+        // Once the input has been zero for the length of the predelay
+        // line, and then everything read from the FDN has been below
+        // TAIL_LEVEL for the length of the longest delay, the state is
+        // cleared and processing stops until the input is non-zero.
+        for (j = 0; (j < m) && (R [j] == 0.0f); j++);
+        if (j < m)
+        {
+            _nquiet = 0;
+            _nlow = 0;
+            _idle = false;
+        }
+        else if (_nquiet <= _size) _nquiet += m;
+        if (_idle)
+        {
+            R += m;
+            W += m;
+            X += m;
+            Y += m;
+            Z += m;
+            continue;
+        }
+
+        i = _i;
+        for (j = 0; j < m; j++)
+        {
+            k = i - _idel;
+            if (k < 0) k += _size;
+            _xin [j] = _line [k];
+            _z += 0.6f * (*R++ - _z) + 1e-10f;
+            _line [i] = _z;
+            if (++i == _size) i = 0;
+        }
+        _i = i;
+
+        _dbank [0].read (m, _sa);
+        if (! _reduce) _dbank [1].read (m, _sb);
+
+        sa = _sa;
+        sb = _sb;
+        ta = _ta;
+        tb = _tb;
+        for (j = 0; j < m; j++)
+        {
+            x = _xin [j];
+            for (k = 0; k < NLANE; k++)
+            {
+                t = g * _x [k] + x - fa [k] * sa [k] + 1e-10f;
+                ta [k] = t;
+                a [k] = sa [k] + fa [k] * t;
+            }
+            hadamard (a);
+
+            *W++ += 1.25f * gain * a [0]; 
+            *X++ += gain * (a [1] - 0.05f * a [2]);
+            *Y++ += gain * a [2];
+            *Z++ += gain * a [4];
+
+            if (_reduce) std::copy_n (a, NLANE, _x);
+            else
+            {
+                for (k = 0; k < NLANE; k++)
+                {
+                    t = a [k] - fb [k] * sb [k] + 1e-10f;
+                    tb [k] = t;
+                    _x [k] = sb [k] + fb [k] * t;
+                }
+            }
+            sa += NLANE;
+            sb += NLANE;
+            ta += NLANE;
+            tb += NLANE;
+        }
+
+        _dbank [0].write (m, _ta);
+        if (! _reduce) _dbank [1].write (m, _tb);
+
+        if (_nquiet > _size)
+        {
+            for (j = 0, t = 0; j < m * NLANE; j++) t = fmaxf (t, fabsf (_sa [j]) + fabsf (_sb [j]));
+            if (t >= TAIL_LEVEL) _nlow = 0;
+            else if ((_nlow += m) > _ntail)
+            {
+                clear ();
+                _idle = true;
+            }
+        }
     }
-    _i = i;
 }
-
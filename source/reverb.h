@@ -24,31 +24,49 @@
 #include <memory>
 
 
-class Delelm
+#define NLANE 8
+#define RBLOCK 64
+
+
+// A bank of NLANE delay elements, one for each line of the FDN.
+// All state is kept as arrays indexed by lane, so the filters and
+// mixing run as fixed length loops over the lanes that the compiler
+// can map to vector registers.
+//
+// Since all delays are much longer than RBLOCK, the part of each
+// element that depends only on the delayed signal is computed for
+// a whole block at once by read (), which streams through each line
+// and leaves the results interleaved by lane. The new line inputs
+// are stored by write () in the same way.
+//
+class Delbank
 {
 private:
 
     friend class Reverb;
 
-    Delelm () = default;
-    Delelm (int size, float fb);
+    Delbank () = default;
+    Delbank (const int *sizes, const float *fb);
 
     void set_t60mf (float tmf);
     void set_t60lo (float tlo, float _wlo);
     void set_t60hi (float thi, float chi);
+    void clear (void);
     void print (void);
-    float process (float x);
-
-    int        _i;
-    int        _size;
-    std::unique_ptr <float []> _line;
-    float      _fb;
-    float      _gmf;
-    float      _glo;
-    float      _wlo;
-    float      _whi;
-    float      _slo;
-    float      _shi;    
+    void read (int n, float *s);
+    void write (int n, const float *t);
+
+    std::unique_ptr <float []> _data;
+    float     *_line [NLANE];
+    int        _size [NLANE];
+    int        _i [NLANE];
+    alignas (32) float _fb  [NLANE];
+    alignas (32) float _gmf [NLANE];
+    alignas (32) float _glo [NLANE];
+    alignas (32) float _wlo [NLANE];
+    alignas (32) float _whi [NLANE];
+    alignas (32) float _slo [NLANE];
+    alignas (32) float _shi [NLANE];
 };
 
 
@@ -66,15 +84,22 @@ public:
     void set_t60mf (float tmf);
     void set_t60lo (float tlo, float flo);
     void set_t60hi (float thi, float fhi);
+    void set_reduced (bool on);
 
 private:
 
     void print (void);
+    void clear (void);
     std::unique_ptr <float []> _line;
     int     _size;
     int     _idel;
     int     _i;
-    Delelm  _delm [16];
+    int     _ntail;   // longest FDN delay
+    int     _nquiet;  // samples since the last non-zero input
+    int     _nlow;    // samples since the FDN was above TAIL_LEVEL
+    bool    _idle;
+    bool    _reduce;  // use only the first delay bank
+    Delbank _dbank [2];
     float   _rate;
     float   _gain;
     float   _tmf;
@@ -82,11 +107,16 @@ private:
     float   _thi;
     float   _flo;
     float   _fhi;
-    float   _x0, _x1, _x2, _x3, _x4, _x5, _x6, _x7;
+    alignas (32) float _x [NLANE];
+    alignas (32) float _sa [RBLOCK * NLANE];
+    alignas (32) float _sb [RBLOCK * NLANE];
+    alignas (32) float _ta [RBLOCK * NLANE];
+    alignas (32) float _tb [RBLOCK * NLANE];
+    float   _xin [RBLOCK];
     float   _z;
 
-    static int   _sizes [16];
-    static float _feedb [16]; 
+    static int   _sizes [2][NLANE];
+    static float _feedb [2][NLANE]; 
 };
 
 
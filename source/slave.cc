@@ -18,8 +18,21 @@
 // ----------------------------------------------------------------------------
 
 
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include "slave.h"
+#include "bundle.h"
+#include "convolver.h"
+#include "premix.h"
+#include "wavfile.h"
+
+
+Slave::Slave (const char *shmdir) :
+    A_thread ("Slave")
+{
+    if (shmdir) _store.open (shmdir);
+}
 
 
 void Slave::thr_main (void) 
@@ -38,7 +51,13 @@ void Slave::thr_main (void)
                 M_def_rank *X = (M_def_rank *) M;
                 send_event (TO_MODEL, new M_ifc_ifelm (MT_IFC_ELATT, X->_group, X->_ifelm)); 
                 X->_rwave = new Rankwave (X->_synth->_n0, X->_synth->_n1);
-                X->_rwave->gen_waves (X->_synth, X->_fsamp, X->_fbase, X->_scale);
+                if (load_shared (X))
+                {
+                    X->_rwave->gen_waves (X->_synth, X->_fsamp, X->_fbase, X->_scale);
+                    store_shared (X);
+		}
+                X->_rwave->load_samples (X->_smpdir, X->_synth, X->_fsamp);
+                X->_rwave->prefault (&X->_resid, &X->_locked);
                 send_event (TO_AUDIO, M);
                 break;
 	    }
@@ -48,10 +67,17 @@ void Slave::thr_main (void)
                 M_def_rank *X = (M_def_rank *) M;
                 send_event (TO_MODEL, new M_ifc_ifelm (MT_IFC_ELATT, X->_group, X->_ifelm)); 
                 X->_rwave = new Rankwave (X->_synth->_n0, X->_synth->_n1);
-                if (X->_rwave->load (X->_path, X->_synth, X->_fsamp, X->_fbase, X->_scale)) 
+                if (   load_bundled (X)
+                    && load_shared (X))
                 {
-                    X->_rwave->gen_waves (X->_synth, X->_fsamp, X->_fbase, X->_scale); 
+                    if (X->_rwave->load (X->_path, X->_synth, X->_fsamp, X->_fbase, X->_scale))
+                    {
+                        X->_rwave->gen_waves (X->_synth, X->_fsamp, X->_fbase, X->_scale); 
+		    }
+                    store_shared (X);
 		} 
+                X->_rwave->load_samples (X->_smpdir, X->_synth, X->_fsamp);
+                X->_rwave->prefault (&X->_resid, &X->_locked);
                 send_event (TO_AUDIO, M);
                 break;
 	    }
@@ -64,7 +90,54 @@ void Slave::thr_main (void)
                 break;
 	    }
 
+            case MT_LOAD_CONV:
+            {
+                M_load_conv *X = (M_load_conv *) M;
+                Wavfile      W;
+                if (W.load (X->_path))
+                {
+                    M->recover ();
+                }
+                else if ((W.nchan () != 1) && (W.nchan () != 4))
+                {
+                    fprintf (stderr, "Impulse response '%s' must have 1 or 4 channels\n", X->_path);
+                    M->recover ();
+                }
+                else if (W.rate () != (int)(X->_fsamp))
+                {
+                    fprintf (stderr, "Impulse response '%s' has sample rate %d, need %d\n", X->_path, W.rate (), (int)(X->_fsamp));
+                    M->recover ();
+                }
+                else
+                {
+                    X->_conv = new Convolver (W.data (), W.nchan (), W.nfram ());
+                    X->_conv->start (X->_policy, X->_relpri);
+                    printf ("Loaded impulse response '%s', %d channels, %.1lf s\n", X->_path, W.nchan (), (double) W.nfram () / W.rate ());
+                    send_event (TO_AUDIO, M);
+                }
+                break;
+	    }
+
+            case MT_CALC_PREMIX:
+            {
+                M_premix *X = (M_premix *) M;
+                X->_premix->compile ();
+                X->_npipe = X->_premix->_npipe;
+                X->_nmerg = X->_premix->_nmerg;
+                send_event (TO_AUDIO, M);
+                break;
+	    }
+
+            case MT_FREE_TABS:
+                // Sent by the model when ranks have been destroyed.
+                _store.release ();
+                M->recover ();
+                break;
+
+            case MT_NEW_INSTR:
+            case MT_NEW_DIVIS:
    	    case MT_AUDIO_SYNC:
+                // Passed on in order with the ranks.
 		send_event (TO_AUDIO, M);
 		break;
  
@@ -76,3 +149,67 @@ void Slave::thr_main (void)
 }
 
 
+// Use the wavetables of a rank from the bundle, without copying
+// them. Returns non-zero if there is no bundle, or the tables in it
+// don't match, and they should be looked for in the waves directory.
+//
+int Slave::load_bundled (M_def_rank *X)
+{
+    const char  *d;
+    char        name [BND_NAME + 4];
+    char        *p;
+    size_t      n;
+
+    if (! X->_bundle) return 1;
+    strncpy (name, X->_synth->_filename, BND_NAME - 1);
+    name [BND_NAME - 1] = 0;
+    if ((p = strrchr (name, '.'))) strcpy (p, ".ae1");
+    else strcat (name, ".ae1");
+    if (! (d = X->_bundle->find (name, &n))) return 1;
+    return X->_rwave->load (name, d, n, X->_synth, X->_fsamp, X->_fbase, X->_scale);
+}
+
+
+
+
+// Use the wavetables of a rank from the shared store. Returns non-zero
+// if there is no store or they are not in it.
+//
+int Slave::load_shared (M_def_rank *X)
+{
+    const char  *d;
+    size_t      n;
+    uint64_t    k;
+
+    if (! _store.isopen ()) return 1;
+    k = Rankwave::tabkey (X->_synth, X->_fsamp, X->_fbase, X->_scale);
+    if (! (d = _store.find (k, &n))) return 1;
+    if (X->_rwave->load (X->_synth->_filename, d, n, X->_synth, X->_fsamp, X->_fbase, X->_scale)) return 1;
+    _store.hold (k, X->_rwave);
+    return 0;
+}
+
+
+// Put the wavetables of a rank, loaded from a file or computed, into
+// the shared store and use the copy there instead. The rank still
+// counts as modified if it was, so it can be saved to the waves
+// directory.
+//
+void Slave::store_shared (M_def_rank *X)
+{
+    const char  *d;
+    size_t      n;
+    uint64_t    k;
+    bool        m;
+
+    if (! _store.isopen ()) return;
+    k = Rankwave::tabkey (X->_synth, X->_fsamp, X->_fbase, X->_scale);
+    if (! (d = _store.insert (k, X->_rwave, X->_fsamp, X->_fbase, X->_scale, &n))) return;
+    m = X->_rwave->modif ();
+    std::unique_ptr <Rankwave> R = std::make_unique <Rankwave> (X->_synth->_n0, X->_synth->_n1);
+    if (R->load (X->_synth->_filename, d, n, X->_synth, X->_fsamp, X->_fbase, X->_scale)) return;
+    _store.hold (k, R.get ());
+    R->set_modif (m);
+    delete X->_rwave;
+    X->_rwave = R.release ();
+}
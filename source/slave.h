@@ -24,20 +24,30 @@
 
 #include <clthreads.h>
 #include "messages.h"
+#include "tabstore.h"
 
 
 class Slave : public A_thread
 {
 public:
 
-    Slave (void) : A_thread ("Slave") {}
+    Slave (const char *shmdir = 0);
     virtual ~Slave (void) {}
 
     void terminate (void) {  put_event (EV_EXIT, 1); }
 
+    // Run on the calling thread instead of one started by thr_start ().
+    void run (void) { thr_main (); }
+
 private:
 
     virtual void thr_main (void);
+
+    int  load_bundled (M_def_rank *X);
+    int  load_shared (M_def_rank *X);
+    void store_shared (M_def_rank *X);
+
+    Tabstore  _store;
 };
 
 
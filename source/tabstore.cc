@@ -0,0 +1,258 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tabstore.h"
+
+
+Tabstore::Tabstore (void)
+{
+    *_dir = 0;
+}
+
+
+Tabstore::~Tabstore (void)
+{
+    close ();
+}
+
+
+int Tabstore::open (const char *dir)
+{
+    struct stat  S;
+
+    close ();
+    if (stat (dir, &S) || ! S_ISDIR (S.st_mode) || access (dir, W_OK | X_OK))
+    {
+        fprintf (stderr, "Can't use '%s' for shared wavetables\n", dir);
+        return 1;
+    }
+    strncpy (_dir, dir, sizeof (_dir) - 1);
+    _dir [sizeof (_dir) - 1] = 0;
+    cleanup ();
+    return 0;
+}
+
+
+// Unmap all tables and remove those no other process has locked.
+// This must not be done while any rank still uses them.
+//
+void Tabstore::close (void)
+{
+    for (Entry& E : _entries) remove (E);
+    _entries.clear ();
+    *_dir = 0;
+}
+
+
+// Count the rank R as a user of the tables with this key, until it
+// is destroyed.
+//
+void Tabstore::hold (uint64_t key, Rankwave *R)
+{
+    for (Entry& E : _entries)
+    {
+        if (E._key == key)
+	{
+            E._users->fetch_add (1, std::memory_order_relaxed);
+            R->set_users (E._users.get ());
+            return;
+	}
+    }
+}
+
+
+// Unmap the tables that no rank uses any more, and remove those no
+// other process has locked.
+//
+void Tabstore::release (void)
+{
+    size_t  i;
+
+    for (i = 0; i < _entries.size (); )
+    {
+        if (_entries [i]._users->load (std::memory_order_acquire) == 0)
+	{
+            remove (_entries [i]);
+            _entries.erase (_entries.begin () + i);
+	}
+        else i++;
+    }
+}
+
+
+void Tabstore::remove (Entry& E)
+{
+    char  name [1100];
+
+    // The file can't have been replaced, we held a lock on it.
+    if (! flock (E._fd, LOCK_EX | LOCK_NB))
+    {
+        filename (name, sizeof (name), E._key);
+        unlink (name);
+    }
+    munmap (E._addr, E._size);
+    ::close (E._fd);
+}
+
+
+// Remove the files that no process has locked. These were left by
+// a process that was killed, or are being written by one that has
+// not locked its file yet, which then just doesn't use the store.
+//
+void Tabstore::cleanup (void)
+{
+    DIR            *D;
+    struct dirent  *P;
+    int            fd, n;
+    char           name [1400];
+
+    if (! (D = opendir (_dir))) return;
+    n = 0;
+    while ((P = readdir (D)))
+    {
+        if (strncmp (P->d_name, "aeolus-", 7) && strncmp (P->d_name, ".aeolus-", 8)) continue;
+        snprintf (name, sizeof (name), "%s/%s", _dir, P->d_name);
+        if ((fd = ::open (name, O_RDONLY)) < 0) continue;
+        if (! flock (fd, LOCK_EX | LOCK_NB) && ! unlink (name)) n++;
+        ::close (fd);
+    }
+    closedir (D);
+    if (n) printf ("Removed %d unused wavetable files from '%s'\n", n, _dir);
+}
+
+
+// Return the tables with this key, or zero if they aren't in the
+// store. They stay valid until the store is closed, or released
+// while no rank holds them.
+//
+const char *Tabstore::find (uint64_t key, size_t *size)
+{
+    int          fd;
+    struct stat  S;
+    char         name [1100];
+
+    if (! isopen ()) return 0;
+    for (const Entry& E : _entries)
+    {
+        if (E._key == key)
+	{
+            *size = E._size;
+            return E._addr;
+	}
+    }
+    filename (name, sizeof (name), key);
+    if ((fd = ::open (name, O_RDONLY)) < 0) return 0;
+    // A file that was removed between the open and the lock is gone.
+    if (flock (fd, LOCK_SH) || fstat (fd, &S) || (S.st_nlink == 0))
+    {
+        ::close (fd);
+        return 0;
+    }
+    return attach (key, fd, size);
+}
+
+
+// Put the tables of a rank in the store, and return the copy in the
+// store. If another process did the same first, its copy is used.
+// The file is written under a temporary name and then linked to its
+// final one, so other processes never see a part of it.
+//
+const char *Tabstore::insert (uint64_t key, Rankwave *R, float fsamp, float fbase, float *scale, size_t *size)
+{
+    int    fd, e;
+    FILE   *F;
+    bool   err;
+    char   name [1100];
+    char   tmp [1100];
+
+    if (! isopen ()) return 0;
+    filename (name, sizeof (name), key);
+    snprintf (tmp, sizeof (tmp), "%s/.aeolus-%016llx.%d", _dir, (unsigned long long) key, (int) getpid ());
+    if ((fd = ::open (tmp, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        fprintf (stderr, "Can't open '%s' for writing\n", tmp);
+        return 0;
+    }
+    // Locked before it is visible, so nobody can remove it.
+    flock (fd, LOCK_SH);
+    if (! (F = fdopen (dup (fd), "wb")))
+    {
+        ::close (fd);
+        unlink (tmp);
+        return 0;
+    }
+    R->save (F, fsamp, fbase, scale);
+    err = fflush (F) || ferror (F);
+    fclose (F);
+    if (err)
+    {
+        fprintf (stderr, "Error writing '%s'\n", tmp);
+        ::close (fd);
+        unlink (tmp);
+        return 0;
+    }
+    if (link (tmp, name))
+    {
+        e = errno;
+        ::close (fd);
+        unlink (tmp);
+        return (e == EEXIST) ? find (key, size) : 0;
+    }
+    unlink (tmp);
+    return attach (key, fd, size);
+}
+
+
+const char *Tabstore::attach (uint64_t key, int fd, size_t *size)
+{
+    struct stat  S;
+    char         *p;
+
+    if (fstat (fd, &S) || (S.st_size < 80))
+    {
+        ::close (fd);
+        return 0;
+    }
+    p = (char *) mmap (0, S.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        ::close (fd);
+        return 0;
+    }
+    _entries.push_back ({ key, fd, p, (size_t) S.st_size, std::make_unique <std::atomic <int>> (0) });
+    *size = S.st_size;
+    return p;
+}
+
+
+void Tabstore::filename (char *name, size_t n, uint64_t key) const
+{
+    snprintf (name, n, "%s/aeolus-%016llx", _dir, (unsigned long long) key);
+}
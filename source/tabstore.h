@@ -0,0 +1,87 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __TABSTORE_H
+#define __TABSTORE_H
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "rankwave.h"
+
+
+// Wavetables shared by all Aeolus processes on a machine. Each rank
+// is a file '<dir>/aeolus-<key>' holding the image of its .ae1 file,
+// where the key is a hash of everything the tables are computed from
+// (Rankwave::tabkey ()). The directory should be on a tmpfs such as
+// /dev/shm. Processes map the files read-only and play the tables
+// where they are, so a rank is in memory only once.
+//
+// Every process that has a file mapped holds a shared lock on it.
+// A rank that plays tables from the store counts as one of their
+// users. When no rank uses them any more they are unmapped, and the
+// file is removed if nobody else has it locked, so a table lives as
+// long as some process uses it. Files left by a process that was
+// killed are removed when the store is opened.
+//
+class Tabstore
+{
+public:
+
+    Tabstore (void);
+    ~Tabstore (void);
+
+    int  open (const char *dir);
+    void close (void);
+
+    bool        isopen (void) const { return *_dir != 0; }
+    const char *find (uint64_t key, size_t *size);
+    const char *insert (uint64_t key, Rankwave *R, float fsamp, float fbase, float *scale, size_t *size);
+    void        hold (uint64_t key, Rankwave *R);
+    void        release (void);
+
+private:
+
+    Tabstore (const Tabstore&);
+    Tabstore& operator=(const Tabstore&);
+
+    struct Entry
+    {
+        uint64_t  _key;
+        int       _fd;
+        char     *_addr;
+        size_t    _size;
+        std::unique_ptr <std::atomic <int>> _users;
+    };
+
+    const char *attach (uint64_t key, int fd, size_t *size);
+    void remove (Entry& E);
+    void cleanup (void);
+    void filename (char *name, size_t n, uint64_t key) const;
+
+    char  _dir [1024];
+    std::vector <Entry> _entries;
+};
+
+
+#endif
@@ -166,6 +166,10 @@ void Tiface::handle_mesg (ITC_mesg *M)
     case MT_IFC_PRRCL:
 	break;
 
+    case MT_IFC_QUALITY:
+	handle_ifc_quality ((M_ifc_quality *) M);
+	break;
+
     default:
 	printf ("Received message of unknown type %5ld\n", M->type ());
     }
@@ -188,8 +192,12 @@ void Tiface::handle_ifc_ready (void)
 
 void Tiface::handle_ifc_init (M_ifc_init *M)
 {
+    int i;
+
+    // Also sent when the instrument is replaced, with all stops off.
     if (_initdata) _initdata ->recover ();
     _initdata = M;
+    for (i = 0; i < NGROUP; i++) _ifelms [i] = 0;
 }
 
 
@@ -210,6 +218,13 @@ void Tiface::handle_ifc_retune (M_ifc_retune *M)
 }
 
 
+void Tiface::handle_ifc_quality (M_ifc_quality *M)
+{
+    if (M->_level) printf ("DSP load %d%%, reduced quality level %d\n", M->_load, M->_level);
+    else printf ("DSP load %d%%, full quality\n", M->_load);
+}
+
+
 void Tiface::handle_ifc_grclr (M_ifc_ifelm *M)
 {
     _ifelms [M->_group] = 0;
@@ -426,12 +441,30 @@ void Tiface::parse_command (const char *p)
 	send_event (TO_MODEL, new ITC_mesg (MT_IFC_SAVE));
 	break;
 
+    case 'I':
+    case 'i':
+	command_i (p);
+	break;
+
     default:
 	printf ("Unknown command '%c'\n", c1); 
     }
 }
 
 
+void Tiface::command_i (const char *p)
+{
+    char s [1024];
+
+    if (sscanf (p, "%1023s", s) != 1)
+    {
+	printf ("Expected an instrument directory\n");
+	return;
+    }
+    send_event (TO_MODEL, new M_ifc_instr (s));
+}
+
+
 void Tiface::command_s (const char *p)
 {
     int  g, i, k, n;
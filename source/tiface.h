@@ -59,6 +59,7 @@ private:
     void handle_ifc_init (M_ifc_init *);
     void handle_ifc_mcset (M_ifc_chconf *);
     void handle_ifc_retune (M_ifc_retune *);
+    void handle_ifc_quality (M_ifc_quality *);
     void handle_ifc_grclr (M_ifc_ifelm *);
     void handle_ifc_elclr (M_ifc_ifelm *);
     void handle_ifc_elset (M_ifc_ifelm *);
@@ -73,6 +74,7 @@ private:
     void print_stops_long (int);
     void rewrite_label (const char *);
     void parse_command (const char *);
+    void command_i (const char *);
     void command_s (const char *);
     int  find_group (const char *);
     int  find_ifelm (const char *, int);
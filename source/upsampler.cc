@@ -0,0 +1,119 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <algorithm>
+#include <math.h>
+#include "upsampler.h"
+
+
+#define UPS_BETA 8.0   // Kaiser window parameter, about 80 dB stopband
+
+
+static double bessel_i0 (double x)
+{
+    int     j;
+    double  s, t;
+
+    for (j = 1, s = t = 1.0; j < 40; j++)
+    {
+        t *= 0.25 * x * x / (j * j);
+        s += t;
+    }
+    return s;
+}
+
+
+Upsampler::Upsampler (void) :
+    _nchan (0),
+    _fact (1),
+    _step (0)
+{
+}
+
+
+// Prepare for nchan channels, fact output frames per input frame,
+// and at most fsize input frames per call to process (). For each
+// of the fact phases the taps are stored in the order they meet the
+// input, so every output frame is one contiguous dot product.
+//
+void Upsampler::init (int nchan, int fact, int fsize)
+{
+    int     i, j, n;
+    double  c, g, s, x;
+    float   *p;
+
+    _nchan = nchan;
+    _fact = fact;
+    _step = fsize + UPS_NTAP - 1;
+    _buff = std::make_unique <float []> (_nchan * _step);
+    _coef = std::make_unique <float []> (_fact * UPS_NTAP);
+
+    n = _fact * UPS_NTAP;
+    c = 0.5 * (n - 1);
+    g = 1.0 / bessel_i0 (UPS_BETA);
+    for (i = 0; i < _fact; i++)
+    {
+        p = _coef.get () + i * UPS_NTAP;
+        for (j = 0, s = 0; j < UPS_NTAP; j++)
+	{
+            x = (i + (UPS_NTAP - 1 - j) * _fact - c) / _fact;
+            p [j] = (fabs (x) < 1e-9) ? 1.0 : sin (M_PI * x) / (M_PI * x);
+            x *= _fact / (c + 1);
+            p [j] *= g * bessel_i0 (UPS_BETA * sqrt (1.0 - x * x));
+            s += p [j];
+	}
+        // Exact unity gain at DC for each phase.
+        for (j = 0; j < UPS_NTAP; j++) p [j] /= s;
+    }
+    reset ();
+}
+
+
+void Upsampler::reset (void)
+{
+    if (_buff) std::fill_n (_buff.get (), _nchan * _step, 0.0f);
+}
+
+
+// Upsample the nfram frames written to each of the input buffers
+// to out, then keep the last UPS_NTAP - 1 of them for the next call.
+//
+void Upsampler::process (float **out, int nfram)
+{
+    int          c, i, j, k;
+    float        s, *q;
+    const float  *b, *p;
+
+    for (c = 0; c < _nchan; c++)
+    {
+        b = _buff.get () + c * _step;
+        q = out [c];
+        for (i = 0; i < nfram; i++)
+	{
+            for (k = 0, p = _coef.get (); k < _fact; k++, p += UPS_NTAP)
+	    {
+                s = 0.0f;
+                for (j = 0; j < UPS_NTAP; j++) s += p [j] * b [i + j];
+                *q++ = s;
+	    }
+	}
+        std::copy_n (b + nfram, UPS_NTAP - 1, _buff.get () + c * _step);
+    }
+}
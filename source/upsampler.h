@@ -0,0 +1,61 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __UPSAMPLER_H
+#define __UPSAMPLER_H
+
+
+#include <memory>
+
+
+#define UPS_NTAP 48   // filter taps per output phase, at the input rate
+
+
+// Multichannel upsampler by an integer factor, a polyphase FIR with
+// a Kaiser windowed sinc that passes up to 0.445 of the input rate
+// and stops images from 0.555. The input is written to the buffers
+// returned by inp (), up to the size given to init (), and process ()
+// then writes fact () output frames for each input frame. The delay
+// is UPS_NTAP / 2 input frames.
+//
+class Upsampler
+{
+public:
+
+    Upsampler (void);
+
+    void init (int nchan, int fact, int fsize);
+    void reset (void);
+
+    int    fact (void) const { return _fact; }
+    float *inp (int c) const { return _buff.get () + c * _step + UPS_NTAP - 1; }
+    void   process (float **out, int nfram);
+
+private:
+
+    int    _nchan;
+    int    _fact;
+    int    _step;
+    std::unique_ptr <float []> _coef;
+    std::unique_ptr <float []> _buff;
+};
+
+
+#endif
@@ -0,0 +1,228 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "wavfile.h"
+
+
+static uint32_t get_u16 (const uint8_t *p) { return p [0] | (p [1] << 8); }
+static uint32_t get_u32 (const uint8_t *p) { return p [0] | (p [1] << 8) | (p [2] << 16) | ((uint32_t) p [3] << 24); }
+
+
+Wavfile::Wavfile (void) :
+    _file (0),
+    _doffs (0),
+    _form (0),
+    _bits (0),
+    _step (0),
+    _rate (0),
+    _nchan (0),
+    _nfram (0),
+    _loop0 (-1),
+    _loop1 (-1)
+{
+}
+
+
+Wavfile::~Wavfile (void)
+{
+    close ();
+}
+
+
+int Wavfile::open (const char *path)
+{
+    uint8_t   h [40];
+    uint32_t  size;
+    bool      fmt;
+
+    close ();
+    _nfram = 0;
+    _loop0 = _loop1 = -1;
+    if (! (_file = fopen (path, "r")))
+    {
+        fprintf (stderr, "Can't open '%s' for reading\n", path);
+        return 1;
+    }
+    if ((fread (h, 1, 12, _file) != 12) || memcmp (h, "RIFF", 4) || memcmp (h + 8, "WAVE", 4))
+    {
+        fprintf (stderr, "File '%s' is not a WAV file\n", path);
+        close ();
+        return 1;
+    }
+
+    fmt = false;
+    _doffs = 0;
+    _form = _bits = _step = 0;
+    while (fread (h, 1, 8, _file) == 8)
+    {
+        size = get_u32 (h + 4);
+        if (! memcmp (h, "fmt ", 4))
+        {
+            if ((size < 16) || (fread (h, 1, (size < 40) ? size : 40, _file) != ((size < 40) ? size : 40)))
+            {
+                break;
+            }
+            if (size > 40) fseek (_file, size - 40, SEEK_CUR);
+            if (size & 1) fseek (_file, 1, SEEK_CUR);
+            _form = get_u16 (h);
+            _nchan = get_u16 (h + 2);
+            _rate = get_u32 (h + 4);
+            _step = get_u16 (h + 12);
+            _bits = get_u16 (h + 14);
+            // Extensible format: the real format is in the subformat GUID.
+            if ((_form == 0xFFFE) && (size >= 26)) _form = get_u16 (h + 24);
+            fmt = true;
+        }
+        else if (! memcmp (h, "data", 4))
+        {
+            if (! fmt || ! _nchan || (_step != _nchan * _bits / 8)
+                || ! (   ((_form == 1) && ((_bits == 16) || (_bits == 24) || (_bits == 32)))
+                      || ((_form == 3) && ((_bits == 32) || (_bits == 64)))))
+            {
+                fprintf (stderr, "File '%s' has an unsupported sample format\n", path);
+                close ();
+                return 1;
+            }
+            _doffs = ftell (_file);
+            _nfram = size / _step;
+            fseek (_file, size + (size & 1), SEEK_CUR);
+        }
+        else if (! memcmp (h, "smpl", 4) && (size >= 60))
+        {
+            // Only the first loop is used. Its end frame is inclusive.
+            if (fread (h, 1, 36, _file) != 36) break;
+            if (get_u32 (h + 28) && (fread (h, 1, 24, _file) == 24))
+            {
+                _loop0 = get_u32 (h + 8);
+                _loop1 = get_u32 (h + 12) + 1;
+                fseek (_file, size + (size & 1) - 60, SEEK_CUR);
+            }
+            else fseek (_file, size + (size & 1) - 36, SEEK_CUR);
+        }
+        else fseek (_file, size + (size & 1), SEEK_CUR);
+    }
+
+    if (! _doffs)
+    {
+        fprintf (stderr, "File '%s' has no audio data\n", path);
+        close ();
+        return 1;
+    }
+    if ((_loop0 < 0) || (_loop1 > _nfram) || (_loop1 <= _loop0)) _loop0 = _loop1 = -1;
+    return 0;
+}
+
+
+int Wavfile::read (float *data, long offs, int nfram, float gain)
+{
+    uint8_t  b [1024];
+    float    d [256];
+    int      i, j, k, n;
+
+    // Reads frames into data, averaging the channels. Returns the
+    // number of frames actually read.
+    if (! _file || (offs < 0) || (offs >= _nfram)) return 0;
+    if (nfram > _nfram - offs) nfram = _nfram - offs;
+    if (fseek (_file, _doffs + offs * _step, SEEK_SET)) return 0;
+    gain /= _nchan;
+    for (n = 0; n < nfram; n += k)
+    {
+        k = nfram - n;
+        if (k > 256 / _nchan) k = 256 / _nchan;
+        if (k > (int)(sizeof (b) / _step)) k = sizeof (b) / _step;
+        if (k == 0) return 0;
+        if ((int) fread (b, _step, k, _file) != k) return n;
+        convert (b, d, k * _nchan);
+        for (i = 0; i < k; i++)
+        {
+            float v = 0;
+            for (j = 0; j < _nchan; j++) v += d [i * _nchan + j];
+            data [n + i] = gain * v;
+        }
+    }
+    return nfram;
+}
+
+
+void Wavfile::close (void)
+{
+    if (_file) fclose (_file);
+    _file = 0;
+}
+
+
+int Wavfile::load (const char *path)
+{
+    uint8_t   *b;
+    long      n;
+
+    if (open (path)) return 1;
+    n = (long) _nfram * _nchan;
+    b = new uint8_t [(size_t) _nfram * _step];
+    fseek (_file, _doffs, SEEK_SET);
+    if (fread (b, _step, _nfram, _file) != (size_t) _nfram)
+    {
+        fprintf (stderr, "File '%s' is truncated\n", path);
+        delete[] b;
+        close ();
+        return 1;
+    }
+    _data = std::make_unique <float []> (n);
+    convert (b, _data.get (), n);
+    delete[] b;
+    close ();
+    return 0;
+}
+
+
+void Wavfile::convert (const uint8_t *b, float *d, long n)
+{
+    long  i;
+
+    for (i = 0; i < n; i++)
+    {
+        const uint8_t *p = b + i * (_bits / 8);
+        if (_form == 3)
+        {
+            if (_bits == 32)
+            {
+                float v;
+                memcpy (&v, p, 4);
+                d [i] = v;
+            }
+            else
+            {
+                double v;
+                memcpy (&v, p, 8);
+                d [i] = v;
+            }
+        }
+        else switch (_bits)
+        {
+        case 16: d [i] = (int16_t) get_u16 (p) / 32768.0f; break;
+        case 24: d [i] = (int32_t)((p [0] << 8) | (p [1] << 16) | ((uint32_t) p [2] << 24)) / 2147483648.0f; break;
+        case 32: d [i] = (int32_t) get_u32 (p) / 2147483648.0f; break;
+        }
+    }
+}
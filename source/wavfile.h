@@ -0,0 +1,75 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+
+#ifndef __WAVFILE_H
+#define __WAVFILE_H
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <memory>
+
+
+// Minimal WAV file reader. Accepts 16, 24 and 32 bit integer and 32
+// and 64 bit float samples, in plain or extensible format. The data
+// is converted to float. Load () reads the whole file and stores it
+// interleaved. Open () reads only the header and the first loop of a
+// 'smpl' chunk, and keeps the file open so that read () can fetch any
+// range of frames, mixed down to mono.
+//
+class Wavfile
+{
+public:
+
+    Wavfile (void);
+    ~Wavfile (void);
+
+    int  load (const char *path);
+    int  open (const char *path);
+    int  read (float *data, long offs, int nfram, float gain);
+    void close (void);
+
+    int          rate (void) const { return _rate; }
+    int          nchan (void) const { return _nchan; }
+    int          nfram (void) const { return _nfram; }
+    int          loop0 (void) const { return _loop0; }
+    int          loop1 (void) const { return _loop1; }
+    const float *data (void) const { return _data.get (); }
+
+private:
+
+    void convert (const uint8_t *b, float *d, long n);
+
+    FILE      *_file;
+    long       _doffs;
+    uint32_t   _form;
+    uint32_t   _bits;
+    uint32_t   _step;
+    int        _rate;
+    int        _nchan;
+    int        _nfram;
+    int        _loop0;
+    int        _loop1;
+    std::unique_ptr <float []> _data;
+};
+
+
+#endif
@@ -176,6 +176,10 @@ void Xiface::handle_mesg (ITC_mesg *M)
         _instrwin->set_tuning ((M_ifc_retune *) M);
         break;
 
+    case MT_IFC_QUALITY:
+        _audiowin->set_quality ((M_ifc_quality *) M);
+        break;
+
     case MT_IFC_EDIT:
         if (! _editp)
 	{
@@ -0,0 +1,624 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+// Microbenchmarks for the synthesis kernels. All inputs are synthetic
+// and fixed, so results are comparable between builds. Each result is
+// printed as one JSON object per line:
+//
+//   {"bench":"...", <parameters>, "iters":N, "ns_per_iter":T, "ns_per_frame":F}
+//
+// where an iteration is one call of the kernel, and ns_per_frame is
+// ns_per_iter divided by the number of output frames per call, if any.
+
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "global.h"
+#include "addsynth.h"
+#include "rankwave.h"
+#include "division.h"
+#include "asection.h"
+#include "reverb.h"
+#include "convolver.h"
+#include "upsampler.h"
+#include "scales.h"
+
+
+extern float exp2ap (float);
+
+
+static float        fsamp = 48000.0f;
+static double       mintime = 0.2;
+static const char  *filter = 0;
+static const char  *profname = 0;
+static int          profile = PROF_FULL;
+static volatile float sink;
+
+
+// Calls f() in batches of increasing size until at least 'mintime'
+// seconds have been spent, and returns the time per call in ns.
+//
+template <typename F>
+static double timeit (F f, long *iters)
+{
+    long    i, n, k;
+    double  t;
+
+    for (i = 0; i < 16; i++) f ();
+    n = 16;
+    k = 0;
+    t = 0;
+    while (t < mintime)
+    {
+        auto t0 = std::chrono::steady_clock::now ();
+        for (i = 0; i < n; i++) f ();
+        auto t1 = std::chrono::steady_clock::now ();
+        t += std::chrono::duration <double> (t1 - t0).count ();
+        k += n;
+        n *= 2;
+    }
+    *iters = k;
+    return 1e9 * t / k;
+}
+
+
+static bool selected (const char *name)
+{
+    return ! filter || strstr (name, filter);
+}
+
+
+static void report (const char *name, const char *param, long iters, double ns, int nframe)
+{
+    printf ("{\"bench\":\"%s\"", name);
+    if (profname) printf (", \"profile\":\"%s\"", profname);
+    printf ("%s%s, \"iters\":%ld, \"ns_per_iter\":%.2f", *param ? ", " : "", param, iters, ns);
+    if (nframe) printf (", \"ns_per_frame\":%.4f", ns / nframe);
+    printf ("}\n");
+    fflush (stdout);
+}
+
+
+// Synthetic stop: nharm harmonics at decreasing levels, some
+// instability, a short attack and release. With all 64 harmonics
+// and the default sample rate this gives all three values of _k_s
+// over the range. With only a few, and decimation enabled, the
+// lower half of the range uses decimated tables.
+//
+static void init_synth (Addsynth *A, int nharm)
+{
+    int h;
+
+    A->reset ();
+    strcpy (A->_filename, "bench.ae0");
+    A->_n_vol.reset (-20.0f);
+    A->_n_ins.reset (1.0f);
+    A->_n_att.reset (0.05f);
+    A->_n_dct.reset (0.10f);
+    A->_n_dcd.reset (2.0f);
+    for (h = 0; h < N_HARM; h++)
+    {
+        A->_h_lev.reset (0.0f);
+        A->_h_lev.setv (h, 0, -6.0f * log2f (h + 1));
+        A->_h_att.setv (h, 0, 0.03f);
+    }
+    // Index 4 is the only breakpoint left by reset ().
+    for (h = nharm; h < N_HARM; h++) A->_h_lev.setv (h, 4, -100.0f);
+    A->_pan = 'C';
+    A->_del = 0;
+}
+
+
+class Bench
+{
+public:
+
+    Bench (void);
+
+    void pipewave_play (void);
+    void rankwave_play (void);
+    void division_process (void);
+    void asection_process (void);
+    void reverb_process (void);
+    void convolver_process (void);
+    void upsampler_process (void);
+    void pipewave_genwave (void);
+    void pipewave_resample (void);
+    void pipewave_looplen (void);
+    void exp2ap_call (void);
+
+private:
+
+    Pipewave *find_pipe (Rankwave *R, int ks, int kd);
+    std::unique_ptr <Rankwave> make_rank (Addsynth *A);
+    void play_states (Pipewave *P);
+
+    Addsynth   _synth;
+    Addsynth   _flute;
+    std::unique_ptr <Rankwave> _rank;
+    std::unique_ptr <Rankwave> _deci;
+    float      _out [NCHANN * PERIOD];
+    float      _noise [PERIOD * 1024];
+};
+
+
+Bench::Bench (void)
+{
+    int       i;
+    uint32_t  r;
+
+    init_synth (&_synth, N_HARM);
+    init_synth (&_flute, 4);
+    Rankwave::set_seed (1);
+    _rank = make_rank (&_synth);
+    Rankwave::set_decimate (true);
+    _deci = make_rank (&_flute);
+    Rankwave::set_decimate (false);
+    for (i = 0, r = 1; i < PERIOD * 1024; i++)
+    {
+        r = 1664525 * r + 1013904223;
+        _noise [i] = 0.1f * (r / 2147483648.0f - 1.0f);
+    }
+}
+
+
+std::unique_ptr <Rankwave> Bench::make_rank (Addsynth *A)
+{
+    auto R = std::make_unique <Rankwave> (A->_n0, A->_n1);
+    R->gen_waves (A, fsamp, 440.0f, scales [8]._data);
+    R->set_param (_out, 0, 'C');
+    return R;
+}
+
+
+Pipewave *Bench::find_pipe (Rankwave *R, int ks, int kd)
+{
+    int        n;
+    Pipewave  *P;
+
+    for (n = R->_n0, P = R->_pipes.get (); n <= R->_n1; n++, P++)
+    {
+        if ((P->_k_s == ks) && (P->_k_d == kd)) return P;
+    }
+    return 0;
+}
+
+
+void Bench::pipewave_play (void)
+{
+    int        k;
+    Pipewave  *P;
+
+    if (! selected ("pipewave_play")) return;
+    for (k = 1; k <= 3; k++)
+    {
+        if ((P = find_pipe (_rank.get (), k, 1))) play_states (P);
+    }
+    for (k = 2; k <= 4; k *= 2)
+    {
+        if ((P = find_pipe (_deci.get (), 1, k))) play_states (P);
+    }
+}
+
+
+void Bench::play_states (Pipewave *P)
+{
+    int        ks, kd;
+    long       iters;
+    double     ns;
+    char       param [64];
+
+    ks = P->_k_s;
+    kd = P->_k_d;
+    P->_link = 0;
+
+    // Attack, restarted when it reaches the loop.
+    P->_sdel = 1;
+    P->_p_p = 0;
+    P->_p_r = 0;
+    ns = timeit ([P] { if (P->_p_p >= P->_p1) P->_p_p = 0; P->play (); }, &iters);
+    sprintf (param, "\"state\":\"attack\", \"k_s\":%d, \"k_d\":%d", ks, kd);
+    report ("pipewave_play", param, iters, ns, PERIOD);
+
+    // Loop, with instability.
+    P->_sdel = 1;
+    P->_p_p = P->_p1;
+    P->_p_r = 0;
+    ns = timeit ([P] { P->play (); }, &iters);
+    sprintf (param, "\"state\":\"loop\", \"k_s\":%d, \"k_d\":%d", ks, kd);
+    report ("pipewave_play", param, iters, ns, PERIOD);
+
+    // Loop, without instability.
+    float d_a = P->_d_a;
+    P->_d_a = 0.0f;
+    P->_z_p = 0.0f;
+    P->_y_p = 0.0f;
+    ns = timeit ([P] { P->play (); }, &iters);
+    sprintf (param, "\"state\":\"steady\", \"k_s\":%d, \"k_d\":%d", ks, kd);
+    report ("pipewave_play", param, iters, ns, PERIOD);
+    P->_d_a = d_a;
+
+    // Release from the loop, with a count that never expires.
+    P->_sdel = 0;
+    P->_p_p = 0;
+    P->_p_r = P->_p1;
+    P->_g_r = 1.0f;
+    P->_y_r = 0.0f;
+    P->_i_r = 30000;
+    ns = timeit ([P] { P->_i_r = 30000; P->_g_r = 1.0f; P->play (); }, &iters);
+    sprintf (param, "\"state\":\"release\", \"k_s\":%d, \"k_d\":%d", ks, kd);
+    report ("pipewave_play", param, iters, ns, PERIOD);
+
+    P->_sdel = 0;
+    P->_p_p = 0;
+    P->_p_r = 0;
+}
+
+
+void Bench::rankwave_play (void)
+{
+    static const int nvoice [] = { 1, 4, 16, 61 };
+
+    int     i, k, n;
+    long    iters;
+    double  ns;
+    char    param [64];
+
+    if (! selected ("rankwave_play")) return;
+    for (i = 0; i < 4; i++)
+    {
+        auto R = make_rank (&_synth);
+        n = nvoice [i];
+        // Spread the voices over the keyboard.
+        for (k = 0; k < n; k++) R->note_on (R->_n0 + (k * 61) / n);
+        for (k = 0; k < 200; k++) R->play (1);
+        ns = timeit ([&R] { R->play (1); }, &iters);
+        sprintf (param, "\"voices\":%d", n);
+        report ("rankwave_play", param, iters, ns, PERIOD);
+    }
+}
+
+
+void Bench::division_process (void)
+{
+    static const char *names [] = { "plain", "tremulant", "swell", "tremulant+swell", "empty", "premix" };
+
+    int     i, k, r, v;
+    long    iters;
+    double  ns;
+    char    param [64];
+    float   *out [NCHANN];
+    float   buff [NCHANN * PERIOD];
+
+    if (! selected ("division_process")) return;
+    for (k = 0; k < NCHANN; k++) out [k] = buff + k * PERIOD;
+    for (i = 0; i < 6; i++)
+    {
+        Asection A (fsamp);
+        Division D (&A, fsamp);
+        D.set_div_mask (0);
+        D.set_tfreq (4.5f);
+        D.set_tmodd (0.3f);
+        // Four ranks, three notes each, or no ranks at all to
+        // measure only the gain, tremulant and swell stage. The
+        // ranks are identical, so a premix merges them into one.
+        for (r = 0; r < ((i != 4) ? 4 : 0); r++)
+        {
+            D.set_rank (r, make_rank (&_synth), 'C', 0);
+            D.set_rank_mask (r, NKEYBD);
+        }
+        v = (i != 4) ? 12 : 0;
+        uint16_t keys [NNOTES] = { };
+        if (i == 5)
+        {
+            // Settle the stops, install the premix, then play.
+            D.update (keys);
+            Premix *M = new Premix ();
+            if (D.get_premix (M))
+            {
+                M->compile ();
+                M = D.set_premix (M);
+            }
+            delete M;
+            D.update (24, 1);
+            D.update (28, 1);
+            D.update (31, 1);
+            v = 3;
+        }
+        else
+        {
+            keys [24] = keys [28] = keys [31] = 1;
+            D.update (keys);
+        }
+        if (i & 1) D.trem_on ();
+        if (i & 2) D.set_swell (0.5f);
+        for (k = 0; k < 200; k++) D.process (out);
+        ns = timeit ([&D, &out] { D.process (out); }, &iters);
+        sprintf (param, "\"mode\":\"%s\", \"ranks\":%d, \"voices\":%d", names [i], (i != 4) ? 4 : 0, v);
+        report ("division_process", param, iters, ns, PERIOD);
+    }
+}
+
+
+void Bench::asection_process (void)
+{
+    int     i;
+    long    iters;
+    double  ns;
+    float   W [PERIOD], X [PERIOD], Y [PERIOD], R [PERIOD];
+
+    if (! selected ("asection_process")) return;
+    Asection A (fsamp);
+    A.set_size (0.075f);
+    A.set_ntaps ((profile == PROF_FULL) ? 16 : 8);
+    i = 0;
+    ns = timeit ([&] {
+        float *p = A.get_wptr ();
+        for (int c = 0; c < NCHANN; c++)
+        {
+            memcpy (p + c * PERIOD * MIXLEN, _noise + ((i + c) & 1023) * PERIOD, PERIOD * sizeof (float));
+        }
+        i++;
+        A.process (0.3f, W, X, Y, R);
+    }, &iters);
+    sink = W [0] + X [0] + Y [0] + R [0];
+    report ("asection_process", "", iters, ns, PERIOD);
+}
+
+
+void Bench::reverb_process (void)
+{
+    int     i;
+    long    iters;
+    double  ns;
+    float   W [PERIOD], X [PERIOD], Y [PERIOD], Z [PERIOD];
+
+    if (! selected ("reverb_process")) return;
+    Reverb V (fsamp);
+    V.set_t60mf (4.0f);
+    V.set_t60lo (6.0f, 250.0f);
+    V.set_t60hi (2.0f, 3e3f);
+    V.set_delay (0.075f);
+    V.set_reduced (profile == PROF_LITE);
+    memset (W, 0, sizeof (W));
+    memset (X, 0, sizeof (X));
+    memset (Y, 0, sizeof (Y));
+    memset (Z, 0, sizeof (Z));
+    i = 0;
+    ns = timeit ([&] { V.process (PERIOD, 0.3f, _noise + (i++ & 1023) * PERIOD, W, X, Y, Z); }, &iters);
+    sink = W [0] + Z [0];
+    report ("reverb_process", "", iters, ns, PERIOD);
+}
+
+
+// Convolver with a 4 channel, 2 second synthetic IR. No worker
+// threads, so all partition levels are computed in the timed call,
+// and the time per frame is the total cost.
+//
+void Bench::convolver_process (void)
+{
+    int     i, n;
+    long    iters;
+    double  ns;
+    char    param [64];
+    float   W [PERIOD], X [PERIOD], Y [PERIOD], Z [PERIOD];
+
+    if (! selected ("convolver_process")) return;
+    n = (int)(2 * fsamp);
+    auto ir = std::make_unique <float []> (4 * n);
+    for (i = 0; i < 4 * n; i++) ir [i] = _noise [i & (PERIOD * 1024 - 1)] * expf (-3.0f * i / (4 * n));
+    Convolver C (ir.get (), 4, n);
+    memset (W, 0, sizeof (W));
+    memset (X, 0, sizeof (X));
+    memset (Y, 0, sizeof (Y));
+    memset (Z, 0, sizeof (Z));
+    i = 0;
+    ns = timeit ([&] { C.process (0.3f, _noise + (i++ & 1023) * PERIOD, W, X, Y, Z); }, &iters);
+    sink = W [0] + Z [0];
+    sprintf (param, "\"ir_frames\":%d, \"ir_chans\":4", n);
+    report ("convolver_process", param, iters, ns, PERIOD);
+}
+
+
+void Bench::upsampler_process (void)
+{
+    int     i, k;
+    long    iters;
+    double  ns;
+    char    param [64];
+    float   out [2][4 * PERIOD];
+    float   *outp [2] = { out [0], out [1] };
+
+    if (! selected ("upsampler_process")) return;
+    for (k = 2; k <= 4; k *= 2)
+    {
+        Upsampler U;
+        U.init (2, k, PERIOD);
+        i = 0;
+        ns = timeit ([&] {
+            std::copy_n (_noise + (i++ & 1023) * PERIOD, PERIOD, U.inp (0));
+            std::copy_n (_noise + (i & 1023) * PERIOD, PERIOD, U.inp (1));
+            U.process (outp, PERIOD);
+	}, &iters);
+        sink = out [0][0] + out [1][0];
+        sprintf (param, "\"factor\":%d, \"chans\":2", k);
+        report ("upsampler_process", param, iters, ns, k * PERIOD);
+    }
+}
+
+
+void Bench::pipewave_genwave (void)
+{
+    static const int notes [] = { 0, 24, 48 };
+
+    int     i, n;
+    long    iters;
+    double  ns;
+    char    param [64];
+
+    if (! selected ("pipewave_genwave")) return;
+    Pipewave::initstatic (fsamp);
+    auto R = std::make_unique <Rankwave> (_synth._n0, _synth._n1);
+    for (i = 0; i < 3; i++)
+    {
+        n = notes [i];
+        Pipewave *P = R->_pipes.get () + n;
+        float fpipe = 440.0f * exp2ap ((n + _synth._n0 - 69) / 12.0f);
+        ns = timeit ([&] { P->genwave (&_synth, n, fsamp, fpipe); }, &iters);
+        sprintf (param, "\"note\":%d, \"k_s\":%d, \"l0\":%d, \"l1\":%d", n + _synth._n0, P->_k_s, P->_l0, P->_l1);
+        report ("pipewave_genwave", param, iters, ns, 0);
+    }
+}
+
+
+// Tables converted from fsamp to 44.1 kHz, or to 48 kHz if that is
+// fsamp. The time includes restoring the original table.
+//
+void Bench::pipewave_resample (void)
+{
+    static const int notes [] = { 0, 24, 48 };
+
+    int     i, k, n;
+    long    iters;
+    double  ns;
+    float   fb;
+    char    param [96];
+
+    if (! selected ("pipewave_resample")) return;
+    Pipewave::initstatic (fsamp);
+    Pipewave::initresamp ();
+    fb = (fsamp == 44100.0f) ? 48000.0f : 44100.0f;
+    auto R = std::make_unique <Rankwave> (_synth._n0, _synth._n1);
+    for (i = 0; i < 3; i++)
+    {
+        n = notes [i];
+        Pipewave *Q = R->_pipes.get () + n;
+        Q->genwave (&_synth, n, fsamp, 440.0f * exp2ap ((n + _synth._n0 - 69) / 12.0f));
+        k = Q->_l0 + Q->_l1 + Q->_k_s * (PERIOD + 4);
+        Pipewave *P = R->_pipes.get () + n + 1;
+        ns = timeit ([&]
+        {
+            P->_p0 = std::make_unique <float []> (k);
+            std::copy_n (Q->_p0.get (), k, P->_p0.get ());
+            P->_l0 = Q->_l0;
+            P->_l1 = Q->_l1;
+            P->_k_s = Q->_k_s;
+            P->_k_d = Q->_k_d;
+            P->_n_c = Q->_n_c;
+            P->_k_r = Q->_k_r;
+            P->_p1 = P->_p0.get () + P->_l0;
+            P->resample (fsamp, fb);
+        }, &iters);
+        sprintf (param, "\"note\":%d, \"k_s\":%d, \"l0\":%d, \"l1\":%d, \"to\":%d", n + _synth._n0, P->_k_s, P->_l0, P->_l1, (int) fb);
+        report ("pipewave_resample", param, iters, ns, 0);
+    }
+}
+
+
+void Bench::pipewave_looplen (void)
+{
+    long    iters;
+    double  ns;
+    int     n, a, b;
+
+    if (! selected ("pipewave_looplen")) return;
+    n = 0;
+    ns = timeit ([&] {
+        float f = 440.0f * exp2ap ((n++ % 61 - 33) / 12.0f);
+        Pipewave::looplen (f, fsamp, (int)(fsamp / 6.0f), &a, &b);
+    }, &iters);
+    sink = a + b;
+    report ("pipewave_looplen", "\"notes\":61", iters, ns, 0);
+}
+
+
+void Bench::exp2ap_call (void)
+{
+    long    iters;
+    double  ns;
+
+    if (! selected ("exp2ap")) return;
+    ns = timeit ([&] {
+        float s = 0;
+        for (int i = 0; i < 1024; i++) s += exp2ap (10.0f * _noise [i]);
+        sink = s;
+    }, &iters);
+    report ("exp2ap", "\"calls\":1024", iters, ns / 1024, 0);
+}
+
+
+static void help (void)
+{
+    fprintf (stderr, "\nAeolus kernel benchmarks %s\n\n", VERSION);
+    fprintf (stderr, "Usage: aeolus_bench <options> [name]\n");
+    fprintf (stderr, "Options:\n");
+    fprintf (stderr, "  -h                 Display this text\n");
+    fprintf (stderr, "  -r <rate>          Sample rate [48000]\n");
+    fprintf (stderr, "  -t <seconds>       Minimum time per benchmark [0.2]\n");
+    fprintf (stderr, "  -Q <profile>       Quality profile: full, balanced, lite\n");
+    fprintf (stderr, "Only benchmarks containing [name] are run.\n");
+    exit (1);
+}
+
+
+int main (int ac, char *av [])
+{
+    int k;
+
+    while ((k = getopt (ac, av, "hr:t:Q:")) != -1)
+    {
+        switch (k)
+        {
+        case 'r' : fsamp = atof (optarg); break;
+        case 't' : mintime = atof (optarg); break;
+        case 'Q' :
+            profname = optarg;
+            if      (! strcmp (optarg, "full"))     profile = PROF_FULL;
+            else if (! strcmp (optarg, "balanced")) profile = PROF_BALANCED;
+            else if (! strcmp (optarg, "lite"))     profile = PROF_LITE;
+            else help ();
+            break;
+        default: help ();
+        }
+    }
+    Rankwave::set_profile (profile);
+    if (ac - optind > 1) help ();
+    if (ac - optind == 1) filter = av [optind];
+
+    Bench B;
+    B.pipewave_play ();
+    B.rankwave_play ();
+    B.division_process ();
+    B.asection_process ();
+    B.reverb_process ();
+    B.convolver_process ();
+    B.upsampler_process ();
+    B.pipewave_genwave ();
+    B.pipewave_resample ();
+    B.pipewave_looplen ();
+    B.exp2ap_call ();
+    return 0;
+}
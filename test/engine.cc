@@ -0,0 +1,349 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+// Test of the parts of Aeolus that need its threads, using libaeolus.
+// The instrument is played from a copy of the stops directory with an
+// empty waves directory, and the output compared between runs that
+// must give the same result:
+//
+//   cache   The instrument read from its definition, which writes the
+//           cached instrument '<instr>.ae2', and read again from that.
+//
+//   swap    Another instrument opened first and replaced by the one
+//           tested, as with the 'i' command of the text mode UI, with
+//           a stop and a preset set while it is being built. It must
+//           play as when it is opened by itself.
+//
+// The same notes are played each time, and the seed makes the tables
+// and the instability of the pipes the same. Stops are set while no
+// periods are processed, so they are in use from the same period in
+// each run.
+//
+// It needs libclthreads, and is run by 'make check_engine' in source/,
+// or by ctest.
+
+
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "global.h"
+#include "engine.h"
+#include "rankwave.h"
+
+
+#define FSAMP  48000
+#define NPLAY  2
+#define WAIT   100000
+#define XFADE  200      // periods, more than the crossfade of the swap
+
+
+static const char  *stopsdir;
+static const char  *instr;
+static const char  *instr2;
+static char         tmpdir [1024];
+
+
+// Copy the stops directory into tmpdir: the instrument directories
+// are copied, as presets are written into them, the rest is linked,
+// and the waves directory is left empty.
+//
+static int copyfile (const char *src, const char *dst)
+{
+    FILE  *F, *G;
+    char  buff [4096];
+    int   n;
+
+    if (! (F = fopen (src, "r"))) return 1;
+    if (! (G = fopen (dst, "w")))
+    {
+        fclose (F);
+        return 1;
+    }
+    while ((n = fread (buff, 1, 4096, F)) > 0) fwrite (buff, 1, n, G);
+    fclose (F);
+    return fclose (G);
+}
+
+
+static int makestops (void)
+{
+    DIR            *D, *E;
+    struct dirent  *P, *Q;
+    struct stat    S;
+    char           src [1300], dst [1300], s [1600], d [PATH_MAX];
+    int            err;
+
+    strcpy (tmpdir, "/tmp/aeolus-engine-XXXXXX");
+    if (! mkdtemp (tmpdir) || ! (D = opendir (stopsdir)))
+    {
+        fprintf (stderr, "Can't copy '%s'\n", stopsdir);
+        *tmpdir = 0;
+        return 1;
+    }
+    err = 0;
+    while (! err && (P = readdir (D)))
+    {
+        if (*P->d_name == '.' || ! strcmp (P->d_name, "waves")) continue;
+        snprintf (src, sizeof (src), "%s/%s", stopsdir, P->d_name);
+        snprintf (dst, sizeof (dst), "%s/%s", tmpdir, P->d_name);
+        snprintf (s, sizeof (s), "%s/definition", src);
+        if (! stat (s, &S) && (E = opendir (src)))
+	{
+            err = mkdir (dst, 0755);
+            while (! err && (Q = readdir (E)))
+	    {
+                if (*Q->d_name == '.') continue;
+                snprintf (s, sizeof (s), "%s/%s", src, Q->d_name);
+                snprintf (d, sizeof (d), "%s/%s", dst, Q->d_name);
+                err = copyfile (s, d);
+	    }
+            closedir (E);
+	}
+        else err = ! realpath (src, d) || symlink (d, dst);
+    }
+    closedir (D);
+    snprintf (dst, sizeof (dst), "%s/waves", tmpdir);
+    if (err || mkdir (dst, 0755))
+    {
+        fprintf (stderr, "Can't copy '%s'\n", stopsdir);
+        return 1;
+    }
+    return 0;
+}
+
+
+static void removeall (const char *path)
+{
+    DIR            *D;
+    struct dirent  *P;
+    struct stat    S;
+    char           name [1300];
+
+    if (lstat (path, &S)) return;
+    if (S_ISDIR (S.st_mode) && (D = opendir (path)))
+    {
+        while ((P = readdir (D)))
+	{
+            if (! strcmp (P->d_name, ".") || ! strcmp (P->d_name, "..")) continue;
+            snprintf (name, sizeof (name), "%s/%s", path, P->d_name);
+            removeall (name);
+	}
+        closedir (D);
+        rmdir (path);
+    }
+    else unlink (path);
+}
+
+
+// Process periods until the engine is ready, or for at most 60 s.
+//
+static int waitready (Engine *E, float **out)
+{
+    int  i;
+
+    for (i = 0; (i < 6000) && ! E->ready (); i++)
+    {
+        usleep (10000);
+        E->process (PERIOD, out);
+    }
+    if (! E->ready ())
+    {
+        fprintf (stderr, "The instrument was not ready in time\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+// Draw the first stop of each group, play a chord on each keyboard,
+// and record the output until after the release.
+//
+static void play (Engine *E, std::vector <float> &rec)
+{
+    int     g, i, j, k;
+    float   L [PERIOD], R [PERIOD];
+    float   *out [NPLAY] = { L, R };
+
+    for (g = 0; g < E->ngroup (); g++)
+    {
+        for (i = 0; i < E->nifelm (g); i++) E->set_stop (g, i, i == 0);
+    }
+    usleep (WAIT);
+    rec.clear ();
+    for (k = 0; k < NKEYBD; k++)
+    {
+        E->key_event (0, k, 24, true);
+        E->key_event (0, k, 31, true);
+        E->key_event (0, k, 40, true);
+    }
+    for (i = 0; i < 1000; i++)
+    {
+        if (i == 600)
+	{
+            for (k = 0; k < NKEYBD; k++)
+	    {
+                E->key_event (0, k, 24, false);
+                E->key_event (0, k, 31, false);
+                E->key_event (0, k, 40, false);
+	    }
+	}
+        E->process (PERIOD, out);
+        for (j = 0; j < PERIOD; j++)
+	{
+            rec.push_back (L [j]);
+            rec.push_back (R [j]);
+	}
+    }
+}
+
+
+static int run (const char *name, std::vector <float> &rec)
+{
+    Engine  E;
+    float   L [PERIOD], R [PERIOD];
+    float   *out [NPLAY] = { L, R };
+
+    if (E.open (tmpdir, name, FSAMP))
+    {
+        fprintf (stderr, "Can't open the engine\n");
+        return 1;
+    }
+    if (waitready (&E, out)) return 1;
+    play (&E, rec);
+    E.close ();
+    return 0;
+}
+
+
+static int compare (const char *test, const std::vector <float> &A, const std::vector <float> &B)
+{
+    size_t  i;
+    double  e, peak, emax;
+
+    peak = emax = 0;
+    for (i = 0; i < A.size (); i++)
+    {
+        e = fabs (A [i] - B [i]);
+        if (fabs (A [i]) > peak) peak = fabs (A [i]);
+        if (e > emax) emax = e;
+    }
+    if ((peak == 0) || (emax > 0))
+    {
+        printf ("%s: FAIL: peak %.4e, max error %.4e\n", test, peak, emax);
+        return 1;
+    }
+    printf ("%s: PASS: peak %.4e\n", test, peak);
+    return 0;
+}
+
+
+static int test_cache (std::vector <float> &A)
+{
+    std::vector <float>  B;
+    struct stat          S;
+    char                 name [1300];
+
+    if (run (instr, A)) return 1;
+    snprintf (name, sizeof (name), "%s/waves/%s.ae2", tmpdir, instr);
+    if (stat (name, &S))
+    {
+        printf ("cache: FAIL: '%s.ae2' was not written\n", instr);
+        return 1;
+    }
+    // It is written to a temporary file first, which must be gone.
+    snprintf (name, sizeof (name), "%s/waves/%s.ae2.%d", tmpdir, instr, (int) getpid ());
+    if (! stat (name, &S))
+    {
+        printf ("cache: FAIL: '%s.ae2.%d' was left\n", instr, (int) getpid ());
+        return 1;
+    }
+    if (run (instr, B)) return 1;
+    return compare ("cache", A, B);
+}
+
+
+static int test_swap (const std::vector <float> &A)
+{
+    Engine               E;
+    std::vector <float>  B;
+    int                  i;
+    float                L [PERIOD], R [PERIOD];
+    float                *out [NPLAY] = { L, R };
+
+    if (E.open (tmpdir, instr2, FSAMP))
+    {
+        fprintf (stderr, "Can't open the engine\n");
+        return 1;
+    }
+    if (waitready (&E, out)) return 1;
+    E.load_instr (instr);
+    // Wait for the model to start building it, then until it is
+    // ready and the crossfade is done.
+    for (i = 0; (i < 6000) && E.ready (); i++)
+    {
+        usleep (10000);
+        E.process (PERIOD, out);
+    }
+    // Stops and presets can't be changed meanwhile, but must not
+    // do any harm.
+    E.set_stop (0, 0, true);
+    E.recall (0, 0);
+    if (waitready (&E, out)) return 1;
+    for (i = 0; i < XFADE; i++) E.process (PERIOD, out);
+    play (&E, B);
+    E.close ();
+    return compare ("swap", A, B);
+}
+
+
+static void help (void)
+{
+    fprintf (stderr, "\nAeolus engine test %s\n\n", VERSION);
+    fprintf (stderr, "Usage: aeolus_engtest <stops dir> <instrument> [<other instrument>]\n");
+    exit (1);
+}
+
+
+int main (int ac, char *av [])
+{
+    int                  k;
+    std::vector <float>  A;
+
+    if ((ac < 3) || (ac > 4)) help ();
+    stopsdir = av [1];
+    instr = av [2];
+    instr2 = (ac > 3) ? av [3] : 0;
+    Rankwave::set_seed (1);
+    if (makestops ())
+    {
+        if (*tmpdir) removeall (tmpdir);
+        return 1;
+    }
+    k = test_cache (A);
+    if (! k && instr2) k = test_swap (A);
+    removeall (tmpdir);
+    return k;
+}
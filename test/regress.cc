@@ -0,0 +1,656 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//    
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+// Offline golden-output test. Renders a scripted sequence of stops
+// and notes through the complete synthesis chain (rankwaves, divisions,
+// audio sections and reverb), without any threads or audio system,
+// and compares the resulting W,X,Y,Z signals with a stored reference.
+//
+// The references are written by a build with the compiler flags of
+// source/Makefile, which CMakeLists.txt uses as well, and such a build
+// reproduces them exactly (-t 0). Other compilers and CPUs round some
+// results differently with -ffast-math, which the default tolerance of
+// 1e-4 of the peak level allows for.
+//
+// Script commands, one per line, '#' starts a comment:
+//
+//   fsamp   <rate>                 Sample rate, must come first.
+//   seed    <n>                    Random seed, default 1.
+//   release <dB>                   Release floor as the -T option, default off.
+//   voices  <n>                    Voice limit per rank as -V, default none.
+//   profile <name>                 Quality profile as -Q: full, balanced or lite.
+//   tuning  <freq> <temp>          Base frequency and temperament index.
+//   reverb  <size> <time>          Reverb size and time.
+//   volume  <vol>                  Output volume.
+//   samples <dir>                  Sampled pipes, relative to the stops directory.
+//   upsample <fact>                Upsample the output as with -U, by 2 or 4.
+//   divis   <asect>                Add a division using audio section <asect>.
+//   rank    <divis> <pan> <del> <file> [<tables> [<rate>]]
+//                                  Add a rank to a division, as in /rank. The
+//                                  wavetables are computed (gen, the default),
+//                                  or computed at <rate> and then loaded from
+//                                  an .ae1 file (file), a bundle (bundle) or
+//                                  the shared store (store).
+//   trem    <divis> <freq> <depth> Tremulant parameters.
+//   at      <period>               Following events happen at this period.
+//   stop    <divis> <rank> on|off  Registration.
+//   key     <note> on|off          Keyboard 0, note 0..60.
+//   swell   <divis> <value>        Swell position, 0..1.
+//   tremul  <divis> on|off         Tremulant on or off.
+//   premix  <divis>                Merge the drawn ranks, as with -P.
+//   end     <period>               Total length of the rendering.
+
+
+#include <algorithm>
+#include <memory>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "global.h"
+#include "addsynth.h"
+#include "bundle.h"
+#include "rankwave.h"
+#include "division.h"
+#include "diskstream.h"
+#include "asection.h"
+#include "reverb.h"
+#include "scales.h"
+#include "tabstore.h"
+#include "upsampler.h"
+
+
+#define NCHOUT 4
+#define MAXEVT 1024
+
+
+enum { EV_STOP, EV_KEY, EV_SWELL, EV_TREM, EV_PREMIX };
+enum { TB_GEN, TB_FILE, TB_BUNDLE, TB_STORE };
+
+
+struct Event
+{
+    int    _time;
+    int    _type;
+    int    _divis;
+    int    _index;
+    float  _value;
+};
+
+
+struct Refhdr
+{
+    char     _magic [8];
+    int32_t  _fsamp;
+    int32_t  _nchan;
+    int32_t  _nfram;
+    int32_t  _spare;
+};
+
+
+static const char *stopsdir;
+static int         fsamp = 0;
+static uint32_t    seed = 1;
+static float       relfloor = 0.0f;
+static int         maxvoice = 0;
+static int         profile = PROF_FULL;
+static float       fbase = 440.0f;
+static int         itemp = 8;
+static float       revsize = 0.075f;
+static float       revtime = 4.0f;
+static float       volume = 0.32f;
+static char        smpdir [1024] = "";
+static char        tmpdir [1024] = "";
+static int         upsfact = 1;
+static int         nasect = 0;
+static int         ndivis = 0;
+static int         nevent = 0;
+static int         nperiod = 0;
+static int         dasect [NDIVIS];
+static int         nranks [NDIVIS];
+static Addsynth    synths [NDIVIS][NRANKS];
+static int         tables [NDIVIS][NRANKS];
+static int         trates [NDIVIS][NRANKS];
+static float       tfreq [NDIVIS];
+static float       tmodd [NDIVIS];
+static Event       events [MAXEVT];
+static uint16_t    keymap [NNOTES];
+static Bundle      bundles [NDIVIS][NRANKS];
+static Tabstore    store;
+
+
+static int readscript (const char *file)
+{
+    FILE   *F;
+    char   line [1024], s [256];
+    char   *p;
+    int    lnum, time, d, r, k;
+    float  v, w;
+    bool   err;
+    Event  *E;
+
+    if (! (F = fopen (file, "r")))
+    {
+        fprintf (stderr, "Can't open '%s' for reading\n", file);
+        return 1;
+    }
+
+    lnum = 0;
+    time = 0;
+    err = false;
+    while (! err && fgets (line, 1024, F))
+    {
+        lnum++;
+        if ((p = strchr (line, '#'))) *p = 0;
+        if (sscanf (line, "%255s", s) != 1) continue;
+        p = line + strspn (line, " \t") + strlen (s);
+
+        if      (! strcmp (s, "fsamp"))  err = (sscanf (p, "%d", &fsamp) != 1) || (fsamp < 8000);
+        else if (! strcmp (s, "seed"))   err = (sscanf (p, "%u", &seed) != 1);
+        else if (! strcmp (s, "release")) err = (sscanf (p, "%f", &relfloor) != 1);
+        else if (! strcmp (s, "voices")) err = (sscanf (p, "%d", &maxvoice) != 1) || (maxvoice < 0);
+        else if (! strcmp (s, "profile"))
+	{
+            err = (sscanf (p, "%255s", s) != 1);
+            if      (err) ;
+            else if (! strcmp (s, "full"))     profile = PROF_FULL;
+            else if (! strcmp (s, "balanced")) profile = PROF_BALANCED;
+            else if (! strcmp (s, "lite"))     profile = PROF_LITE;
+            else err = true;
+	}
+        else if (! strcmp (s, "tuning")) err = (sscanf (p, "%f %d", &fbase, &itemp) != 2) || (itemp < 0) || (itemp >= NSCALES);
+        else if (! strcmp (s, "reverb")) err = (sscanf (p, "%f %f", &revsize, &revtime) != 2);
+        else if (! strcmp (s, "volume")) err = (sscanf (p, "%f", &volume) != 1);
+        else if (! strcmp (s, "samples"))
+	{
+            err = (sscanf (p, "%255s", s) != 1);
+            if (! err) snprintf (smpdir, 1024, "%s/%s", stopsdir, s);
+	}
+        else if (! strcmp (s, "upsample")) err = (sscanf (p, "%d", &upsfact) != 1) || ((upsfact != 2) && (upsfact != 4));
+        else if (! strcmp (s, "divis"))
+        {
+            err = (ndivis == NDIVIS) || (sscanf (p, "%d", &d) != 1) || (d < 0) || (d >= NASECT);
+            if (! err)
+            {
+                dasect [ndivis] = d;
+                tfreq [ndivis] = 4.5f;
+                tmodd [ndivis] = 0.3f;
+                if (nasect <= d) nasect = d + 1;
+                ndivis++;
+            }
+        }
+        else if (! strcmp (s, "rank"))
+        {
+            char c, t [16];
+            int  n;
+            *t = 0;
+            n = sscanf (p, "%d %c %d %255s %15s %d", &d, &c, &k, s, t, &r);
+            err = (n < 4) || (d < 0) || (d >= ndivis) || (nranks [d] == NRANKS);
+            if (! err)
+            {
+                Addsynth *A = &synths [d][nranks [d]];
+                snprintf (A->_filename, sizeof (A->_filename), "%s", s);
+                if      ((n < 5) || ! strcmp (t, "gen")) tables [d][nranks [d]] = TB_GEN;
+                else if (! strcmp (t, "file"))   tables [d][nranks [d]] = TB_FILE;
+                else if (! strcmp (t, "bundle")) tables [d][nranks [d]] = TB_BUNDLE;
+                else if (! strcmp (t, "store"))  tables [d][nranks [d]] = TB_STORE;
+                else err = true;
+                trates [d][nranks [d]] = (n == 6) ? r : 0;
+                if (err || A->load (stopsdir)) err = true;
+                else
+                {
+                    A->_pan = c;
+                    A->_del = k;
+                    nranks [d]++;
+                }
+            }
+        }
+        else if (! strcmp (s, "trem"))
+        {
+            err = (sscanf (p, "%d %f %f", &d, &v, &w) != 3) || (d < 0) || (d >= ndivis);
+            if (! err)
+            {
+                tfreq [d] = v;
+                tmodd [d] = w;
+            }
+        }
+        else if (! strcmp (s, "at"))  err = (sscanf (p, "%d", &time) != 1) || (time < nperiod);
+        else if (! strcmp (s, "end")) err = (sscanf (p, "%d", &nperiod) != 1) || (nperiod < time);
+        else
+        {
+            if (nevent == MAXEVT)
+            {
+                fprintf (stderr, "%s:%d: too many events\n", file, lnum);
+                fclose (F);
+                return 1;
+            }
+            E = events + nevent;
+            E->_time = time;
+            E->_value = 0;
+            if (! strcmp (s, "stop"))
+            {
+                E->_type = EV_STOP;
+                err = (sscanf (p, "%d %d %255s", &d, &r, s) != 3) || (d < 0) || (d >= ndivis) || (r < 0) || (r >= nranks [d]);
+                E->_divis = d;
+                E->_index = r;
+                E->_value = strcmp (s, "on") ? 0 : 1;
+            }
+            else if (! strcmp (s, "key"))
+            {
+                E->_type = EV_KEY;
+                err = (sscanf (p, "%d %255s", &k, s) != 2) || (k < 0) || (k >= NNOTES);
+                E->_divis = 0;
+                E->_index = k;
+                E->_value = strcmp (s, "on") ? 0 : 1;
+            }
+            else if (! strcmp (s, "swell"))
+            {
+                E->_type = EV_SWELL;
+                err = (sscanf (p, "%d %f", &d, &v) != 2) || (d < 0) || (d >= ndivis);
+                E->_divis = d;
+                E->_value = v;
+            }
+            else if (! strcmp (s, "premix"))
+            {
+                E->_type = EV_PREMIX;
+                err = (sscanf (p, "%d", &d) != 1) || (d < 0) || (d >= ndivis);
+                E->_divis = d;
+            }
+            else if (! strcmp (s, "tremul"))
+            {
+                E->_type = EV_TREM;
+                err = (sscanf (p, "%d %255s", &d, s) != 2) || (d < 0) || (d >= ndivis);
+                E->_divis = d;
+                E->_value = strcmp (s, "on") ? 0 : 1;
+            }
+            else err = true;
+            nevent++;
+        }
+    }
+    fclose (F);
+
+    if (err)
+    {
+        fprintf (stderr, "%s:%d: syntax error\n", file, lnum);
+        return 1;
+    }
+    if (! fsamp || ! ndivis || ! nperiod)
+    {
+        fprintf (stderr, "%s: fsamp, divis and end are required\n", file);
+        return 1;
+    }
+    return 0;
+}
+
+
+// Make the wavetables of a rank the way Aeolus gets them. Except for
+// 'gen' they are computed at their rate, written to the temporary
+// directory and loaded from there, and converted if the rate differs.
+//
+static int maketables (Rankwave *R, Addsynth *A, int d, int r)
+{
+    int         rate;
+    float       *scale;
+    char        name [BND_NAME + 4], file [1100], path [1100];
+    char        *p;
+    const char  *m, *f;
+    const char  *data;
+    size_t      size;
+
+    scale = scales [itemp]._data;
+    rate = trates [d][r] ? trates [d][r] : fsamp;
+    if (tables [d][r] == TB_GEN)
+    {
+        R->gen_waves (A, fsamp, fbase, scale);
+        return 0;
+    }
+    if (! *tmpdir)
+    {
+        strcpy (tmpdir, "/tmp/aeolus-regress-XXXXXX");
+        if (! mkdtemp (tmpdir))
+	{
+            fprintf (stderr, "Can't create a temporary directory\n");
+            *tmpdir = 0;
+            return 1;
+	}
+    }
+
+    std::unique_ptr <Rankwave> T = std::make_unique <Rankwave> (A->_n0, A->_n1);
+    T->gen_waves (A, rate, fbase, scale);
+    switch (tables [d][r])
+    {
+    case TB_FILE:
+        if (T->save (tmpdir, A, rate, fbase, scale)) return 1;
+        return R->load (tmpdir, A, fsamp, fbase, scale);
+
+    case TB_BUNDLE:
+        // A bundle for each rank, holding only its .ae1 file.
+        if (T->save (tmpdir, A, rate, fbase, scale)) return 1;
+        snprintf (name, BND_NAME - 4, "%s", A->_filename);
+        if ((p = strrchr (name, '.'))) *p = 0;
+        snprintf (file, 1100, "%s/%s.ae1", tmpdir, name);
+        snprintf (path, 1100, "%s/%s-%d-%d.aeb", tmpdir, name, d, r);
+        strcat (name, ".ae1");
+        m = name;
+        f = file;
+        if (Bundle::write (path, 1, &m, &f) || bundles [d][r].open (path)) return 1;
+        if (! (data = bundles [d][r].find (name, &size))) return 1;
+        return R->load (name, data, size, A, fsamp, fbase, scale);
+
+    case TB_STORE:
+        if (! store.isopen () && store.open (tmpdir)) return 1;
+        if (! (data = store.insert (Rankwave::tabkey (A, rate, fbase, scale), T.get (), rate, fbase, scale, &size))) return 1;
+        return R->load (A->_filename, data, size, A, fsamp, fbase, scale);
+    }
+    return 1;
+}
+
+
+// Remove the temporary directory, when no rank uses its tables.
+//
+static void cleanup (void)
+{
+    DIR            *D;
+    struct dirent  *E;
+    char           name [1300];
+
+    store.close ();
+    for (int d = 0; d < NDIVIS; d++)
+    {
+        for (int r = 0; r < NRANKS; r++) bundles [d][r].close ();
+    }
+    if (! *tmpdir || ! (D = opendir (tmpdir))) return;
+    while ((E = readdir (D)))
+    {
+        if (*E->d_name == '.') continue;
+        snprintf (name, sizeof (name), "%s/%s", tmpdir, E->d_name);
+        unlink (name);
+    }
+    closedir (D);
+    rmdir (tmpdir);
+}
+
+
+static float *render (void)
+{
+    int                         i, j, k, n, d, r, t;
+    float                       *out, *q;
+    float                       W [PERIOD], X [PERIOD], Y [PERIOD], Z [PERIOD], R [PERIOD];
+    Diskstream                  dstream;
+    std::unique_ptr <Asection>  asect [NASECT];
+    std::unique_ptr <Division>  divis [NDIVIS];
+    std::unique_ptr <Rankwave>  P;
+    Premix                      *M;
+    Reverb                      reverb (fsamp);
+    Upsampler                   upsamp;
+    float                       U [NCHOUT][4 * PERIOD];
+    float                       *chan [NCHOUT];
+    Event                       *E;
+
+    Rankwave::set_seed (seed);
+    Rankwave::set_release_floor (relfloor);
+    Rankwave::set_voice_limit (maxvoice);
+    Rankwave::set_profile (profile);
+    // Without a thread the streams are read on demand, so the
+    // output does not depend on timing.
+    Rankwave::set_stream (&dstream);
+
+    reverb.set_t60mf (revtime);
+    reverb.set_t60lo (revtime * 1.50f, 250.0f);
+    reverb.set_t60hi (revtime * 0.50f, 3e3f);
+    reverb.set_delay (revsize);
+    reverb.set_reduced (profile == PROF_LITE);
+    for (i = 0; i < nasect; i++)
+    {
+        asect [i] = std::make_unique <Asection> ((float) fsamp);
+        asect [i]->set_size (revsize);
+        asect [i]->set_ntaps ((profile == PROF_FULL) ? 16 : 8);
+    }
+    for (d = 0; d < ndivis; d++)
+    {
+        divis [d] = std::make_unique <Division> (asect [dasect [d]].get (), (float) fsamp);
+        divis [d]->set_div_mask (0);
+        divis [d]->set_tfreq (tfreq [d]);
+        divis [d]->set_tmodd (tmodd [d]);
+        for (r = 0; r < nranks [d]; r++)
+        {
+            Addsynth *A = &synths [d][r];
+            P = std::make_unique <Rankwave> (A->_n0, A->_n1);
+            if (maketables (P.get (), A, d, r))
+	    {
+                fprintf (stderr, "Can't make the wavetables of '%s'\n", A->_filename);
+                return 0;
+	    }
+            if (*smpdir) P->load_samples (smpdir, A, fsamp);
+            divis [d]->set_rank (r, std::move (P), A->_pan, A->_del);
+        }
+    }
+
+    if (upsfact > 1) upsamp.init (NCHOUT, upsfact, PERIOD);
+    out = new float [nperiod * PERIOD * upsfact * NCHOUT];
+    E = events;
+    for (t = 0, q = out; t < nperiod; t++)
+    {
+        for (; (E < events + nevent) && (E->_time == t); E++)
+        {
+            switch (E->_type)
+            {
+            case EV_STOP:
+                if (E->_value > 0) divis [E->_divis]->set_rank_mask (E->_index, NKEYBD);
+                else               divis [E->_divis]->clr_rank_mask (E->_index, NKEYBD);
+                break;
+            case EV_KEY:
+                keymap [E->_index] = (E->_value > 0) ? (1 | KMAP_SET) : KMAP_SET;
+                break;
+            case EV_SWELL:
+                divis [E->_divis]->set_swell (E->_value);
+                break;
+            case EV_TREM:
+                if (E->_value > 0) divis [E->_divis]->trem_on ();
+                else               divis [E->_divis]->trem_off ();
+                break;
+            case EV_PREMIX:
+                // Compiled at once here, by the slave thread in Aeolus.
+                M = new Premix ();
+                if (divis [E->_divis]->get_premix (M))
+                {
+                    M->compile ();
+                    M = divis [E->_divis]->set_premix (M);
+                }
+                delete M;
+                break;
+            }
+        }
+
+        // Same sequence as Audio::proc_keys1(), proc_keys2() and proc_synth().
+        for (k = 0; k < NNOTES; k++)
+        {
+            if (keymap [k] & KMAP_SET)
+            {
+                keymap [k] ^= KMAP_SET;
+                for (d = 0; d < ndivis; d++) divis [d]->update (k, keymap [k] & KMAP_ALL);
+            }
+        }
+        for (d = 0; d < ndivis; d++) divis [d]->update (keymap);
+
+        memset (W, 0, sizeof (W));
+        memset (X, 0, sizeof (X));
+        memset (Y, 0, sizeof (Y));
+        memset (Z, 0, sizeof (Z));
+        memset (R, 0, sizeof (R));
+        for (d = 0; d < ndivis; d++) divis [d]->process ();
+        for (i = 0; i < nasect; i++) asect [i]->process (volume, W, X, Y, R);
+        reverb.process (PERIOD, volume, R, W, X, Y, Z);
+
+        chan [0] = W;
+        chan [1] = X;
+        chan [2] = Y;
+        chan [3] = Z;
+        n = PERIOD;
+        if (upsfact > 1)
+	{
+            // As in Audio::proc_synth(), to the output rate.
+            for (i = 0; i < NCHOUT; i++)
+	    {
+                std::copy_n (chan [i], PERIOD, upsamp.inp (i));
+                chan [i] = U [i];
+	    }
+            upsamp.process (chan, PERIOD);
+            n = PERIOD * upsfact;
+	}
+        for (j = 0; j < n; j++)
+        {
+            *q++ = chan [0][j];
+            *q++ = chan [1][j];
+            *q++ = chan [2][j];
+            *q++ = chan [3][j];
+        }
+    }
+    return out;
+}
+
+
+static int writeref (const char *file, const float *data, int nfram)
+{
+    FILE    *F;
+    Refhdr  H;
+
+    if (! (F = fopen (file, "w")))
+    {
+        fprintf (stderr, "Can't open '%s' for writing\n", file);
+        return 1;
+    }
+    memset (&H, 0, sizeof (H));
+    memcpy (H._magic, "aeolusrf", 8);
+    H._fsamp = fsamp * upsfact;
+    H._nchan = NCHOUT;
+    H._nfram = nfram;
+    if (   (fwrite (&H, sizeof (H), 1, F) != 1)
+        || (fwrite (data, sizeof (float) * NCHOUT, nfram, F) != (size_t) nfram))
+    {
+        fprintf (stderr, "Error writing '%s'\n", file);
+        fclose (F);
+        return 1;
+    }
+    fclose (F);
+    printf ("Wrote %d frames to '%s'\n", nfram, file);
+    return 0;
+}
+
+
+static int compare (const char *file, const float *data, int nfram, double tol)
+{
+    FILE    *F;
+    Refhdr  H;
+    float   *ref;
+    double  d, e, peak, emax, esum, rsum;
+    int     i, j, ierr;
+
+    if (! (F = fopen (file, "r")))
+    {
+        fprintf (stderr, "Can't open '%s' for reading\n", file);
+        return 1;
+    }
+    if (   (fread (&H, sizeof (H), 1, F) != 1)
+        || memcmp (H._magic, "aeolusrf", 8)
+        || (H._fsamp != fsamp * upsfact) || (H._nchan != NCHOUT) || (H._nfram != nfram))
+    {
+        fprintf (stderr, "Reference '%s' does not match the script\n", file);
+        fclose (F);
+        return 1;
+    }
+    ref = new float [nfram * NCHOUT];
+    if (fread (ref, sizeof (float) * NCHOUT, nfram, F) != (size_t) nfram)
+    {
+        fprintf (stderr, "Reference '%s' is truncated\n", file);
+        delete[] ref;
+        fclose (F);
+        return 1;
+    }
+    fclose (F);
+
+    peak = emax = esum = rsum = 0;
+    ierr = -1;
+    for (i = 0; i < nfram * NCHOUT; i++)
+    {
+        d = ref [i];
+        e = fabs (data [i] - d);
+        if (fabs (d) > peak) peak = fabs (d);
+        if (e > emax) emax = e;
+        if ((e > 0) && (ierr < 0)) ierr = i;
+        esum += e * e;
+        rsum += d * d;
+    }
+    delete[] ref;
+
+    j = (emax <= tol * peak);
+    printf ("%s: peak %.4e, max error %.4e, rms error %.1f dB",
+            j ? "PASS" : "FAIL", peak, emax,
+            (esum > 0) ? 10 * log10 (esum / rsum) : -999.0);
+    if (ierr >= 0) printf (", first difference at frame %d channel %d", ierr / NCHOUT, ierr % NCHOUT);
+    printf ("\n");
+    return j ? 0 : 1;
+}
+
+
+static void help (void)
+{
+    fprintf (stderr, "\nAeolus regression test %s\n\n", VERSION);
+    fprintf (stderr, "Usage: aeolus_regress <options> <stops dir> <script> <reference>\n");
+    fprintf (stderr, "Options:\n");
+    fprintf (stderr, "  -h                 Display this text\n");
+    fprintf (stderr, "  -w                 Write the reference instead of comparing\n");
+    fprintf (stderr, "  -t <tolerance>     Maximum error relative to peak level [1e-4], 0 for exact\n");
+    exit (1);
+}
+
+
+int main (int ac, char *av [])
+{
+    int     k, nfram;
+    bool    wr;
+    double  tol;
+    float   *out;
+
+    wr = false;
+    tol = 1e-4;
+    while ((k = getopt (ac, av, "hwt:")) != -1)
+    {
+        switch (k)
+        {
+        case 'w' : wr = true; break;
+        case 't' : tol = atof (optarg); break;
+        default: help ();
+        }
+    }
+    if (ac - optind != 3) help ();
+    stopsdir = av [optind];
+    if (readscript (av [optind + 1])) return 1;
+
+    out = render ();
+    cleanup ();
+    if (! out) return 1;
+    nfram = nperiod * PERIOD * upsfact;
+    k = wr ? writeref (av [optind + 2], out, nfram) : compare (av [optind + 2], out, nfram, tol);
+    delete[] out;
+    return k;
+}